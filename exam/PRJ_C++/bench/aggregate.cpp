@@ -0,0 +1,51 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+/**
+ * Range sums on a red-black tree of 1M random keys augmented with sum_of:
+ * aggregate(a, b) against the walk from lower_bound(a) up to b, over
+ * ranges that cover from 16 keys to the whole tree. Every measure answers
+ * the same random ranges; the cost of the walk grows with the width of the
+ * range, the one of aggregate stays bounded by the height.
+ */
+
+using tree = bst<long,long,std::less<long>,augmented<sum_of<long>,red_black>>;
+
+int main(){
+    std::mt19937_64 gen{42};
+    const long n = 1000000;
+
+    std::vector<long> keys(n);
+    for(long i = 0; i < n; ++i){keys[i] = i;}
+    std::shuffle(keys.begin(), keys.end(), gen);
+    tree t;
+    for(auto k : keys){t.insert(std::pair<long,long>{k, k % 1000});}
+
+    for(long width : {16L, 1024L, 65536L, n}){
+        const std::size_t queries = width == n ? 10 : static_cast<std::size_t>(20000000 / (width + 1000));
+        std::vector<long> from(queries);
+        for(auto& a : from){a = static_cast<long>(gen() % static_cast<unsigned long>(n - width + 1));}
+        std::cout << "ranges of " << width << " keys" << std::endl;
+
+        long walked = 0, aggregated = 0;
+        report("  lower_bound and walk", queries, time_ms([&](){
+            for(auto a : from){
+                auto end = t.cend();
+                for(auto i = t.lower_bound(a); i != end && *i < a + width; ++i){walked += i.value();}
+            }
+        }));
+        report("  aggregate", queries, time_ms([&](){
+            for(auto a : from){aggregated += t.aggregate(a, a + width - 1);}
+        }));
+        if(walked != aggregated){
+            std::cout << "  MISMATCH: " << walked << " != " << aggregated << std::endl;
+            return 1;
+        }
+        do_not_optimize(aggregated);
+    }
+    return 0;
+}
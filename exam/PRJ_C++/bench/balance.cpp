@@ -0,0 +1,46 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+/**
+ * Cost of bst::balance on a random tree and on a degenerate one
+ * (sorted keys), followed by a find of every key on the balanced tree.
+ */
+
+void run(const std::string& name, const std::vector<int>& keys, bool sorted){
+    bst<int,int> tree;
+    for(auto k : keys){
+        if(sorted){tree.insert(tree.end(), std::pair<int,int>{k,k});}
+        else{tree.insert(std::pair<int,int>{k,k});}
+    }
+
+    auto balance = time_ms([&](){tree.balance();});
+
+    long sum = 0;
+    auto find = time_ms([&](){
+        for(auto k : keys){
+            sum += tree.find(k).value();
+        }
+    });
+    do_not_optimize(sum);
+
+    report(name + " balance", keys.size(), balance);
+    report(name + " find after balance", keys.size(), find);
+}
+
+int main(){
+    std::mt19937 gen{42};
+
+    for(int n : {10000, 100000, 1000000}){
+        std::vector<int> keys(n);
+        for(int i = 0; i < n; ++i){keys[i] = i;}
+        run("sorted", keys, true);
+
+        std::shuffle(keys.begin(), keys.end(), gen);
+        run("random", keys, false);
+    }
+    return 0;
+}
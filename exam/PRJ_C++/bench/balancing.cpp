@@ -0,0 +1,46 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+/**
+ * Sequential-key insert followed by a find of every key,
+ * for each balancing policy. Sequential keys are the worst case
+ * of the unbalanced tree, which degenerates into a list.
+ */
+
+template <typename BAL>
+void run(const std::string& name, int n){
+    bst<int,int,std::less<int>,BAL> tree;
+
+    auto insert = time_ms([&](){
+        for(int i = 0; i < n; ++i){
+            tree.insert(std::pair<int,int>{i,i});
+        }
+    });
+
+    long sum = 0;
+    auto find = time_ms([&](){
+        for(int i = 0; i < n; ++i){
+            sum += tree.find(i).value();
+        }
+    });
+    do_not_optimize(sum);
+
+    report(name + " insert", n, insert);
+    report(name + " find", n, find);
+}
+
+int main(){
+    for(int n : {1000, 10000, 20000}){
+        run<unbalanced>("unbalanced", n);
+        run<red_black>("red_black", n);
+        run<avl>("avl", n);
+        run<splay<>>("splay", n);
+    }
+    // the unbalanced tree is quadratic, so only the self-adjusting ones go further
+    for(int n : {1000000}){
+        run<red_black>("red_black", n);
+        run<avl>("avl", n);
+        run<splay<>>("splay", n);
+    }
+    return 0;
+}
@@ -0,0 +1,67 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+/**
+ * Batched lookups on red-black trees with random keys, from trees that fit
+ * in the caches to trees much larger than the LLC: batches of 64 to 1024
+ * keys, random or sorted, looked up one find at a time and with
+ * find_batch and contains_batch. Every measure performs 1M lookups.
+ */
+
+using tree = bst<long,long,std::less<long>,red_black>;
+
+int main(){
+    std::mt19937_64 gen{42};
+    const std::size_t lookups = 1 << 20;
+
+    for(std::size_t n : {10000, 1000000, 8000000}){
+        std::vector<long> keys(n);
+        for(std::size_t i = 0; i < n; ++i){keys[i] = 2 * static_cast<long>(i);}
+        std::shuffle(keys.begin(), keys.end(), gen);
+        tree t;
+        for(auto k : keys){t.insert(std::pair<long,long>{k, k});}
+
+        std::vector<long> queries(lookups);
+        for(auto& q : queries){q = static_cast<long>(gen() % (2 * n));}   // half of them are missing
+        std::cout << "tree of " << n << " keys" << std::endl;
+
+        for(std::size_t batch : {64, 256, 1024}){
+            for(bool sorted : {false, true}){
+                auto q = queries;
+                if(sorted){
+                    for(std::size_t b = 0; b < lookups; b += batch){std::sort(q.begin() + b, q.begin() + b + batch);}
+                }
+                auto what = std::string{sorted ? "sorted" : "random"} + " batches of " + std::to_string(batch);
+                std::vector<tree::const_iterator> out(batch);
+                std::vector<char> found(batch);
+                const tree& c = t;
+                long sum = 0;
+
+                report("  " + what + ", find", lookups, time_ms([&](){
+                    for(std::size_t b = 0; b < lookups; b += batch){
+                        for(std::size_t i = 0; i < batch; ++i){out[i] = c.find(q[b + i]);}
+                        sum += out[batch - 1] != c.end();
+                    }
+                }));
+                report("  " + what + ", find_batch", lookups, time_ms([&](){
+                    for(std::size_t b = 0; b < lookups; b += batch){
+                        c.find_batch(q.begin() + b, q.begin() + b + batch, out.begin());
+                        sum += out[batch - 1] != c.end();
+                    }
+                }));
+                report("  " + what + ", contains_batch", lookups, time_ms([&](){
+                    for(std::size_t b = 0; b < lookups; b += batch){
+                        c.contains_batch(q.begin() + b, q.begin() + b + batch, found.begin());
+                        sum += found[batch - 1];
+                    }
+                }));
+                do_not_optimize(sum);
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,75 @@
+#ifndef _BENCH_
+#define _BENCH_
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+/**
+ * Header with the helpers shared by the benchmarks in this folder.
+ */
+
+/**
+ * @brief Run f once and return the elapsed wall-clock time in milliseconds
+ * 
+ * @param f callable to be timed
+ */
+template <typename F>
+double time_ms(F&& f){
+    auto start = std::chrono::steady_clock::now();
+    f();
+    auto stop = std::chrono::steady_clock::now();
+    return std::chrono::duration<double, std::milli>(stop - start).count();
+}
+
+/**
+ * @brief Print one line of results
+ * 
+ * @param what name of the measured operation
+ * @param n number of keys
+ * @param ms elapsed time in milliseconds
+ */
+inline void report(const std::string& what, std::size_t n, double ms){
+    std::cout << what << "\tn = " << n << "\t" << ms << " ms\t"
+              << ms * 1e6 / n << " ns/op" << std::endl;
+}
+
+/**
+ * @brief Keep the optimizer from discarding a value
+ */
+template <typename T>
+void do_not_optimize(const T& x){
+    asm volatile("" : : "r,m"(x) : "memory");
+}
+
+/**
+ * @brief Zipf distribution over the ranks [0, n), as in YCSB (Gray et al.)
+ */
+class zipf{
+    double theta, zetan, alpha, eta, half_pow;
+    long n;
+
+public:
+    zipf(long items, double t = 0.99): theta{t}, zetan{0}, n{items} {
+        for(long i = 1; i <= n; ++i){zetan += 1 / std::pow(static_cast<double>(i), theta);}
+        auto zeta2 = 1 + std::pow(0.5, theta);
+        alpha = 1 / (1 - theta);
+        eta = (1 - std::pow(2.0 / n, 1 - theta)) / (1 - zeta2 / zetan);
+        half_pow = 1 + std::pow(0.5, theta);
+    }
+
+    template <typename G>
+    long operator()(G& gen){
+        auto u = std::uniform_real_distribution<double>{0, 1}(gen);
+        auto uz = u * zetan;
+        if(uz < 1){return 0;}
+        if(uz < half_pow){return 1;}
+        auto rank = static_cast<long>(n * std::pow(eta * u - eta + 1, alpha));
+        return std::min(rank, n - 1);
+    }
+};
+
+#endif
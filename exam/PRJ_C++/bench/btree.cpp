@@ -0,0 +1,49 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Random insertions, lookups, a full traversal and random erasures
+ * on a red-black tree and on B+ trees with different node sizes.
+ */
+
+template <typename tree>
+void run(const std::string& name, const std::vector<int>& keys, const std::vector<int>& queries){
+    tree t;
+    long sum = 0;
+    report(name + " insert", keys.size(), time_ms([&](){
+        for(auto k : keys){t.insert(std::pair<int,int>{k,k});}
+    }));
+    report(name + " find", queries.size(), time_ms([&](){
+        for(auto k : queries){sum += t.find(k) != t.end();}
+    }));
+    report(name + " iteration", keys.size(), time_ms([&](){
+        for(auto i = t.begin(); i != t.end(); ++i){sum += i.value();}
+    }));
+    report(name + " erase", keys.size(), time_ms([&](){
+        for(auto k : queries){if(t.find(k) != t.end()){t.erase(k);}}
+    }));
+    do_not_optimize(sum);
+}
+
+int main(){
+    std::mt19937 gen{42};
+
+    for(int n : {100000, 1000000}){
+        std::vector<int> keys(n);
+        for(int i = 0; i < n; ++i){keys[i] = i;}
+        std::shuffle(keys.begin(), keys.end(), gen);
+        std::vector<int> queries(keys);
+        std::shuffle(queries.begin(), queries.end(), gen);
+
+        run<bst<int,int,std::less<int>,red_black>>("red_black", keys, queries);
+        run<bst<int,int,std::less<int>,btree<16>>>("btree<16>", keys, queries);
+        run<bst<int,int,std::less<int>,btree<>>>("btree<64>", keys, queries);
+        run<bst<int,int,std::less<int>,btree<256>>>("btree<256>", keys, queries);
+    }
+    return 0;
+}
@@ -0,0 +1,46 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+/**
+ * Loading a red-black tree from a snapshot of pairs:
+ * repeated insert against bulk_load, for a sorted and a shuffled snapshot.
+ */
+
+using tree = bst<int,int,std::less<int>,red_black>;
+
+int main(){
+    std::mt19937 gen{42};
+
+    for(int n : {10000, 100000, 1000000}){
+        std::vector<std::pair<int,int>> snapshot(n);
+        for(int i = 0; i < n; ++i){snapshot[i] = std::pair<int,int>{i,i};}
+
+        tree a;
+        report("sorted insert", n, time_ms([&](){
+            for(auto& p : snapshot){a.insert(p);}
+        }));
+
+        tree b;
+        report("sorted insert at end()", n, time_ms([&](){
+            for(auto& p : snapshot){b.insert(b.end(), p);}
+        }));
+
+        tree c;
+        report("sorted bulk_load", n, time_ms([&](){c.bulk_load(snapshot.begin(), snapshot.end());}));
+
+        std::shuffle(snapshot.begin(), snapshot.end(), gen);
+
+        tree d;
+        report("shuffled insert", n, time_ms([&](){
+            for(auto& p : snapshot){d.insert(p);}
+        }));
+
+        tree e;
+        report("shuffled bulk_load", n, time_ms([&](){e.bulk_load(snapshot.begin(), snapshot.end());}));
+    }
+    return 0;
+}
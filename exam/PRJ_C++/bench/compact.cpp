@@ -0,0 +1,81 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+/**
+ * The compact engine against the red-black bst, both with int keys and
+ * values: memory per pair, measured with an allocator that counts the
+ * bytes it hands out, random insert, random find, iteration and erase of
+ * half of the keys, then the insertion of as many new ones (which reuse
+ * the free slots of the compact engine), from trees that fit in the
+ * caches to trees much larger than the LLC.
+ */
+
+std::size_t allocated = 0;
+
+/**
+ * @brief std::allocator that keeps track of the bytes in use
+ */
+template <typename T>
+struct counting: std::allocator<T>{
+    template <typename U> struct rebind{using other = counting<U>;};
+
+    counting() noexcept = default;
+    template <typename U> counting(const counting<U>&) noexcept {}
+
+    T* allocate(std::size_t n){
+        allocated += n * sizeof(T);
+        return std::allocator<T>::allocate(n);
+    }
+    void deallocate(T* p, std::size_t n) noexcept {
+        allocated -= n * sizeof(T);
+        std::allocator<T>::deallocate(p, n);
+    }
+};
+
+template <typename BAL>
+void run(const std::string& name, const std::vector<int>& keys, const std::vector<int>& queries){
+    using tree = bst<int,int,std::less<int>,BAL,counting<std::pair<int,int>>>;
+    auto n = keys.size();
+    auto before = allocated;
+    tree t;
+
+    report(name + " random insert", n, time_ms([&](){
+        for(auto k : keys){t.insert(std::pair<int,int>{k, k});}
+    }));
+    std::cout << "  " << double(allocated - before) / n << " bytes/pair" << std::endl;
+
+    long sum = 0;
+    report(name + " random find", queries.size(), time_ms([&](){
+        for(auto q : queries){sum += t.find(q).value();}
+    }));
+    report(name + " iterate", n, time_ms([&](){
+        for(auto i = t.cbegin(); i != t.cend(); ++i){sum += i.value();}
+    }));
+    report(name + " erase half", n / 2, time_ms([&](){
+        for(std::size_t i = 0; i < n / 2; ++i){t.erase(keys[i]);}
+    }));
+    report(name + " insert half again", n / 2, time_ms([&](){
+        for(std::size_t i = 0; i < n / 2; ++i){t.insert(std::pair<int,int>{-keys[i] - 1, 0});}
+    }));
+    std::cout << "  " << double(allocated - before) / t.size() << " bytes/pair" << std::endl;
+    do_not_optimize(sum);
+}
+
+int main(){
+    std::mt19937 gen{42};
+    for(int n : {10000, 1000000, 4000000}){
+        std::vector<int> keys(n);
+        for(int i = 0; i < n; ++i){keys[i] = i;}
+        std::shuffle(keys.begin(), keys.end(), gen);
+        std::vector<int> queries(1000000);
+        for(auto& q : queries){q = keys[gen() % n];}
+
+        run<red_black>("red_black", keys, queries);
+        run<compact>("compact", keys, queries);
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+/**
+ * Throughput of a mixed workload of find, insert and erase on random keys,
+ * from 1 to 64 threads and for several read ratios: concurrent_bst against
+ * a red-black bst behind a global mutex. Every thread runs the same
+ * share of a fixed number of operations.
+ * The scaling depends on the number of cores of the machine.
+ */
+
+using tree = bst<int,int,std::less<int>,red_black>;
+
+constexpr int keys = 1 << 20;
+constexpr int ops = 1 << 19;
+
+/**
+ * @brief Run the workload on threads threads and return the elapsed time
+ *
+ * @param reads percentage of the operations that are lookups; the rest are
+ * split evenly between insert and erase, so that the size stays around keys/2
+ * @param find, insert, erase the operations on the tree under test
+ */
+template <typename Find, typename Insert, typename Erase>
+double run(int threads, int reads, Find find, Insert insert, Erase erase){
+    return time_ms([&](){
+        std::vector<std::thread> pool;
+        for(int t = 0; t < threads; ++t){
+            pool.emplace_back([&, t](){
+                std::mt19937 gen(t);
+                long found = 0;
+                for(int i = 0; i < ops / threads; ++i){
+                    int key = gen() % keys;
+                    int op = gen() % 100;
+                    if(op < reads){found += find(key);}
+                    else if(op % 2){insert(key);}
+                    else{erase(key);}
+                }
+                do_not_optimize(found);
+            });
+        }
+        for(auto& th : pool){th.join();}
+    });
+}
+
+int main(){
+    std::cout << "hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+
+    // both trees start balanced, with every other key
+    std::vector<std::pair<int,int>> half;
+    for(int i = 0; i < keys; i += 2){half.emplace_back(i, i);}
+    std::shuffle(half.begin(), half.end(), std::mt19937{42});
+
+    for(int reads : {100, 90, 50}){
+        std::cout << "\nreads " << reads << "%" << std::endl;
+        for(int threads = 1; threads <= 64; threads *= 2){
+            concurrent_bst<int,int> c{half.begin(), half.end()};
+            report("concurrent_bst\tthreads = " + std::to_string(threads), ops, run(threads, reads,
+                [&c](int k){return c.contains(k);},
+                [&c](int k){c.insert(std::pair<int,int>{k, k});},
+                [&c](int k){c.erase(k);}));
+
+            tree b;
+            std::mutex m;
+            for(auto& x : half){b.insert(x);}
+            report("bst + mutex\tthreads = " + std::to_string(threads), ops, run(threads, reads,
+                [&](int k){std::lock_guard<std::mutex> g{m}; return b.find(k) != b.end();},
+                [&](int k){std::lock_guard<std::mutex> g{m}; b.insert(std::pair<int,int>{k, k});},
+                [&](int k){std::lock_guard<std::mutex> g{m}; if(b.find(k) != b.end()){b.erase(k);}}));
+        }
+    }
+    return 0;
+}
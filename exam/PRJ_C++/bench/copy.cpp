@@ -0,0 +1,48 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Cost of copying and destroying a bst with non-trivial pairs, on a random
+ * tree and on a degenerate one (sorted keys, one node per level).
+ * Copy and destruction do not recurse, so the degenerate tree does not
+ * overflow the stack even with millions of nodes.
+ */
+
+using tree = bst<int,std::string>;
+
+void run(const std::string& name, const std::vector<int>& keys, bool sorted){
+    tree t;
+    for(auto k : keys){
+        if(sorted){t.insert(t.end(), std::pair<int,std::string>{k, std::to_string(k)});}
+        else{t.insert(std::pair<int,std::string>{k, std::to_string(k)});}
+    }
+
+    std::vector<tree> copies(5);
+    auto copy = time_ms([&](){
+        for(auto& c : copies){c = t;}
+    });
+    auto destroy = time_ms([&](){
+        for(auto& c : copies){c.clear();}
+    });
+
+    report(name + " copy", keys.size() * copies.size(), copy);
+    report(name + " destroy", keys.size() * copies.size(), destroy);
+}
+
+int main(){
+    std::mt19937 gen{42};
+
+    for(int n : {10000, 100000, 1000000}){
+        std::vector<int> keys(n);
+        for(int i = 0; i < n; ++i){keys[i] = i;}
+        run("sorted", keys, true);
+        std::shuffle(keys.begin(), keys.end(), gen);
+        run("random", keys, false);
+    }
+    return 0;
+}
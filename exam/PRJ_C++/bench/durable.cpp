@@ -0,0 +1,92 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <cstdio>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * Durable updates of a bst through its write-ahead log: updates that wait
+ * for the disk, from 1 to 64 threads (group commit lets the waiting writers
+ * share one fdatasync), updates committed in one batch against the same
+ * inserts without a log and against writing the same number of bytes
+ * sequentially with one fdatasync, then checkpoint
+ * and recovery (replay of the log) at startup.
+ */
+
+using durable = durable_bst<long,long>;
+
+const std::string snapshot = "/tmp/bst_bench_durable.bin";
+const std::string log_file = "/tmp/bst_bench_durable.log";
+
+void clean(){
+    std::remove(snapshot.c_str());
+    std::remove(log_file.c_str());
+}
+
+int main(){
+    for(int threads : {1, 4, 16, 64}){
+        clean();
+        durable d{snapshot, log_file};
+        constexpr int total = 1 << 13;
+        auto ms = time_ms([&](){
+            std::vector<std::thread> pool;
+            for(int t = 0; t < threads; ++t){
+                pool.emplace_back([&d, t, threads](){
+                    for(long i = t; i < total; i += threads){d.insert(std::pair<long,long>{i, i});}
+                });
+            }
+            for(auto& t : pool){t.join();}
+        });
+        report("every_update insert, " + std::to_string(threads) + " threads", total, ms);
+    }
+
+    for(int n : {100000, 1000000}){
+        clean();
+        std::mt19937 gen{42};
+        std::uint64_t bytes;
+        {
+            durable d{snapshot, log_file, durability::on_commit};
+            report("on_commit insert + commit", n, time_ms([&](){
+                for(int i = 0; i < n; ++i){d.insert(std::pair<long,long>{static_cast<long>(gen()), i});}
+                d.commit();
+            }));
+            bytes = d.log_size();
+
+            std::mt19937 same{42};
+            bst<long,long,std::less<long>,red_black> memory;
+            report("insert in memory, no log", n, time_ms([&](){
+                for(int i = 0; i < n; ++i){memory.insert(std::pair<long,long>{static_cast<long>(same()), i});}
+            }));
+
+            std::vector<char> raw(bytes, 'x');
+            auto path = log_file + ".raw";
+            report("sequential write + fdatasync of as many bytes", n, time_ms([&](){
+                auto fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+                for(std::size_t done = 0; done < raw.size();){
+                    auto w = ::write(fd, raw.data() + done, std::min<std::size_t>(raw.size() - done, 1 << 20));
+                    if(w <= 0){break;}
+                    done += static_cast<std::size_t>(w);
+                }
+                fdatasync(fd);
+                ::close(fd);
+            }));
+            std::remove(path.c_str());
+            std::cout << "\t\tlog: " << bytes / n << " bytes per record, " << bytes / 1000000.0 << " MB" << std::endl;
+        }
+
+        report("recovery: replay of the log", n, time_ms([&](){durable d{snapshot, log_file, durability::on_commit};}));
+        {
+            durable d{snapshot, log_file, durability::on_commit};
+            report("checkpoint", n, time_ms([&](){d.checkpoint();}));
+        }
+        report("recovery: load of the checkpoint", n, time_ms([&](){durable d{snapshot, log_file, durability::on_commit};}));
+    }
+    clean();
+    return 0;
+}
@@ -0,0 +1,58 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <random>
+#include <vector>
+
+/**
+ * Random lookups on a red-black tree built by random insertions
+ * and on its frozen snapshot (Eytzinger layout).
+ * The largest tree (10M keys, about 400 MB of nodes) does not fit in the LLC.
+ */
+
+using tree = bst<int,int,std::less<int>,red_black>;
+
+int main(){
+    std::mt19937 gen{42};
+
+    for(int n : {100000, 1000000, 10000000}){
+        tree t;
+        for(int i = 0; i < n; ++i){
+            int k = gen();
+            t.insert(std::pair<int,int>{k,k});
+        }
+
+        frozen_bst<int,int> f;
+        report("freeze", n, time_ms([&](){f = t.freeze();}));
+
+        std::vector<int> queries(1000000);
+        for(auto& q : queries){q = gen();}               // mostly misses
+        std::vector<int> hits(queries.size());
+        {
+            std::vector<int> keys(f.begin(), f.end());
+            for(auto& h : hits){h = keys[gen() % keys.size()];}
+        }
+
+        long sum = 0;
+        report("bst find hit", hits.size(), time_ms([&](){
+            for(auto k : hits){sum += t.find(k).value();}
+        }));
+        report("frozen find hit", hits.size(), time_ms([&](){
+            for(auto k : hits){sum += f.find(k).value();}
+        }));
+        report("bst find miss", queries.size(), time_ms([&](){
+            for(auto k : queries){sum += t.find(k) == t.end();}
+        }));
+        report("frozen find miss", queries.size(), time_ms([&](){
+            for(auto k : queries){sum += f.find(k) == f.end();}
+        }));
+        report("frozen lower_bound", queries.size(), time_ms([&](){
+            for(auto k : queries){sum += f.lower_bound(k) == f.end();}
+        }));
+        report("frozen iteration", f.size(), time_ms([&](){
+            for(auto i = f.begin(); i != f.end(); ++i){sum += i.value();}
+        }));
+        do_not_optimize(sum);
+    }
+    return 0;
+}
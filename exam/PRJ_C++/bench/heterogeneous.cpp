@@ -0,0 +1,64 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <experimental/string_view>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * String keys looked up from views of char buffers, as when they come
+ * from the network: with std::less<std::string> every find first builds a
+ * std::string (the keys are longer than the small string buffer, so it
+ * allocates), with the transparent std::less<> the view is compared with
+ * the keys directly. The same for try_emplace of keys already present.
+ * A const char* would work as well, but every comparison with it would
+ * measure its length again.
+ */
+
+using view = std::experimental::string_view;
+
+template <typename T, typename K>
+void run(const std::string& what, const std::vector<std::string>& keys, const std::vector<view>& buffers, K key){
+    T t;
+    for(auto& k : keys){t.insert(std::pair<std::string,int>{k, 1});}
+
+    long sum = 0;
+    report(what, buffers.size(), time_ms([&](){
+        for(auto& b : buffers){sum += t.find(key(b)).value();}
+    }));
+    report("  try_emplace of present keys", buffers.size(), time_ms([&](){
+        for(auto& b : buffers){sum += t.try_emplace(key(b), 0).second;}
+    }));
+    do_not_optimize(sum);
+}
+
+int main(){
+    std::mt19937 gen{42};
+    for(int n : {1000, 100000, 1000000}){
+        std::vector<std::string> keys(n);
+        char text[64];
+        for(int i = 0; i < n; ++i){
+            std::snprintf(text, sizeof(text), "session:%016d", i);
+            keys[i] = text;
+        }
+        std::shuffle(keys.begin(), keys.end(), gen);
+
+        std::vector<char> network(1000000 * 24);                 // the keys as they arrive, one after the other
+        std::vector<view> buffers;
+        for(std::size_t i = 0; i < 1000000; ++i){
+            auto& k = keys[gen() % n];
+            std::copy(k.begin(), k.end(), network.begin() + i * 24);
+            buffers.emplace_back(network.data() + i * 24, k.size());
+        }
+
+        auto size = " (" + std::to_string(n) + " keys)";
+        run<bst<std::string,int,std::less<std::string>,red_black>>("find(std::string{view}), std::less<std::string>" + size,
+                                                                   keys, buffers, [](view b){return std::string{b};});
+        run<bst<std::string,int,std::less<>,red_black>>("find(view), std::less<>" + size,
+                                                        keys, buffers, [](view b){return b;});
+    }
+    return 0;
+}
@@ -0,0 +1,73 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * A tree that lives in a memory-mapped file: random insert and find on a
+ * mapped_bst against an avl bst in memory, the cost of sync, and the
+ * restart of the process: reopening the mapped_bst against loading a
+ * bst from a snapshot file. The files are in the page cache.
+ */
+
+using tree = bst<long,long,std::less<long>,avl>;
+using mapped = mapped_bst<long,long>;
+
+int main(){
+    std::mt19937 gen{42};
+    const std::string file = "/tmp/bst_bench_mapped.tree";
+    const std::string snapshot = "/tmp/bst_bench_mapped.bin";
+
+    for(int n : {100000, 1000000, 4000000}){
+        std::vector<long> keys(n);
+        for(int i = 0; i < n; ++i){keys[i] = 2L * i;}
+        std::shuffle(keys.begin(), keys.end(), gen);
+        std::vector<long> queries(1000000);
+        for(auto& q : queries){q = static_cast<long>(gen() % (2 * n));}
+
+        std::remove(file.c_str());
+        long sum = 0;
+        {
+            mapped m{file};
+            tree t;
+            report("mapped_bst insert", n, time_ms([&](){
+                for(auto k : keys){m.insert(std::pair<long,long>{k, k});}
+            }));
+            report("bst insert", n, time_ms([&](){
+                for(auto k : keys){t.insert(std::pair<long,long>{k, k});}
+            }));
+            report("mapped_bst find", queries.size(), time_ms([&](){
+                for(auto q : queries){
+                    auto i = m.find(q);
+                    if(i != m.end()){sum += i.value();}
+                }
+            }));
+            report("bst find", queries.size(), time_ms([&](){
+                for(auto q : queries){
+                    auto i = t.find(q);
+                    if(i != t.end()){sum += i.value();}
+                }
+            }));
+            report("mapped_bst sync", n, time_ms([&](){m.sync();}));
+            t.save(snapshot);
+        }
+
+        report("restart: reopen mapped_bst and find 1000 keys", 1, time_ms([&](){
+            mapped m{file};
+            for(int i = 0; i < 1000; ++i){sum += m.contains(queries[i]);}
+        }));
+        report("restart: load bst and find 1000 keys", 1, time_ms([&](){
+            tree t;
+            t.load(snapshot);
+            for(int i = 0; i < 1000; ++i){sum += t.find(queries[i]) != t.end();}
+        }));
+        do_not_optimize(sum);
+    }
+    std::remove(file.c_str());
+    std::remove(snapshot.c_str());
+    return 0;
+}
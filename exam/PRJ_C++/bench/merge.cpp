@@ -0,0 +1,76 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+/**
+ * Recombining red-black trees: merge of two trees with interleaved keys,
+ * join of two trees with disjoint ranges and split at the median key,
+ * against inserting the pairs of one tree into the other (or into two
+ * new trees, for the split). The trees are built by random insertions,
+ * so their nodes are scattered in memory as in a long lived tree.
+ * The split of a plain tree counts the nodes of the smaller part, the one
+ * of an order_statistic tree knows the sizes of the subtrees.
+ */
+
+using tree = bst<int,int,std::less<int>,red_black>;
+using counted = bst<int,int,std::less<int>,order_statistic<red_black>>;
+
+/**
+ * @brief Build a tree out of the keys first, first + step, ... (n keys), inserted in random order
+ */
+template <typename tree = ::tree>
+tree make(int n, int first, int step, std::mt19937& gen){
+    std::vector<std::pair<int,int>> pairs;
+    for(int i = 0; i < n; ++i){pairs.emplace_back(first + i * step, i);}
+    std::shuffle(pairs.begin(), pairs.end(), gen);
+    tree t;
+    for(auto& x : pairs){t.insert(x);}
+    return t;
+}
+
+int main(){
+    for(int n : {10000, 100000, 1000000}){
+        {
+            std::mt19937 gen{42}, same{42};                     // c and d are laid out in memory as a and b
+            auto a = make(n, 0, 2, gen);
+            auto b = make(n, 1, 2, gen);
+            auto c = make(n, 0, 2, same);
+            auto d = make(n, 1, 2, same);
+            report("merge interleaved", 2 * n, time_ms([&](){a.merge(std::move(b));}));
+            report("insert interleaved", 2 * n, time_ms([&](){
+                for(auto i = d.cbegin(); i != d.cend(); ++i){c.insert(std::pair<int,int>{*i, i.value()});}
+            }));
+            do_not_optimize(a.size() + c.size());
+        }
+        {
+            std::mt19937 gen{42}, same{42};
+            auto a = make(n, 0, 1, gen);
+            auto b = make(n, n, 1, gen);
+            auto c = make(n, 0, 1, same);
+            auto d = make(n, n, 1, same);
+            report("join disjoint", 2 * n, time_ms([&](){a.join(std::move(b));}));
+            report("insert disjoint", 2 * n, time_ms([&](){
+                for(auto i = d.cbegin(); i != d.cend(); ++i){c.insert(c.end(), std::pair<int,int>{*i, i.value()});}
+            }));
+
+            tree upper;
+            report("split at median", 2 * n, time_ms([&](){upper = a.split(n);}));
+            auto e = make(2 * n, 0, 1, same);
+            tree low, high;
+            report("insert into two trees", 2 * n, time_ms([&](){
+                for(auto i = e.cbegin(); i != e.cend(); ++i){
+                    auto& t = *i < n ? low : high;
+                    t.insert(t.end(), std::pair<int,int>{*i, i.value()});
+                }
+            }));
+            auto f = make<counted>(2 * n, 0, 1, same);
+            counted counted_upper;
+            report("split at median, order_statistic", 2 * n, time_ms([&](){counted_upper = f.split(n);}));
+            do_not_optimize(a.size() + upper.size() + low.size() + high.size() + c.size() + counted_upper.size());
+        }
+    }
+    return 0;
+}
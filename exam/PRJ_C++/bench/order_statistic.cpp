@@ -0,0 +1,54 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Cost of the order statistic augmentation on random insertions and erasures,
+ * then rank and select against the linear walk they replace.
+ */
+
+template <typename tree>
+void updates(const std::string& name, const std::vector<int>& keys){
+    tree t;
+    report(name + " insert", keys.size(), time_ms([&](){
+        for(auto k : keys){t.insert(std::pair<int,int>{k,k});}
+    }));
+    report(name + " erase", keys.size(), time_ms([&](){
+        for(auto k : keys){t.erase(k);}
+    }));
+}
+
+int main(){
+    std::mt19937 gen{42};
+
+    for(int n : {100000, 1000000}){
+        std::vector<int> keys(n);
+        for(int i = 0; i < n; ++i){keys[i] = i;}
+        std::shuffle(keys.begin(), keys.end(), gen);
+
+        updates<bst<int,int,std::less<int>,red_black>>("red_black", keys);
+        updates<bst<int,int,std::less<int>,order_statistic<red_black>>>("order_statistic<red_black>", keys);
+
+        bst<int,int,std::less<int>,order_statistic<red_black>> t;
+        for(auto k : keys){t.insert(std::pair<int,int>{k,k});}
+
+        long sum = 0;
+        int queries = 100000;
+        report("rank", queries, time_ms([&](){
+            for(int q = 0; q < queries; ++q){sum += t.rank(gen() % n);}
+        }));
+        report("select", queries, time_ms([&](){
+            for(int q = 0; q < queries; ++q){sum += *t.select(gen() % n);}
+        }));
+        report("linear select", queries / 10000, time_ms([&](){
+            for(int q = 0; q < queries / 10000; ++q){sum += *std::next(t.begin(), gen() % n);}
+        }));
+        do_not_optimize(sum);
+    }
+    return 0;
+}
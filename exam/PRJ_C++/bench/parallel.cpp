@@ -0,0 +1,48 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <random>
+#include <thread>
+#include <vector>
+
+/**
+ * Tree construction above the parallel cutoff: bulk_load of a shuffled
+ * snapshot (parallel sort and build), copy, and parallel_bulk_insert of
+ * batches against inserting the same pairs one by one.
+ * The speedup depends on the number of cores of the machine.
+ */
+
+using tree = bst<int,int,std::less<int>,red_black>;
+
+int main(){
+    std::cout << "hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+    std::mt19937 gen{42};
+
+    for(int n : {1000000, 10000000}){
+        std::vector<std::pair<int,int>> snapshot;
+        for(int i = 0; i < n; ++i){snapshot.emplace_back(i, i);}
+        std::shuffle(snapshot.begin(), snapshot.end(), gen);
+
+        tree t;
+        report("bulk_load shuffled", n, time_ms([&](){t.bulk_load(snapshot.begin(), snapshot.end());}));
+        report("copy", n, time_ms([&](){tree c{t}; do_not_optimize(c.size());}));
+
+        // a second half of the keys, in batches of 10% of the tree
+        std::vector<std::pair<int,int>> batch;
+        for(int i = 0; i < n; ++i){batch.emplace_back(n + gen() % n, i);}
+
+        tree p{t};
+        report("parallel_bulk_insert", n, time_ms([&](){
+            for(int b = 0; b < 10; ++b){
+                p.parallel_bulk_insert(batch.begin() + b * (n / 10), batch.begin() + (b + 1) * (n / 10));
+            }
+        }));
+        tree s{t};
+        report("insert one by one", n, time_ms([&](){
+            for(auto& x : batch){s.insert(x);}
+        }));
+        do_not_optimize(p.size() + s.size());
+    }
+    return 0;
+}
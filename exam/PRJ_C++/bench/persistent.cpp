@@ -0,0 +1,77 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+/**
+ * Cost of taking a snapshot after every update: a persistent bst, whose
+ * snapshots are constant time copies sharing the nodes, against the deep
+ * copy of a red-black bst. The nodes of the persistent bst are counted,
+ * to show how many of them all the snapshots keep alive together.
+ */
+
+std::size_t live_nodes = 0;
+
+/**
+ * @brief Allocator that counts the nodes alive
+ */
+template <typename T>
+struct counting_allocator{
+    using value_type = T;
+
+    counting_allocator() = default;
+    template <typename U>
+    counting_allocator(const counting_allocator<U>&) noexcept {}
+
+    T* allocate(std::size_t n){
+        live_nodes += n;
+        return std::allocator<T>{}.allocate(n);
+    }
+    void deallocate(T* p, std::size_t n) noexcept {
+        live_nodes -= n;
+        std::allocator<T>{}.deallocate(p, n);
+    }
+
+    friend bool operator==(const counting_allocator&, const counting_allocator&) noexcept {return true;}
+    friend bool operator!=(const counting_allocator&, const counting_allocator&) noexcept {return false;}
+};
+
+using persistent = persistent_bst<int,int,std::less<int>,counting_allocator<std::pair<int,int>>>;
+using tree = bst<int,int,std::less<int>,red_black>;
+
+int main(){
+    std::mt19937 gen{42};
+    constexpr int snapshots = 1000;
+
+    for(int n : {10000, 100000, 1000000}){
+        std::vector<std::pair<int,int>> pairs;
+        for(int i = 0; i < n; ++i){pairs.emplace_back(2 * i, i);}
+
+        persistent p{pairs.begin(), pairs.end()};
+        auto before = live_nodes;
+        std::vector<persistent> versions;
+        versions.reserve(snapshots);
+        report("persistent snapshot + update", snapshots, time_ms([&](){
+            for(int i = 0; i < snapshots; ++i){
+                versions.push_back(p.snapshot());
+                p.insert(std::pair<int,int>{static_cast<int>(gen() % (2 * n)) | 1, i});   // a new odd key
+            }
+        }));
+        std::cout << "\t\tnodes alive: " << live_nodes << " for " << snapshots + 1
+                  << " versions of about " << n << " keys (" << before << " for one)" << std::endl;
+        versions.clear();
+
+        tree b{pairs.begin(), pairs.end()};
+        int copies = std::max(1, snapshots * 10000 / n);
+        std::vector<tree> deep(copies);
+        report("bst copy + update", copies, time_ms([&](){
+            for(auto& c : deep){
+                c = b;
+                b.insert(std::pair<int,int>{static_cast<int>(gen() % (2 * n)) | 1, 0});
+            }
+        }));
+    }
+    return 0;
+}
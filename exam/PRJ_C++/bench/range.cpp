@@ -0,0 +1,45 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <random>
+
+/**
+ * Time-window queries: sum of the values of the keys in [a, a + width)
+ * on a red-black tree and on a B+ tree, located with lower_bound
+ * or by scanning from begin() as it was done before lower_bound existed.
+ */
+
+template <typename tree>
+void run(const std::string& name, int n, int width, int queries){
+    tree t;
+    for(int i = 0; i < n; ++i){t.insert(t.end(), std::pair<int,int>{i,i});}
+
+    std::mt19937 gen{42};
+    long sum = 0;
+    report(name + " lower_bound window", queries, time_ms([&](){
+        for(int q = 0; q < queries; ++q){
+            int a = gen() % n;
+            for(auto i = t.lower_bound(a); i != t.end() && *i < a + width; ++i){sum += i.value();}
+        }
+    }));
+    report(name + " scan window", queries / 100, time_ms([&](){
+        for(int q = 0; q < queries / 100; ++q){
+            int a = gen() % n;
+            for(auto i = t.begin(); i != t.end() && *i < a + width; ++i){
+                if(*i >= a){sum += i.value();}
+            }
+        }
+    }));
+    report(name + " reverse iteration", n, time_ms([&](){
+        for(auto i = t.rbegin(); i != t.rend(); ++i){sum += i.value();}
+    }));
+    do_not_optimize(sum);
+}
+
+int main(){
+    for(int n : {100000, 1000000}){
+        run<bst<int,int,std::less<int>,red_black>>("red_black", n, 100, 100000);
+        run<bst<int,int,std::less<int>,btree<>>>("btree", n, 100, 100000);
+    }
+    return 0;
+}
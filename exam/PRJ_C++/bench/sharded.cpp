@@ -0,0 +1,74 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+/**
+ * Write-heavy ingest from 1 to 64 threads: every thread inserts random keys
+ * of its own range, then erases half of them. A sharded bst, whose shards
+ * follow the key ranges of the threads, against a single red-black bst
+ * behind a mutex. The last test ingests sequential keys, the worst skew:
+ * all the writes go to the last shard, which keeps splitting.
+ * The scaling depends on the number of cores of the machine.
+ */
+
+using tree = bst<int,int,std::less<int>,red_black>;
+
+constexpr int ops = 1 << 20;
+
+/**
+ * @brief Run the ingest on threads threads and return the elapsed time
+ *
+ * @param insert, erase the operations on the container under test
+ */
+template <typename Insert, typename Erase>
+double run(int threads, Insert insert, Erase erase){
+    return time_ms([&](){
+        std::vector<std::thread> pool;
+        for(int t = 0; t < threads; ++t){
+            pool.emplace_back([&, t](){
+                std::mt19937 gen(t);
+                int per_thread = ops / threads;
+                int base = t * per_thread * 4;                  // a disjoint range per thread
+                for(int i = 0; i < per_thread; ++i){
+                    int key = base + gen() % (per_thread * 4);
+                    if(i % 3 == 2){erase(key);}
+                    else{insert(key);}
+                }
+            });
+        }
+        for(auto& th : pool){th.join();}
+    });
+}
+
+int main(){
+    std::cout << "hardware threads: " << std::thread::hardware_concurrency() << std::endl;
+
+    for(int threads = 1; threads <= 64; threads *= 2){
+        sharded_bst<int,int> s{1 << 14};
+        report("sharded_bst\tthreads = " + std::to_string(threads), ops, run(threads,
+            [&s](int k){s.insert(std::pair<int,int>{k, k});},
+            [&s](int k){s.erase(k);}));
+        std::cout << "\t\tshards: " << s.shard_count() << std::endl;
+
+        tree b;
+        std::mutex m;
+        report("bst + mutex\tthreads = " + std::to_string(threads), ops, run(threads,
+            [&](int k){std::lock_guard<std::mutex> g{m}; b.insert(std::pair<int,int>{k, k});},
+            [&](int k){std::lock_guard<std::mutex> g{m}; if(b.find(k) != b.end()){b.erase(k);}}));
+    }
+
+    sharded_bst<int,int> sequential{1 << 14};
+    report("\nsharded_bst sequential keys", ops, time_ms([&](){
+        for(int i = 0; i < ops; ++i){sequential.insert(std::pair<int,int>{i, i});}
+    }));
+    std::cout << "\t\tshards: " << sequential.shard_count() << std::endl;
+    tree b;
+    report("bst sequential keys", ops, time_ms([&](){
+        for(int i = 0; i < ops; ++i){b.insert(std::pair<int,int>{i, i});}
+    }));
+    return 0;
+}
@@ -0,0 +1,70 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+/**
+ * Persisting a red-black bst: the binary snapshot written by save, loaded
+ * back by load or mapped and searched in place by a mapped_snapshot,
+ * against printing the keys with operator<< and inserting them back.
+ * The files are in the page cache, so the times do not include the disk.
+ */
+
+using tree = bst<long,long,std::less<long>,red_black>;
+
+int main(){
+    std::mt19937 gen{42};
+    const std::string binary = "/tmp/bst_bench_snapshot.bin";
+    const std::string text = "/tmp/bst_bench_snapshot.txt";
+
+    for(int n : {100000, 1000000, 4000000}){
+        std::vector<long> keys(n);
+        for(int i = 0; i < n; ++i){keys[i] = 2L * i;}
+        std::shuffle(keys.begin(), keys.end(), gen);
+        tree t;
+        for(auto k : keys){t.insert(std::pair<long,long>{k, k});}
+
+        report("save", n, time_ms([&](){t.save(binary);}));
+        report("operator<< to a file", n, time_ms([&](){
+            std::ofstream os{text};
+            os << t;
+        }));
+
+        tree loaded;
+        report("load", n, time_ms([&](){loaded.load(binary);}));
+        tree inserted;
+        report("read a file and insert", n, time_ms([&](){
+            std::ifstream is{text};
+            long k;
+            while(is >> k){inserted.insert(inserted.end(), std::pair<long,long>{k, k});}
+        }));
+
+        mapped_snapshot<long,long> mapped;
+        report("open mapped_snapshot", 1, time_ms([&](){mapped = mapped_snapshot<long,long>{binary};}));
+
+        std::vector<long> queries(1000000);
+        for(auto& q : queries){q = static_cast<long>(gen() % (2 * n));}
+        long sum = 0;
+        report("find on mapped_snapshot", queries.size(), time_ms([&](){
+            for(auto q : queries){
+                auto i = mapped.find(q);
+                if(i != mapped.end()){sum += i.value();}
+            }
+        }));
+        report("find on bst", queries.size(), time_ms([&](){
+            for(auto q : queries){
+                auto i = t.find(q);
+                if(i != t.end()){sum += i.value();}
+            }
+        }));
+        do_not_optimize(sum + loaded.size() + inserted.size());
+    }
+    std::remove(binary.c_str());
+    std::remove(text.c_str());
+    return 0;
+}
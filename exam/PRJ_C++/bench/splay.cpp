@@ -0,0 +1,65 @@
+#define BST_STATS
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+/**
+ * Skewed lookups on trees of 1M random keys: the queries are drawn from
+ * Zipf distributions (theta = 0.99, as in YCSB, and 0.8) over the keys,
+ * the hottest ones scattered, and from the uniform one. The splay policy,
+ * which moves every hit (or one every 4 or 16 hits) to the root, against
+ * the unbalanced tree built by the same random insertions and the
+ * red-black one. Built with BST_STATS: after the time of the lookups each
+ * tree reports the comparisons and the nodes visited per lookup.
+ */
+
+template <typename T>
+void run(const char* what, const std::vector<long>& keys, const std::vector<long>& queries){
+    T t;
+    for(auto k : keys){t.insert(std::pair<long,long>{k, k});}
+    t.reset_stats();
+
+    long sum = 0;
+    report(what, queries.size(), time_ms([&](){
+        for(auto q : queries){sum += t.find(q).value();}
+    }));
+    do_not_optimize(sum);
+    auto s = t.stats();
+    std::cout << "  comparisons/find = " << s.comparisons_per_operation() << ", nodes/find = " << s.nodes_per_operation()
+              << ", height = " << s.height << std::endl;
+}
+
+int main(){
+    std::mt19937_64 gen{42};
+    const long n = 1000000;
+    const std::size_t lookups = 2000000;
+
+    std::vector<long> keys(n);
+    for(long i = 0; i < n; ++i){keys[i] = i;}
+    std::shuffle(keys.begin(), keys.end(), gen);
+    auto hot = keys;                                    // hot[i] is the key drawn with rank i
+    std::shuffle(hot.begin(), hot.end(), gen);
+
+    for(double theta : {0.99, 0.8, 0.0}){
+        std::vector<long> queries(lookups);
+        if(theta > 0){
+            zipf z{n, theta};
+            for(auto& q : queries){q = hot[z(gen)];}
+            std::cout << "Zipf, theta = " << theta << std::endl;
+        }
+        else{
+            for(auto& q : queries){q = static_cast<long>(gen() % n);}
+            std::cout << "uniform" << std::endl;
+        }
+
+        run<bst<long,long>>("  find, unbalanced", keys, queries);
+        run<bst<long,long,std::less<long>,red_black>>("  find, red_black", keys, queries);
+        run<bst<long,long,std::less<long>,splay<>>>("  find, splay<1>", keys, queries);
+        run<bst<long,long,std::less<long>,splay<4>>>("  find, splay<4>", keys, queries);
+        run<bst<long,long,std::less<long>,splay<16>>>("  find, splay<16>", keys, queries);
+    }
+    return 0;
+}
@@ -0,0 +1,56 @@
+#define BST_STATS
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+/**
+ * Instrumentation of the bst (built with BST_STATS): sequential keys
+ * inserted into an unbalanced tree, which degenerates into a list,
+ * with and without auto_rebalance at a few factors, followed by random
+ * lookups; the stats of each tree show the shape it ends with and the
+ * nodes visited by the lookups. A red-black tree is the reference.
+ */
+
+template <typename T>
+void run(const char* what, int n, double factor){
+    T t;
+    if(factor > 0){t.auto_rebalance(factor);}
+    report(what, n, time_ms([&](){
+        for(int i = 0; i < n; ++i){t.insert(std::pair<int,int>{i, i});}
+    }));
+
+    std::mt19937 gen{42};
+    std::vector<int> queries(n);
+    for(auto& q : queries){q = static_cast<int>(gen() % n);}
+    auto balances = t.stats().auto_balances;
+    t.reset_stats();
+    long sum = 0;
+    report("  random find", n, time_ms([&](){
+        for(auto q : queries){sum += t.find(q).value();}
+    }));
+    do_not_optimize(sum);
+    auto s = t.stats();
+    std::cout << "  height = " << s.height << ", average depth = " << s.average_depth
+              << ", nodes/find = " << s.nodes_per_operation() << ", automatic balances = " << balances << std::endl;
+}
+
+int main(){
+    using plain = bst<int,int>;
+    using rb = bst<int,int,std::less<int>,red_black>;
+
+    for(int n : {10000, 50000}){
+        run<plain>("sequential insert, unbalanced", n, 0);
+        run<plain>("sequential insert, unbalanced, auto_rebalance(1.5)", n, 1.5);
+        run<plain>("sequential insert, unbalanced, auto_rebalance(2)", n, 2);
+        run<plain>("sequential insert, unbalanced, auto_rebalance(4)", n, 4);
+        run<rb>("sequential insert, red_black", n, 0);
+    }
+    for(int n : {1000000}){
+        run<plain>("sequential insert, unbalanced, auto_rebalance(2)", n, 2);
+        run<rb>("sequential insert, red_black", n, 0);
+    }
+    return 0;
+}
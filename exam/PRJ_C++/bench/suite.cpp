@@ -0,0 +1,297 @@
+#include "bst.hpp"
+#include "bench.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+/**
+ * Benchmark suite: the bst (red-black) against std::map and
+ * std::unordered_map, for every combination of
+ * - key and value types: int/int, string/int and int/large value (256 bytes)
+ * - workloads: the keys are inserted, looked up and erased in random,
+ *   sorted or reverse order, or in random order with the lookups drawn
+ *   from a Zipf distribution (theta = 0.99, the hottest keys scattered)
+ * - sizes: from --min to --max keys, ten times larger at every step
+ * - operations: insert, find_hit, find_miss, erase, iterate, copy,
+ *   balance (bst only) and operator[]
+ *
+ * Every measure is repeated --reps times on the same data, generated from
+ * --seed, and the median is reported. The results go to the standard
+ * output as CSV, and to the files given with --csv and --json; every row
+ * carries the version of the sources (BENCH_VERSION, set by the Makefile)
+ * so that results of different versions can be compared.
+ *
+ * usage: suite.x [--min N] [--max N] [--reps R] [--seed S] [--csv FILE] [--json FILE]
+ */
+
+#ifndef BENCH_VERSION
+#define BENCH_VERSION "unknown"
+#endif
+
+/**
+ * @brief A value of 256 bytes
+ */
+struct large{
+    std::array<char,256> bytes;
+    large(int x = 0) noexcept {bytes.fill(static_cast<char>(x));}
+};
+
+/**
+ * @brief The i-th key of each type: the keys of the containers are the
+ * even ones, the odd ones are the misses
+ */
+template <typename k_t> k_t make_key(long i);
+template <> int make_key<int>(long i) {return static_cast<int>(i);}
+template <> std::string make_key<std::string>(long i) {
+    char buffer[24];
+    std::snprintf(buffer, sizeof(buffer), "key%016ld", i);
+    return buffer;
+}
+
+template <typename k_t> const char* key_name();
+template <> const char* key_name<int>() {return "int";}
+template <> const char* key_name<std::string>() {return "string";}
+
+template <typename v_t> const char* value_name();
+template <> const char* value_name<int>() {return "int";}
+template <> const char* value_name<large>() {return "large";}
+
+/**
+ * @brief The orders of the keys of a workload: insertion, lookups and erasure,
+ * as indices of the keys
+ */
+struct workload{
+    std::vector<long> insert, find, erase;
+};
+
+workload make_workload(const std::string& name, long n, long queries, std::mt19937_64& gen){
+    workload w;
+    w.insert.resize(n);
+    for(long i = 0; i < n; ++i){w.insert[i] = i;}
+    if(name == "reverse"){std::reverse(w.insert.begin(), w.insert.end());}
+    if(name == "random" || name == "zipf"){std::shuffle(w.insert.begin(), w.insert.end(), gen);}
+    w.erase = w.insert;
+
+    w.find.resize(queries);
+    if(name == "zipf"){                                         // the ranks are scattered over the keys
+        zipf z{n};
+        for(auto& q : w.find){q = w.insert[z(gen)];}
+    }
+    else if(name == "random"){
+        for(auto& q : w.find){q = static_cast<long>(gen() % n);}
+    }
+    else{
+        for(long i = 0; i < queries; ++i){w.find[i] = w.insert[i % n];}
+    }
+    return w;
+}
+
+/**
+ * @brief Uniform interface to the containers
+ */
+template <typename C>
+struct adapter{
+    using key_type = typename C::key_type;
+    using mapped_type = typename C::mapped_type;
+    static void insert(C& c, const key_type& k, const mapped_type& v) {c.emplace(k, v);}
+    static bool find(const C& c, const key_type& k) {return c.find(k) != c.end();}
+    static void erase(C& c, const key_type& k) {c.erase(k);}
+    static std::size_t iterate(const C& c){
+        std::size_t n = 0;
+        for(auto& x : c){n += sizeof(x.second); do_not_optimize(&x.second);}
+        return n;
+    }
+    static bool balance(C&) {return false;}
+};
+
+template <typename k_t, typename v_t, typename BAL>
+struct adapter<bst<k_t,v_t,std::less<k_t>,BAL>>{
+    using C = bst<k_t,v_t,std::less<k_t>,BAL>;
+    using key_type = k_t;
+    using mapped_type = v_t;
+    static void insert(C& c, const k_t& k, const v_t& v) {c.insert(std::pair<k_t,v_t>{k, v});}
+    static bool find(const C& c, const k_t& k) {return c.find(k) != c.end();}
+    static void erase(C& c, const k_t& k) {c.erase(k);}
+    static std::size_t iterate(const C& c){
+        std::size_t n = 0;
+        for(auto i = c.cbegin(); i != c.cend(); ++i){n += sizeof(i.value()); do_not_optimize(&i.value());}
+        return n;
+    }
+    static bool balance(C& c) {c.balance(); return true;}
+};
+
+template <typename C> const char* container_name();
+
+/**
+ * @brief One row of results
+ */
+struct result{
+    std::string container, key, value, workload, operation;
+    long n, ops;
+    double ms;
+};
+
+struct options{
+    long min = 1000, max = 1000000, reps = 3;
+    unsigned long seed = 42;
+    std::string csv, json;
+};
+
+/**
+ * @brief Median of reps measures of f; before every measure reset() prepares the data
+ */
+template <typename R, typename F>
+double measure(long reps, R&& reset, F&& f){
+    std::vector<double> times;
+    for(long r = 0; r < reps; ++r){
+        reset();
+        times.push_back(time_ms(f));
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+template <typename C>
+void run(const std::string& name, const std::string& load, long n, const options& opt, std::vector<result>& out){
+    using A = adapter<C>;
+    using k_t = typename A::key_type;
+    using v_t = typename A::mapped_type;
+
+    std::mt19937_64 gen{opt.seed + static_cast<unsigned long>(n)};
+    long queries = std::min(n, 1000000L);
+    auto w = make_workload(load, n, queries, gen);
+    std::vector<k_t> keys, hits, misses;                         // built in advance, not timed
+    keys.reserve(n);
+    for(auto i : w.insert){keys.push_back(make_key<k_t>(2 * i));}
+    for(auto i : w.find){hits.push_back(make_key<k_t>(2 * i)); misses.push_back(make_key<k_t>(2 * i + 1));}
+    std::vector<k_t> erased;
+    erased.reserve(n);
+    for(auto i : w.erase){erased.push_back(make_key<k_t>(2 * i));}
+
+    auto add = [&](const char* operation, long ops, double ms){
+        out.push_back(result{name, key_name<k_t>(), value_name<v_t>(), load, operation, n, ops, ms});
+        std::cerr << name << " " << key_name<k_t>() << "/" << value_name<v_t>() << " " << load << " n = " << n
+                  << " " << operation << ": " << ms * 1e6 / ops << " ns/op" << std::endl;
+    };
+    auto fill = [&](C& c){
+        c.clear();
+        for(std::size_t i = 0; i < keys.size(); ++i){A::insert(c, keys[i], v_t(static_cast<int>(i)));}
+    };
+
+    C c;
+    add("insert", n, measure(opt.reps, [&](){c.clear();}, [&](){
+        for(std::size_t i = 0; i < keys.size(); ++i){A::insert(c, keys[i], v_t(static_cast<int>(i)));}
+    }));
+
+    std::size_t found = 0;
+    auto nothing = [](){};
+    add("find_hit", queries, measure(opt.reps, nothing, [&](){
+        for(auto& k : hits){found += A::find(c, k);}
+    }));
+    add("find_miss", queries, measure(opt.reps, nothing, [&](){
+        for(auto& k : misses){found += A::find(c, k);}
+    }));
+    add("operator[]", queries, measure(opt.reps, nothing, [&](){
+        for(auto& k : hits){do_not_optimize(&c[k]);}
+    }));
+    add("iterate", n, measure(opt.reps, nothing, [&](){found += A::iterate(c);}));
+    {
+        C copy;
+        add("copy", n, measure(opt.reps, [&](){copy.clear();}, [&](){copy = c;}));
+    }
+    if(A::balance(c)){
+        add("balance", n, measure(opt.reps, [&](){fill(c);}, [&](){A::balance(c);}));
+    }
+    add("erase", n, measure(opt.reps, [&](){fill(c);}, [&](){
+        for(auto& k : erased){A::erase(c, k);}
+    }));
+    do_not_optimize(found);
+}
+
+template <typename k_t, typename v_t>
+void run_types(const options& opt, std::vector<result>& out){
+    for(auto load : {"random", "sorted", "reverse", "zipf"}){
+        for(long n = opt.min; n <= opt.max; n *= 10){
+            run<bst<k_t,v_t,std::less<k_t>,red_black>>("bst", load, n, opt, out);
+            run<std::map<k_t,v_t>>("std::map", load, n, opt, out);
+            run<std::unordered_map<k_t,v_t>>("std::unordered_map", load, n, opt, out);
+        }
+    }
+}
+
+/**
+ * @brief Escape a string for CSV and JSON: the names used here need quotes only
+ */
+std::string quoted(const std::string& s) {return "\"" + s + "\"";}
+
+void write_csv(std::ostream& os, const std::vector<result>& rows){
+    os << "version,container,key,value,workload,n,operation,ops,ms,ns_per_op\n";
+    for(auto& r : rows){
+        os << quoted(BENCH_VERSION) << "," << quoted(r.container) << "," << quoted(r.key) << "," << quoted(r.value) << ","
+           << quoted(r.workload) << "," << r.n << "," << quoted(r.operation) << "," << r.ops << ","
+           << r.ms << "," << r.ms * 1e6 / r.ops << "\n";
+    }
+}
+
+void write_json(std::ostream& os, const std::vector<result>& rows, const options& opt){
+    os << "{\n  \"version\": " << quoted(BENCH_VERSION) << ",\n  \"compiler\": " << quoted(__VERSION__)
+       << ",\n  \"seed\": " << opt.seed << ",\n  \"reps\": " << opt.reps << ",\n  \"results\": [\n";
+    for(std::size_t i = 0; i < rows.size(); ++i){
+        auto& r = rows[i];
+        os << "    {\"container\": " << quoted(r.container) << ", \"key\": " << quoted(r.key)
+           << ", \"value\": " << quoted(r.value) << ", \"workload\": " << quoted(r.workload)
+           << ", \"n\": " << r.n << ", \"operation\": " << quoted(r.operation) << ", \"ops\": " << r.ops
+           << ", \"ms\": " << r.ms << ", \"ns_per_op\": " << r.ms * 1e6 / r.ops << "}"
+           << (i + 1 < rows.size() ? ",\n" : "\n");
+    }
+    os << "  ]\n}\n";
+}
+
+int main(int argc, char** argv){
+    options opt;
+    for(int i = 1; i + 1 < argc; i += 2){
+        std::string flag = argv[i];
+        std::string value = argv[i + 1];
+        if(flag == "--min"){opt.min = std::atol(value.c_str());}
+        else if(flag == "--max"){opt.max = std::atol(value.c_str());}
+        else if(flag == "--reps"){opt.reps = std::atol(value.c_str());}
+        else if(flag == "--seed"){opt.seed = std::strtoul(value.c_str(), nullptr, 10);}
+        else if(flag == "--csv"){opt.csv = value;}
+        else if(flag == "--json"){opt.json = value;}
+        else{
+            std::cerr << "usage: " << argv[0] << " [--min N] [--max N] [--reps R] [--seed S] [--csv FILE] [--json FILE]" << std::endl;
+            return 1;
+        }
+    }
+    if(opt.min < 1 || opt.max < opt.min || opt.reps < 1){
+        std::cerr << "ERROR: invalid sizes or repetitions" << std::endl;
+        return 1;
+    }
+
+    std::vector<result> rows;
+    run_types<int,int>(opt, rows);
+    run_types<std::string,int>(opt, rows);
+    run_types<int,large>(opt, rows);
+
+    write_csv(std::cout, rows);
+    if(!opt.csv.empty()){
+        std::ofstream os{opt.csv};
+        write_csv(os, rows);
+    }
+    if(!opt.json.empty()){
+        std::ofstream os{opt.json};
+        write_json(os, rows, opt);
+    }
+    return 0;
+}
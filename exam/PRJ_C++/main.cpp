@@ -1,5 +1,10 @@
 #include "bst.hpp"
+#include <cstdio>
+#include <fstream>
 #include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
 
 
 int main(){
@@ -90,6 +95,364 @@ int main(){
     std::cout << cp << std::endl;
 
 
+    std::cout << "\nTESTS ON BALANCING POLICIES:" << std::endl;
+    bst<int,int,std::less<int>,red_black> rb;
+    bst<int,int,std::less<int>,avl> av;
+    for(int i = 0; i < 10; ++i){        // sorted keys: the worst case for the default policy
+        rb.insert(std::pair<int,int>{i,i});
+        av.emplace(i,i);
+    }
+    rb.erase(3);
+    av.erase(3);
+    std::cout << "red_black after inserting 0..9 and erasing 3" << std::endl;
+    std::cout << rb << std::endl;
+    std::cout << "avl after inserting 0..9 and erasing 3" << std::endl;
+    std::cout << av << std::endl;
+
+
+    std::cout << "\nTESTS ON INSERTION WITH HINT, TRY_EMPLACE AND INSERT_OR_ASSIGN:" << std::endl;
+    bst<int,int> hinted;
+    for(int i = 0; i < 10; ++i){
+        hinted.insert(hinted.end(), std::pair<int,int>{i,i});   // keys in order: constant time
+    }
+    hinted.try_emplace(5, 50);          // 5 is present: nothing happens
+    hinted.try_emplace(20, 20);
+    hinted.insert_or_assign(3, 30);     // 3 is present: its value becomes 30
+    std::cout << "hinted" << std::endl;
+    std::cout << hinted << std::endl;
+    std::cout << "hinted[5] = " << hinted[5] << ", hinted[3] = " << hinted[3] << std::endl;
+
+
+    std::cout << "\nTESTS ON BULK LOAD:" << std::endl;
+    std::vector<std::pair<int,int>> snapshot;
+    for(int i = 0; i < 15; ++i){
+        snapshot.emplace_back(i, i*i);
+    }
+    bst<int,int> loaded{snapshot.begin(), snapshot.end()};
+    std::cout << "bst built from the sorted pairs (0,0) ... (14,196)" << std::endl;
+    std::cout << loaded << std::endl;
+    std::cout << "loaded[12] = " << loaded[12] << std::endl;
+    std::vector<std::pair<int,int>> batch{{20,400}, {16,256}, {3,-1}, {18,324}};
+    loaded.parallel_bulk_insert(batch.begin(), batch.end());     // 3 is already present
+    std::cout << "loaded after parallel_bulk_insert of 20, 16, 3 and 18" << std::endl;
+    std::cout << loaded << std::endl;
+    std::cout << "loaded[3] = " << loaded[3] << ", loaded[16] = " << loaded[16] << std::endl;
+
+
+    std::cout << "\nTESTS ON RANGE QUERIES:" << std::endl;
+    std::cout << "keys of loaded in [3, 8):";
+    for(auto i = loaded.lower_bound(3); i != loaded.lower_bound(8); ++i){
+        std::cout << " " << *i;
+    }
+    std::cout << std::endl << "loaded in reverse order:";
+    for(auto i = loaded.rbegin(); i != loaded.rend(); ++i){
+        std::cout << " " << *i;
+    }
+    auto range = loaded.equal_range(12);
+    std::cout << std::endl << "equal_range(12) = [" << *range.first << ", " << *range.second
+              << "), upper_bound(20) is end(): " << (loaded.upper_bound(20) == loaded.end()) << std::endl;
+
+
+    std::cout << "\nTESTS ON ORDER STATISTICS:" << std::endl;
+    bst<int,int,std::less<int>,order_statistic<red_black>> ranked;
+    for(int i = 0; i < 20; i += 2){
+        ranked.insert(std::pair<int,int>{i,i});
+    }
+    ranked.erase(6);
+    std::cout << ranked << std::endl;
+    std::cout << "size = " << ranked.size() << ", rank(7) = " << ranked.rank(7)
+              << ", select(4) = " << *ranked.select(4)
+              << ", count_range(3, 12) = " << ranked.count_range(3, 12) << std::endl;
+
+
+    std::cout << "\nTESTS ON MERGE, SPLIT AND JOIN:" << std::endl;
+    bst<int,int,std::less<int>,red_black> evens, odds;
+    for(int i = 0; i < 20; ++i){
+        (i % 2 ? odds : evens).insert(std::pair<int,int>{i, i});
+    }
+    evens.merge(std::move(odds));
+    std::cout << "merge of evens and odds, size = " << evens.size() << ", size of odds = " << odds.size() << std::endl;
+    std::cout << evens << std::endl;
+    auto upper = evens.split(12);
+    std::cout << "split at 12" << std::endl;
+    std::cout << evens << std::endl;
+    std::cout << upper << std::endl;
+    upper.join(std::move(evens));
+    std::cout << "join back, size = " << upper.size() << std::endl;
+    std::cout << upper << std::endl;
+    bst<int,int,std::less<int>,red_black> small_rb;
+    bst<int,int,std::less<int>,avl> small_avl;
+    for(int i = 1; i <= 3; ++i){
+        small_rb.insert(std::pair<int,int>{i, i});
+        small_avl.insert(std::pair<int,int>{i, i});
+    }
+    auto rb_upper = small_rb.split(2);                          // both parts are subtrees cut out of the path
+    auto avl_upper = small_avl.split(2);
+    for(int i = 4; i <= 6; ++i){
+        small_rb.insert(std::pair<int,int>{-i, -i});
+        rb_upper.insert(std::pair<int,int>{i, i});
+        small_avl.insert(std::pair<int,int>{-i, -i});
+        avl_upper.insert(std::pair<int,int>{i, i});
+    }
+    std::cout << "split of 1 2 3 at 2, then insertions into both parts" << std::endl;
+    std::cout << small_rb << std::endl;
+    std::cout << rb_upper << std::endl;
+    std::cout << small_avl << std::endl;
+    std::cout << avl_upper << std::endl;
+
+
+    std::cout << "\nTESTS ON FREEZE:" << std::endl;
+    auto frozen = loaded.freeze();
+    std::cout << "frozen snapshot of loaded" << std::endl;
+    std::cout << frozen << std::endl;
+    std::cout << "value of 7 = " << frozen.find(7).value()
+              << ", first key not smaller than 21 is end(): " << (frozen.lower_bound(21) == frozen.end()) << std::endl;
+
+
+    std::cout << "\nTESTS ON SNAPSHOT FILES:" << std::endl;
+    loaded.save("loaded.snapshot");
+    bst<int,int,std::less<int>,red_black> reloaded;
+    reloaded.load("loaded.snapshot");
+    std::cout << "loaded saved to loaded.snapshot and loaded back" << std::endl;
+    std::cout << reloaded << std::endl;
+    {
+        mapped_snapshot<int,int> mapped{"loaded.snapshot"};
+        std::cout << "mapped in place: size = " << mapped.size() << ", value of 12 = " << mapped.find(12).value()
+                  << ", 21 is missing: " << (mapped.find(21) == mapped.end()) << std::endl;
+    }
+    std::remove("loaded.snapshot");
+
+
+    std::cout << "\nTESTS ON MAPPED BST:" << std::endl;
+    {
+        mapped_bst<int,int> on_disk{"squares.tree"};
+        for(int i = 0; i < 10; ++i){
+            on_disk.insert(std::pair<int,int>{i, i * i});
+        }
+        on_disk.erase(3);
+        on_disk.insert_or_assign(4, -16);
+        on_disk.sync();
+    }
+    {
+        mapped_bst<int,int> reopened{"squares.tree"};          // no reload: the nodes are in the file
+        std::cout << "reopened after erase(3) and insert_or_assign(4, -16), size = " << reopened.size() << std::endl;
+        std::cout << reopened << std::endl;
+        std::cout << "value of 4 = " << reopened.find(4).value() << ", 3 is missing: " << !reopened.contains(3) << std::endl;
+
+        reopened.insert(std::pair<int,int>{10, 100});           // the file is dirty until the next sync
+        std::ifstream from{"squares.tree", std::ios::binary};
+        std::ofstream{"crashed.tree", std::ios::binary} << from.rdbuf();    // what a crash would leave
+    }
+    try{
+        mapped_bst<int,int> crashed{"crashed.tree"};
+        std::cout << "ERROR: a dirty tree was opened" << std::endl;
+        return 1;
+    }
+    catch(const std::runtime_error& e){std::cout << "copy taken before sync refused: " << e.what() << std::endl;}
+    {
+        mapped_bst<int,int> closed{"squares.tree"};             // the dtor synced it
+        std::cout << "reopened after a close, value of 10 = " << closed.find(10).value() << std::endl;
+    }
+    std::remove("squares.tree");
+    std::remove("crashed.tree");
+
+
+    std::cout << "\nTESTS ON DURABLE BST:" << std::endl;
+    {
+        durable_bst<int,int> logged{"logged.snapshot", "logged.log"};
+        for(int i = 0; i < 10; ++i){
+            logged.insert(std::pair<int,int>{i, i});
+        }
+        logged.checkpoint();                                    // the first ten pairs go to the snapshot
+        logged.erase(2);
+        logged[5] = 55;
+        logged.emplace(10, 100);
+    }
+    {
+        durable_bst<int,int> recovered{"logged.snapshot", "logged.log"};   // snapshot, then the log
+        std::cout << "recovered after erase(2), [5] = 55 and emplace(10, 100), size = " << recovered.size() << std::endl;
+        std::cout << recovered << std::endl;
+        int value = 0;
+        recovered.find(5, value);
+        std::cout << "value of 5 = " << value << std::endl;
+    }
+    std::remove("logged.snapshot");
+    std::remove("logged.log");
+
+
+    std::cout << "\nTESTS ON B+ TREE ENGINE:" << std::endl;
+    bst<int,int,std::less<int>,btree<4>> wide;                  // at most 4 keys per node
+    for(int i = 0; i < 20; ++i){
+        wide.insert(std::pair<int,int>{(7*i) % 20, i});
+    }
+    std::cout << "B+ tree after inserting 0..19 in scattered order" << std::endl;
+    std::cout << wide << std::endl;
+    for(int i = 0; i < 20; i += 3){
+        wide.erase(i);
+    }
+    std::cout << "after erasing the multiples of 3" << std::endl;
+    std::cout << wide << std::endl;
+    std::cout << "wide[7] = " << wide[7] << ", 9 found: " << (wide.find(9) != wide.end()) << std::endl;
+    bst<int,int,std::less<int>,btree<4>>::const_reverse_iterator last = wide.crbegin();   // the same member types as a bst
+    bst<int,int,std::less<int>,btree<4>>::iterator first = wide.begin();
+    std::cout << "first key = " << *first << ", last key = " << *last << std::endl;
+
+
+    std::cout << "\nTESTS ON COMPACT ENGINE:" << std::endl;
+    bst<int,int,std::less<int>,compact> dense;
+    for(int i = 0; i < 20; ++i){dense.insert(std::pair<int,int>{(7*i) % 20, i});}
+    auto seven = dense.find(7);
+    for(int i = 0; i < 20; i += 3){dense.erase(i);}
+    for(int i = 20; i < 27; ++i){dense.insert(std::pair<int,int>{i, i});}        // they reuse the erased slots
+    std::cout << "after inserting 0..19, erasing the multiples of 3 and inserting 20..26" << std::endl;
+    std::cout << dense << std::endl;
+    std::cout << "value of 7 through an iterator taken before: " << seven.value()
+              << ", backwards from end: " << *(--dense.end()) << std::endl;
+
+
+    std::cout << "\nTESTS ON CONCURRENT BST:" << std::endl;
+    concurrent_bst<int,int> shared;
+    std::vector<std::thread> writers;
+    for(int t = 0; t < 4; ++t){
+        writers.emplace_back([&shared, t](){
+            for(int i = t; i < 40; i += 4){shared.insert(std::pair<int,int>{i, 10*i});}
+            for(int i = t; i < 40; i += 4){
+                if(i % 2 == 0){shared.erase(i);}
+            }
+        });
+    }
+    for(auto& w : writers){w.join();}
+    std::cout << "concurrent_bst after 4 threads inserted 0..39 and erased the even keys" << std::endl;
+    std::cout << shared << std::endl;
+    int value = 0;
+    bool found = shared.find(7, value);
+    std::cout << "size = " << shared.size() << ", 7 found: " << found << " with value " << value
+              << ", 8 found: " << shared.contains(8) << std::endl;
+
+
+    std::cout << "\nTESTS ON SHARDED BST:" << std::endl;
+    sharded_bst<int,int> sharded{4};                            // a shard is split beyond 4 keys
+    std::vector<std::thread> ingest;
+    for(int t = 0; t < 4; ++t){
+        ingest.emplace_back([&sharded, t](){
+            for(int i = 10*t; i < 10*t + 10; ++i){sharded.insert(std::pair<int,int>{i, -i});}
+        });
+    }
+    for(auto& w : ingest){w.join();}
+    for(int i = 0; i < 40; i += 3){
+        sharded.erase(i);
+    }
+    std::cout << "sharded_bst after 4 threads inserted 0..39 and the multiples of 3 were erased" << std::endl;
+    std::cout << sharded << std::endl;
+    std::cout << "shards = " << sharded.shard_count() << ", keys in [10, 20):";
+    sharded.for_each(10, 20, [](const int& k, const int&){std::cout << " " << k;});
+    std::cout << std::endl;
+    sharded_bst<std::string,int> named{4};                      // the bounds are copies of moved keys
+    for(int i = 0; i < 40; ++i){named.insert(std::pair<std::string,int>{"k" + std::to_string(100 + i), i});}
+    int reachable = 0;
+    for(int i = 0; i < 40; ++i){reachable += named.contains("k" + std::to_string(100 + i));}
+    std::cout << "string keys: shards = " << named.shard_count() << ", found " << reachable << " of 40";
+    for(int i = 0; i < 40; i += 2){named.erase("k" + std::to_string(100 + i));}
+    for(int i = 0; i < 30; ++i){named.erase("k" + std::to_string(100 + i));}
+    reachable = 0;
+    for(int i = 30; i < 40; ++i){reachable += named.contains("k" + std::to_string(100 + i));}
+    std::cout << ", after the merges: shards = " << named.shard_count() << ", found " << reachable << " of 5" << std::endl;
+
+
+    std::cout << "\nTESTS ON PERSISTENT BST:" << std::endl;
+    persistent_bst<int,int> versioned{snapshot.begin(), snapshot.end()};
+    auto old_version = versioned.snapshot();                    // constant time, the nodes are shared
+    versioned.erase(5);
+    versioned.insert_or_assign(7, -7);
+    versioned.insert(std::pair<int,int>{20, 400});
+    std::cout << "current version after erase(5), insert_or_assign(7, -7) and insert(20)" << std::endl;
+    std::cout << versioned << std::endl;
+    std::cout << "snapshot taken before the updates" << std::endl;
+    std::cout << old_version << std::endl;
+    std::cout << "value of 7: " << versioned.find(7).value() << " now, "
+              << old_version.find(7).value() << " in the snapshot" << std::endl;
+
+
+    std::cout << "\nTESTS ON BATCHED LOOKUP:" << std::endl;
+    std::vector<int> wanted{14, 2, 28, 5, 1, 33};
+    std::vector<bool> present(wanted.size());
+    std::vector<bst<int,int>::iterator> where(wanted.size());                // loaded has the keys 0..14
+    loaded.contains_batch(wanted.begin(), wanted.end(), present.begin());
+    loaded.find_batch(wanted.begin(), wanted.end(), where.begin());
+    for(std::size_t i = 0; i < wanted.size(); ++i){
+        std::cout << wanted[i] << ": " << (present[i] ? "present" : "missing");
+        if(where[i] != loaded.end()){std::cout << ", value " << where[i].value();}
+        std::cout << std::endl;
+    }
+
+
+    std::cout << "\nTESTS ON HETEROGENEOUS LOOKUP:" << std::endl;
+    bst<std::string,int,std::less<>> sessions;
+    const char* requests[] = {"alice", "bob", "alice", "carol", "alice"};
+    for(auto r : requests){sessions[r] += 1;}                   // the key is built only on insertion
+    sessions.erase("bob");
+    std::cout << "sessions after 5 requests and erase(\"bob\")" << std::endl;
+    std::cout << sessions << std::endl;
+    std::cout << "requests of alice: " << sessions.find("alice").value()
+              << ", contains(\"bob\"): " << sessions.contains("bob") << std::endl;
+
+
+    std::cout << "\nTESTS ON SPLAY POLICY:" << std::endl;
+    bst<int,int,std::less<int>,splay<>> adaptive;
+    for(int i = 0; i < 10; ++i){adaptive.insert(std::pair<int,int>{i, i * i});}   // every new key becomes the root
+    const auto& hits = adaptive;
+    for(int i = 0; i < 3; ++i){std::cout << "find(3): " << hits.find(3).value() << std::endl;}   // 3 is moved to the root
+    adaptive.erase(3);
+    std::cout << "after erase(3), contains(3): " << adaptive.contains(3) << std::endl;
+    std::cout << adaptive << std::endl;
+    bst<int,int,std::less<int>,splay<>> shared_splay;
+    for(int i = 0; i < 1000; ++i){shared_splay.insert(std::pair<int,int>{(i * 7) % 1000, i});}
+    std::vector<std::thread> lookups;
+    std::vector<int> wrong(4, 0);
+    for(int t = 0; t < 4; ++t){
+        lookups.emplace_back([&shared_splay, &wrong, t](){
+            const auto& readers = shared_splay;                 // concurrent const lookups, some of them splay
+            for(int i = 0; i < 20000; ++i){
+                int k = (i * 31 + t * 17) % 1000;
+                auto found = readers.find(k);
+                if(found == readers.end() || (found.value() * 7) % 1000 != k || !readers.contains(k)){++wrong[t];}
+                if(*readers.lower_bound(k) != k){++wrong[t];}
+            }
+        });
+    }
+    for(auto& w : lookups){w.join();}
+    int previous = -1, in_order = 0;
+    for(auto key : shared_splay){in_order += key > previous; previous = key;}
+    std::cout << "4 threads, 80000 const lookups on a splay tree: " << wrong[0] + wrong[1] + wrong[2] + wrong[3]
+              << " wrong, " << in_order << " of " << shared_splay.size() << " keys in order" << std::endl;
+
+
+    std::cout << "\nTESTS ON RANGE AGGREGATES:" << std::endl;
+    bst<int,long,std::less<int>,augmented<sum_of<long>,red_black>> sums;
+    for(int i = 1; i <= 100; ++i){sums.insert(std::pair<int,long>{i, i});}
+    std::cout << "sum of [1, 100]: " << sums.aggregate() << ", of [10, 20]: " << sums.aggregate(10, 20) << std::endl;
+    sums.insert_or_assign(15, 1000);
+    sums.erase(20);
+    std::cout << "after insert_or_assign(15, 1000) and erase(20), sum of [10, 20]: " << sums.aggregate(10, 20) << std::endl;
+    bst<int,int,std::less<int>,order_statistic<augmented<max_of<int>,avl>>> peaks;
+    for(int i = 0; i < 20; ++i){peaks.insert(std::pair<int,int>{i, (i * 7) % 20});}
+    std::cout << "max of the values with keys in [0, 5]: " << peaks.aggregate(0, 5)
+              << ", keys in [0, 5]: " << peaks.count_range(0, 5) << std::endl;
+
+
+#ifdef BST_STATS
+    std::cout << "\nTESTS ON STATS:" << std::endl;
+    bst<int,int> instrumented;
+    instrumented.auto_rebalance(2);
+    for(int i = 0; i < 1000; ++i){instrumented.insert(std::pair<int,int>{i, i});}
+    instrumented.reset_stats();
+    instrumented.find(500);
+    instrumented.find(2000);
+    std::cout << "1000 sequential keys with auto_rebalance(2), then two finds" << std::endl;
+    std::cout << instrumented.stats() << std::endl;
+#endif
+
+
     std::cout << "\n\n\nEND TESTS" << std::endl;
 
     
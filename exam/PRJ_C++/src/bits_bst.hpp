@@ -3,6 +3,11 @@
 
 #include "bits_bst_node.hpp"
 #include "bits_bst_iterator.hpp"
+#include "bits_bst_balance.hpp"
+#include "bits_bst_pool.hpp"
+#include "bits_bst_frozen.hpp"
+#include "bits_bst_snapshot.hpp"
+#include "bits_bst_stats.hpp"
 
 
 
@@ -11,6 +16,13 @@
 #include <memory>
 #include <iterator>
 #include <vector>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <thread>
 
 
 /**
@@ -22,25 +34,157 @@
  * @tparam k_t template for the key type
  * @tparam v_t template for the value type
  * @tparam OP template for the total order relation that rules the bst; default is std::less<k_t>
+ * @tparam BAL template for the balancing policy (unbalanced, red_black, avl or splay,
+ * possibly augmented with order_statistic and with a monoid); default is unbalanced
+ * @tparam Alloc template for the allocator the node pool obtains its blocks from; default is std::allocator
  */
 
 
 
 
 
-template <typename k_t, typename v_t, typename OP = std::less<k_t> >
+template <typename k_t, typename v_t, typename OP = std::less<k_t>, typename BAL = unbalanced,
+          typename Alloc = std::allocator<std::pair<k_t,v_t>> >
 class bst{
 
 
-    using node = _node<k_t,v_t>;
-    using iterator = _iterator<k_t,k_t,v_t>;
-    using const_iterator = _iterator<const k_t,k_t,v_t>;
+    using monoid = typename _monoid_of<BAL>::type;
+    using node = _node<k_t,v_t,monoid,_is_order_statistic<BAL>::value>;
+
+public:
+    using iterator = _iterator<k_t,k_t,v_t,monoid,_is_order_statistic<BAL>::value>;
+    using const_iterator = _iterator<const k_t,k_t,v_t,monoid,_is_order_statistic<BAL>::value>;
+    using reverse_iterator = _reverse_iterator<iterator>;
+    using const_reverse_iterator = _reverse_iterator<const_iterator>;
+
+private:
 
     /**
-     * @brief Private variables
+     * @brief Private variables.
+     * The pool is declared before head, so that the nodes
+     * are destroyed before their memory is released
      */
-    std::unique_ptr<node> head;
+    _node_pool<node,Alloc> pool;
+    mutable typename node::link head;   // mutable: the lookups of a self-adjusting tree restructure it
+    node* tail{nullptr};                // the right most node, for the insertions at the end
+    std::size_t items{0};               // number of nodes, for size()
     OP cmp; 
+    _adjust_state<BAL> adjust;          // gate of the readers of a self-adjusting tree, see bits_bst_balance.hpp
+
+    static constexpr bool counted = _is_order_statistic<BAL>::value;
+    static constexpr bool summarized = !std::is_void<monoid>::value;
+
+    using pool_t = _node_pool<node,Alloc>;
+
+#ifdef BST_STATS
+    mutable _bst_counters counters;     // see bits_bst_stats.hpp
+
+    /**
+     * @brief Only the trees that do not restructure themselves are rebalanced automatically
+     */
+    static constexpr bool self_balancing = !std::is_base_of<unbalanced, BAL>::value || _is_self_adjusting<BAL>::value;
+
+    _bst_probe _probe() const noexcept {return _bst_probe{counters};}
+
+    /**
+     * @brief Call f with the depth of every node, in order, without recursion
+     */
+    template <typename F>
+    void _for_each_depth(F&& f) const noexcept {
+        const node* x = head.get();
+        std::size_t d = 0;
+        while(x && x->left){x = x->left.get(); ++d;}
+        while(x){
+            f(d);
+            if(x->right){                                   // the successor is the left most node on the right
+                x = x->right.get();
+                ++d;
+                while(x->left){x = x->left.get(); ++d;}
+            }
+            else{                                           // climb until we come from a left child
+                auto p = x->parent;
+                while(p && p->right.get() == x){x = p; p = p->parent; --d;}
+                x = p;
+                if(p){--d;}
+            }
+        }
+    }
+
+    static std::size_t _depth(const node* x) noexcept {
+        std::size_t d = 0;
+        for(; x->parent; x = x->parent){++d;}
+        return d;
+    }
+
+    bool _tracking() const noexcept {return !self_balancing && counters.factor > 0;}
+
+    /**
+     * @brief The shape of the tree has changed at once: the sum of the depths is measured again
+     */
+    void _reshaped() noexcept {
+        if(!_tracking()){return;}
+        std::size_t sum = 0;
+        _for_each_depth([&sum](std::size_t d){sum += d;});
+        counters.depth_sum = sum;
+    }
+
+    /**
+     * @brief If the bound of the average depth exceeds factor * log2(n) the
+     * average depth is measured, and the tree is balanced if the bound was right
+     */
+    void _check_depth() noexcept {
+        if(items < 2){return;}
+        auto limit = counters.factor * items * std::log2(static_cast<double>(items));
+        if(counters.depth_sum <= limit){return;}
+        _reshaped();
+        if(counters.depth_sum > limit){
+            counters.auto_balances.fetch_add(1, std::memory_order_relaxed);
+            balance();
+        }
+    }
+
+    /**
+     * @brief The node x has been attached
+     */
+    void _grown(const node* x) noexcept {
+        if(!_tracking()){return;}
+        counters.depth_sum += _depth(x);
+        _check_depth();
+    }
+
+    /**
+     * @brief A node has been detached from parent, and child has taken its place:
+     * the nodes below child went up by one, which is known only if the tree is counted
+     */
+    void _shrunk(const node* parent, const node* child) noexcept {
+        if(!_tracking()){return;}
+        counters.depth_sum -= parent ? _depth(parent) + 1 : 0;
+        if(counted){counters.depth_sum -= _subtree_size(child);}
+        _check_depth();
+    }
+
+    void _adopt_stats(const bst& x) noexcept {counters = x.counters;}
+#else
+    static _bst_probe _probe() noexcept {return _bst_probe{};}
+    void _reshaped() noexcept {}
+    void _grown(const node*) noexcept {}
+    void _shrunk(const node*, const node*) noexcept {}
+    void _adopt_stats(const bst&) noexcept {}
+#endif
+
+    /**
+     * @brief Subtrees with less nodes than this are built and copied on a single thread
+     */
+    static constexpr std::size_t parallel_cutoff = 1 << 16;
+
+    /**
+     * @brief Number of threads to build a tree of n nodes with
+     */
+    static unsigned _threads(std::size_t n) noexcept {
+        if(n < parallel_cutoff){return 1;}
+        auto cores = std::thread::hardware_concurrency();
+        return cores ? cores : 1;
+    }
     
     /**
      * This private function will be usefull to define
@@ -49,10 +193,10 @@ class bst{
      */
     iterator left_most() noexcept {                            
         auto tmp = head.get();                      
-        while(tmp->left){                           
+        while(tmp && tmp->left){                           
             tmp = tmp->left.get();
         }
-        return iterator{tmp};
+        return iterator{tmp, &tail};
     }
 
 
@@ -62,11 +206,258 @@ class bst{
      * @return const_iterator to the node with the smallest key (wrt OP)
      */
     const_iterator left_most() const noexcept {
+        auto reader = adjust.enter();
         auto tmp = head.get();
-        while(tmp->left){
+        while(tmp && tmp->left){
             tmp = tmp->left.get();
         }
-        return const_iterator{tmp};
+        return const_iterator{tmp, &tail};
+    }
+
+    /**
+     * This private function looks for a key with a single
+     * top to bottom traversal of the bst.
+     * The bool is true if the key is present, and the node is the one with such key;
+     * otherwise the node is the one the key should be attached to (nullptr if the tree is empty)
+     * 
+     * @param x key to look for, or any value comparable with the keys
+     * @return pair of a pointer to node and a bool
+     */
+    template <typename K>
+    std::pair<node*, bool> _locate(const K& x) const noexcept {
+        auto probe = _probe();
+        auto tmp = head.get();
+        node* parent = nullptr;
+        while(tmp){
+            probe.visit();
+            parent = tmp;
+            if(probe.less(cmp, x, tmp->_pair.first)){tmp = tmp->left.get();}
+            else if(probe.less(cmp, tmp->_pair.first, x)){tmp = tmp->right.get();}
+            else{return std::pair<node*, bool>{tmp, true};}   // found it
+        }
+        return std::pair<node*, bool>{parent, false};
+    }
+
+    /**
+     * This private function looks for the first node whose key is not smaller than x
+     * (if strict is false) or is bigger than x (if strict is true):
+     * every node where we move to the left is a candidate, the last one is the answer
+     * 
+     * @param x key to look for, or any value comparable with the keys
+     * @param strict true for upper_bound, false for lower_bound
+     * @return pointer to the node, nullptr if there is none
+     */
+    template <typename K>
+    node* _bound(const K& x, bool strict) const noexcept {
+        auto reader = adjust.enter();
+        auto probe = _probe();
+        auto tmp = head.get();
+        node* candidate = nullptr;
+        while(tmp){
+            probe.visit();
+            if(strict ? probe.less(cmp, x, tmp->_pair.first) : !probe.less(cmp, tmp->_pair.first, x)){
+                candidate = tmp;
+                tmp = tmp->left.get();
+            }
+            else{tmp = tmp->right.get();}
+        }
+        return candidate;
+    }
+
+    /**
+     * This private function implements find. A self-adjusting tree is
+     * restructured around the node found, if no other reader is in the tree
+     * 
+     * @param x key to look for, or any value comparable with the keys
+     * @return pointer to the node with such key, nullptr if there is none
+     */
+    template <typename K>
+    node* _find(const K& x) const noexcept {
+        auto reader = adjust.enter();
+        auto where = _locate(x);
+        if(!where.second){return nullptr;}
+        adjust.found(head, where.first, reader);
+        return where.first;
+    }
+
+    /**
+     * @brief Number of searches find_batch keeps in flight
+     */
+    static constexpr std::size_t batch_lanes = 32;
+
+    /**
+     * This private function looks for n keys at once: up to batch_lanes
+     * searches move down one level each, in turn, and the child each one
+     * moves to is prefetched, so that the cache misses of different searches
+     * overlap instead of following one another. As soon as a search is over
+     * its lane starts the next key
+     * 
+     * @param keys random access iterator to the first key
+     * @param n number of keys
+     * @param emit called with the position of each key and its node (nullptr if the key is missing)
+     */
+    template <typename It, typename F>
+    void _find_interleaved(It keys, std::size_t n, F& emit) const {
+        auto root = head.get();
+        if(!root){
+            for(std::size_t i = 0; i < n; ++i){emit(i, nullptr);}
+            return;
+        }
+        auto probe = _probe();
+        probe.batch(n);
+        node* at[batch_lanes];
+        std::size_t which[batch_lanes];
+        std::size_t lanes = n < batch_lanes ? n : batch_lanes;
+        std::size_t next = 0, busy = 0;
+        for(; next < lanes; ++next){
+            at[next] = root;
+            which[next] = next;
+            ++busy;
+        }
+
+        while(busy){
+            for(std::size_t l = 0; l < lanes; ++l){
+                auto x = at[l];
+                if(!x){continue;}
+                probe.visit();
+                const auto& k = keys[which[l]];
+                node* child = nullptr;
+                if(probe.less(cmp, k, x->_pair.first)){child = x->left.get();}
+                else if(probe.less(cmp, x->_pair.first, k)){child = x->right.get();}
+                else{                                       // found it
+                    emit(which[l], x);
+                    x = nullptr;
+                }
+                if(child){
+#if defined(__GNUC__)
+                    __builtin_prefetch(child);
+#endif
+                    at[l] = child;
+                    continue;
+                }
+                if(x){emit(which[l], nullptr);}             // fell off the tree
+                if(next < n){                               // the lane takes the next key
+                    which[l] = next++;
+                    at[l] = root;
+                }
+                else{
+                    at[l] = nullptr;
+                    --busy;
+                }
+            }
+        }
+    }
+
+    /**
+     * This private function looks for n keys sorted in increasing order:
+     * the search of a key starts from the deepest node, on the path of the
+     * previous one, whose subtree can contain it, i.e. below the last node
+     * on the path where the search moved left and whose key is bigger.
+     * Close keys share most of their path, which is not walked again
+     * 
+     * @param keys random access iterator to the first key
+     * @param n number of keys
+     * @param emit called with the position of each key and its node (nullptr if the key is missing)
+     */
+    template <typename It, typename F>
+    void _find_sorted(It keys, std::size_t n, F& emit) const {
+        auto probe = _probe();
+        probe.batch(n);
+        // the nodes on the path, each with the closest ancestor where the path moved left
+        std::vector<std::pair<node*, node*>> path;
+        path.emplace_back(head.get(), nullptr);
+        for(std::size_t i = 0; i < n; ++i){
+            const auto& k = keys[i];
+            while(path.back().second && !probe.less(cmp, k, path.back().second->_pair.first)){path.pop_back();}
+            auto x = path.back().first;
+            auto bound = path.back().second;
+            path.pop_back();
+            node* found = nullptr;
+            while(x){
+                probe.visit();
+                path.emplace_back(x, bound);
+                if(probe.less(cmp, k, x->_pair.first)){
+                    bound = x;
+                    x = x->left.get();
+                }
+                else if(probe.less(cmp, x->_pair.first, k)){x = x->right.get();}
+                else{
+                    found = x;
+                    break;
+                }
+            }
+            if(path.empty()){path.emplace_back(head.get(), nullptr);}  // the tree is empty
+            emit(i, found);
+        }
+    }
+
+    /**
+     * @brief A sorted batch follows the previous paths only if there is at most a
+     * key every this many in the tree: the paths of sparser keys share just the
+     * first levels, that are in the caches anyway, and interleaving wins
+     */
+    static constexpr std::size_t sorted_spread = 64;
+
+    /**
+     * This private function implements the batched lookups: a sorted batch
+     * dense in the tree shares the prefixes of the paths, any other is interleaved
+     */
+    template <typename It, typename F>
+    void _find_batch(It first, It last, F&& emit) const {
+        auto reader = adjust.enter();
+        auto n = static_cast<std::size_t>(last - first);
+        auto sorted = n > 1 && std::is_sorted(first, last, [this](const typename std::iterator_traits<It>::value_type& a,
+                                                         const typename std::iterator_traits<It>::value_type& b){
+            return cmp(a, b);
+        });
+        if(sorted && items <= n * sorted_spread){_find_sorted(first, n, emit);}
+        else{_find_interleaved(first, n, emit);}
+    }
+
+    /**
+     * @brief Recompute the summaries of x and of its ancestors, bottom-up,
+     * if the tree is augmented with a monoid
+     */
+    static void _summarize_up(node* x) noexcept {
+        if(!summarized){return;}
+        for(; x; x = x->parent){_summarize(x);}
+    }
+
+    /**
+     * @brief Assign a new value to the pair of x, whose summary
+     * and those of its ancestors change with it
+     */
+    template <typename M>
+    void _assign(node* x, M&& obj){
+        x->_pair.second = std::forward<M>(obj);
+        _summarize_up(x);
+    }
+
+    /**
+     * This private function attaches a new node as a child of parent,
+     * on the side given by its key, and then invokes the balancing policy
+     * 
+     * @param parent pointer to the new parent (nullptr if the tree is empty)
+     * @param new_node pointer to the node to attach
+     * @return pointer to the new node
+     */
+    node* _attach(node* parent, node* new_node) noexcept {
+        new_node->parent = parent;
+        if(!parent){head.reset(new_node);}
+        else if(cmp(new_node->_pair.first, parent->_pair.first)){parent->left.reset(new_node);}
+        else{parent->right.reset(new_node);}
+
+        if(!tail || (parent == tail && parent->right.get() == new_node)){tail = new_node;}   // a new right most node
+
+        ++items;
+        if(counted){                                        // one more node in the subtrees of the ancestors
+            for(auto p = parent; p; p = p->parent){_set_subtree_size(p, _subtree_size(p) + 1);}
+        }
+        _summarize_up(new_node);
+
+        BAL::after_insert(head, new_node);                  // restructure the tree, if the policy requires it
+        _grown(new_node);
+        return new_node;
     }
 
     /**
@@ -80,233 +471,1089 @@ class bst{
      */
     template <typename O>
     std::pair<iterator, bool> _insert(O&& x){
-        // auto pair = std::forward<O>(x);
+        auto where = _locate(x.first);                      // a single traversal of the bst
+        if(where.second){
+            return std::pair<iterator, bool>{iterator{where.first, &tail}, false}; // the key is already present: flag the insertion as aborted
+        }
+        auto new_node = _attach(where.first, pool.create(std::forward<O>(x)));
+        return std::pair<iterator, bool>{iterator{new_node, &tail}, true};
+    }
+
+    /**
+     * This private function implements the insertion of a node with a hint:
+     * if the key fits between the node before hint and hint itself the
+     * new node is attached there without traversing the bst
+     * 
+     * @param hint iterator to the node that should follow the new one
+     * @param x pair
+     * @return iterator pointing to the node with the key of x
+     */
+    template <typename O>
+    iterator _insert(const_iterator hint, O&& x){
+        auto next = hint.where();
+        auto prev = next ? _predecessor(next) : tail;
+
+        if((!next || cmp(x.first, next->_pair.first)) && (!prev || cmp(prev->_pair.first, x.first))){
+            // prev and next are adjacent in the bst, so either
+            // the left child of next or the right child of prev is free
+            auto parent = (next && !next->left) ? next : prev;
+            return iterator{_attach(parent, pool.create(std::forward<O>(x))), &tail};
+        }
+        return _insert(std::forward<O>(x)).first;           // wrong hint: fall back to a full traversal
+    }
+
+    /**
+     * This private function implements try_emplace:
+     * the node is constructed only if the key is not present
+     * 
+     * @param k key
+     * @param args arguments to construct the value from
+     * @return pair of an iterator (pointing to the node) and a bool
+     */
+    template <typename K, typename... Types>
+    std::pair<iterator, bool> _try_emplace(K&& k, Types&&... args){
+        auto where = _locate(k);
+        if(where.second){
+            return std::pair<iterator, bool>{iterator{where.first, &tail}, false};
+        }
+        auto new_node = pool.create(_in_place_t{}, std::piecewise_construct,
+                                    std::forward_as_tuple(std::forward<K>(k)),
+                                    std::forward_as_tuple(std::forward<Types>(args)...));
+        return std::pair<iterator, bool>{iterator{_attach(where.first, new_node), &tail}, true};
+    }
+
+    /**
+     * @brief Auxiliary function to balance the tree.
+     * It performs count left rotations along the vine hanging from head,
+     * every other node: each rotated node becomes the left child of the following one
+     * 
+     * @param count number of rotations
+     */
+    void _compress(std::size_t count) noexcept {
+        auto link = &head;
+        for(std::size_t i = 0; i < count; ++i){
+            _rotate_left(head, link->get());                // the next node takes the place of the current one
+            link = &(*link)->right;
+        }
+    }
+
+    /**
+     * @brief Auxiliary function to balance the tree, TREE TO VINE:
+     * every left child is rotated up until the node on the vine has none,
+     * so that the tree becomes a list of right children in order of key
+     *
+     * @return the number of nodes
+     */
+    std::size_t _to_vine() noexcept {
+        std::size_t n = 0;
+        auto link = &head;
+        while(*link){
+            auto x = link->get();
+            if(x->left){_rotate_right(head, x);}            // the left child of x takes its place
+            else{
+                ++n;
+                link = &x->right;                           // x is on the vine: move down
+            }
+        }
+        return n;
+    }
+
+    /**
+     * @brief Auxiliary function to balance the tree, VINE TO TREE:
+     * the nodes in excess wrt the largest full tree (2^k - 1 nodes) go to the last level,
+     * then every compression halves the length of the vine.
+     * At the end the balancing information of the nodes is restored
+     *
+     * @param n number of nodes of the vine
+     */
+    void _vine_to_tree(std::size_t n) noexcept {
+        std::size_t full = 1;
+        while(full <= n + 1){full *= 2;}
+        full = full / 2 - 1;
+
+        _compress(n - full);
+        while(full > 1){
+            full /= 2;
+            _compress(full);
+        }
+
+        BAL::rebuild(head.get());
+    }
+
+    /**
+     * @brief Auxiliary function for merge: the vine hanging
+     * from head has been relinked, with consistent parent pointers, and ends
+     * in last. The sizes of the nodes, tail and items are recomputed
+     * going up the vine, then it is folded into a balanced tree
+     *
+     * @param last the last node of the vine, nullptr if it is empty
+     */
+    void _relinked_vine(node* last) noexcept {
+        tail = last;
+        items = 0;
+        for(auto x = last; x; x = x->parent){
+            _set_subtree_size(x, ++items);
+            _summarize(x);
+        }
+        _vine_to_tree(items);
+    }
+
+    /**
+     * @brief Auxiliary function for merge and split, JOIN: link the trees
+     * rooted in l and r, whose keys precede and follow the key of k, with k
+     * between them. The policy tells where k goes (see join_point in
+     * bits_bst_balance.hpp), then restores its invariants, in time
+     * proportional to the difference of the heights of the trees
+     *
+     * @param l root of the lower tree, possibly nullptr
+     * @param k the node in the middle, with no children
+     * @param r root of the upper tree, possibly nullptr
+     * @return the root of the joined tree
+     */
+    static node* _join(node* l, node* k, node* r) noexcept {
+        if(l){l->parent = nullptr;}
+        if(r){r->parent = nullptr;}
+        bool right = true;
+        auto p = BAL::join_point(l, r, right);
+        auto added = 1 + _subtree_size(right ? r : l);      // nodes that join the subtrees of the spine
+
+        typename node::link root;
+        auto link = &root;                                  // the pointer that will own k
+        if(p){                                              // k takes the place of a subtree of the taller tree
+            root.reset(right ? l : r);
+            link = right ? &p->right : &p->left;
+            (right ? l : r) = link->release();
+        }
+        k->left.reset(l);
+        k->right.reset(r);
+        if(l){l->parent = k;}
+        if(r){r->parent = k;}
+        k->parent = p;
+        link->reset(k);
+
+        if(counted){
+            _recount(k);
+            for(auto x = p; x; x = x->parent){_set_subtree_size(x, _subtree_size(x) + added);}
+        }
+        _summarize_up(k);
+        BAL::after_join(root, k);
+        return root.release();
+    }
+
+    /**
+     * @brief Auxiliary function for merge, join and split, SPLIT: cut the
+     * tree rooted in t at the key x. The path from the root to x is walked
+     * down, then climbed back joining every node, with its subtree off the
+     * path, to the lower or the upper part
+     *
+     * @param t root of the tree
+     * @param x the key where the tree is cut
+     * @param equal set to the node with the key equivalent to x, in neither part, nullptr if none
+     * @return the roots of the parts with the keys smaller and greater than x
+     */
+    std::pair<node*, node*> _split(node* t, const k_t& x, node*& equal) noexcept {
+        equal = nullptr;
+        if(t){t->parent = nullptr;}
+        node* last = nullptr;                               // the last node of the path
+        for(auto y = t; y;){
+            last = y;
+            if(cmp(x, y->_pair.first)){y = y->left.get();}
+            else if(cmp(y->_pair.first, x)){y = y->right.get();}
+            else{
+                equal = y;
+                break;
+            }
+        }
+
+        node* lower = nullptr;
+        node* upper = nullptr;
+        if(equal){
+            lower = equal->left.release();
+            upper = equal->right.release();
+            last = equal->parent;
+        }
+        while(last){                                        // the child on the path is already in a part
+            auto up = last->parent;
+            auto l = last->left.release();
+            auto r = last->right.release();
+            if(cmp(last->_pair.first, x)){lower = _join(l, last, lower);}
+            else{upper = _join(upper, last, r);}
+            last = up;
+        }
+        if(lower){lower->parent = nullptr;}
+        if(upper){upper->parent = nullptr;}
+        return std::pair<node*, node*>{lower, upper};
+    }
+
+    /**
+     * @brief Auxiliary function for merge, UNION: the root of a splits b,
+     * the halves are merged with the subtrees of the root and joined back
+     * around it. The recursion follows a, which should be the smaller tree
+     *
+     * @param a root of a tree, possibly nullptr
+     * @param b root of another tree, possibly nullptr
+     * @param a_wins whether the node of a is kept when a key is in both trees
+     * @param duplicates increased by the number of nodes destroyed
+     * @return the root of the union
+     */
+    node* _union(node* a, node* b, bool a_wins, std::size_t& duplicates) noexcept {
+        if(!a){return b;}
+        if(!b){return a;}
+        node* equal;
+        auto halves = _split(b, a->_pair.first, equal);
+        auto l = _union(a->left.release(), halves.first, a_wins, duplicates);
+        auto r = _union(a->right.release(), halves.second, a_wins, duplicates);
+        if(equal){
+            ++duplicates;
+            if(!a_wins){std::swap(a, equal);}
+            pool.destroy(equal);                            // its children have already been moved
+        }
+        return _join(l, a, r);
+    }
+
+    /**
+     * @brief Auxiliary function for merge, MERGE VINES: both trees are turned
+     * into vines, which are merged by relinking their nodes and folded back
+     * into a balanced tree. It needs no recursion, whatever the heights
+     *
+     * @param x the tree to merge, its nodes are already in the pool of this tree
+     */
+    void _merge_vines(bst& x) noexcept {
+        _to_vine();
+        x._to_vine();
+
+        node* a = head.release();
+        node* b = x.head.release();
+        x.tail = nullptr;
+        x.items = 0;
+
+        auto link = &head;
+        node* parent = nullptr;
+        while(a || b){
+            node* next;
+            if(!b || (a && cmp(a->_pair.first, b->_pair.first))){
+                next = a;
+                a = a->right.release();
+            }
+            else if(!a || cmp(b->_pair.first, a->_pair.first)){
+                next = b;
+                b = b->right.release();
+            }
+            else{                                               // the key is in both trees: ours wins
+                auto duplicate = b;
+                b = b->right.release();
+                pool.destroy(duplicate);
+                continue;
+            }
+            next->parent = parent;
+            link->reset(next);
+            parent = next;
+            link = &next->right;
+        }
+        _relinked_vine(parent);
+    }
+
+    /**
+     * @param x pointer to a node
+     * @return pointer to the node before x (wrt OP), nullptr if x is the left most
+     */
+    static node* _predecessor(node* x) noexcept {
+        if(x->left){
+            x = x->left.get();
+            while(x->right){x = x->right.get();}
+            return x;
+        }
+        while(x->parent && x == x->parent->left.get()){x = x->parent;}
+        return x->parent;
+    }
+
+    /**
+     * @param x pointer to a node
+     * @return pointer to the node after x (wrt OP), nullptr if x is the right most
+     */
+    static node* _successor(node* x) noexcept {
+        if(x->right){
+            x = x->right.get();
+            while(x->left){x = x->left.get();}
+            return x;
+        }
+        while(x->parent && x == x->parent->right.get()){x = x->parent;}
+        return x->parent;
+    }
+
+    /**
+     * @return pointer to the right most node, nullptr if the tree is empty
+     */
+    node* _right_most() const noexcept {
         auto tmp = head.get();
-        
+        while(tmp && tmp->right){tmp = tmp->right.get();}
+        return tmp;
+    }
 
-        if (find(x.first)!=iterator{nullptr}){                      // check if a node with the same key is already present
-            
-            return std::pair<iterator, bool>{find(x.first), false}; // if so return an iterator to that node and flag the insertion as aborted
+    /**
+     * @brief Auxiliary function to build a balanced tree
+     * out of a sorted range of pairs without duplicate keys.
+     * The median becomes the root and the two halves of the range
+     * are built recursively as its left and right subtrees
+     * 
+     * When more threads are available and the subtree is big enough
+     * the left subtree is built by another thread, in a pool of its own
+     * that is then spliced into the pool of the current subtree
+     * 
+     * @param first random access iterator to the first pair
+     * @param n number of pairs in the range
+     * @param parent pointer to the parent node
+     * @param from the pool the nodes are created in
+     * @param threads number of threads that can work on the subtree
+     * @return pointer to the node with the median element 
+     */
+    template <typename It>
+    node* balancing(It first, std::size_t n, node* parent, pool_t& from, unsigned threads){
+        // Base Case 
+        if (n == 0) 
+        return nullptr; 
+  
+        // Get the median element and make a node out of it (head)
+        std::size_t median = (n - 1)/2; 
+        node* tmp = from.create(_in_place_t{}, first[median]); 
+        tmp->parent = parent;
+        _set_subtree_size(tmp, n);
+
+        if(threads > 1 && n >= parallel_cutoff){
+            pool_t side{from.get_allocator()};
+            auto left = std::async(std::launch::async, [&](){
+                return balancing(first, median, tmp, side, threads / 2);
+            });
+            tmp->right.reset(balancing(first + median + 1, n - median - 1, tmp, from, threads - threads / 2));
+            tmp->left.reset(left.get());
+            from.splice(std::move(side));
+            _summarize(tmp);
+            return tmp;
         }
 
-        auto new_node{new node{std::forward<O>(x)}};
+        // Recursively construct the left subtree 
+        // and make it left child  
+        tmp->left.reset(balancing(first, median, tmp, from, 1)); 
+  
+        // Recursively construct the right subtree 
+        // and make it right child 
+        tmp->right.reset(balancing(first + median + 1, n - median - 1, tmp, from, 1)); 
+  
+        _summarize(tmp);
+        return tmp; 
+    }
 
-        
-        // base case: empty bst - no check must be performed
-        if(!head){
-            head.reset(new_node);
-            return std::pair<iterator, bool>{iterator{new_node},true};
-        }
-        
-        // if we didn't return yet
-        // we are sure that we will insert a new node
-        else{
-            while(tmp){                                  // traverse the bst top to bottom until we get to the leaves
-                new_node->parent = tmp;                  // at every step take note of the "momentaneous" parent (we don't know when the loop ends)
-                if( cmp(tmp->_pair.first, x.first) ){ // explore the two possible cases for the new key
-                    if(!tmp->right.get()){               // if we reach a leaf
-                        tmp->right.reset(new_node);      // attach the new node
-                        tmp = nullptr;                   // to end the loop
-                    }
-                    else{tmp = tmp->right.get();}
-                }
-                else{
-                    if(!tmp->left.get()){
-                        tmp->left.reset(new_node);
-                        tmp = nullptr;
-                    }
-                    else{tmp = tmp->left.get();}
+    /**
+     * @brief Auxiliary function to check whether the keys
+     * of a range are strictly increasing (wrt OP)
+     * 
+     * @param first iterator to the first pair
+     * @param last iterator to one past the last pair
+     */
+    template <typename It>
+    bool _is_strictly_sorted(It first, It last) const {
+        if(first == last){return true;}
+        for(auto next = std::next(first); next != last; ++first, ++next){
+            if(!cmp(first->first, next->first)){return false;}
+        }
+        return true;
+    }
+
+    /**
+     * @brief Auxiliary function to build the tree out of a sorted random access
+     * range of n pairs without duplicate keys: on a single thread all the nodes
+     * are created in a single block of the node pool
+     */
+    template <typename It>
+    void _build(It first, std::size_t n){
+        auto threads = _threads(n);
+        if(threads == 1){pool.reserve(n);}
+        head.reset(balancing(first, n, nullptr, pool, threads));
+        items = n;
+    }
+
+    /**
+     * @brief Auxiliary function to sort the pairs of a vector by key,
+     * keeping the first pair with a given key and dropping the others.
+     * Above the parallel cutoff the chunks are sorted by different
+     * threads and then merged
+     */
+    void _sort_unique(std::vector<std::pair<k_t,v_t>>& ordered) const {
+        auto by_key = [this](const std::pair<k_t,v_t>& a, const std::pair<k_t,v_t>& b){
+            return cmp(a.first, b.first);
+        };
+        auto same_key = [this](const std::pair<k_t,v_t>& a, const std::pair<k_t,v_t>& b){
+            return !cmp(a.first, b.first);                  // b is not smaller, since the vector is sorted
+        };
+        if(_is_strictly_sorted(ordered.begin(), ordered.end())){return;}
+
+        std::size_t chunks = _threads(ordered.size());
+        std::vector<std::size_t> bounds;
+        for(std::size_t i = 0; i <= chunks; ++i){bounds.push_back(ordered.size() * i / chunks);}
+
+        std::vector<std::future<void>> sorted;
+        for(std::size_t i = 1; i < chunks; ++i){
+            sorted.push_back(std::async(std::launch::async, [&, i](){
+                std::stable_sort(ordered.begin() + bounds[i], ordered.begin() + bounds[i + 1], by_key);
+            }));
+        }
+        std::stable_sort(ordered.begin(), ordered.begin() + bounds[1], by_key);
+        for(auto& f : sorted){f.get();}
+
+        // merge the chunks pairwise, the earlier ones first so that the merge is stable
+        for(std::size_t width = 1; width < chunks; width *= 2){
+            std::vector<std::future<void>> merged;
+            for(std::size_t i = 0; i + width < chunks; i += 2 * width){
+                auto last = i + 2 * width < chunks ? i + 2 * width : chunks;
+                merged.push_back(std::async(std::launch::async, [&, i, width, last](){
+                    std::inplace_merge(ordered.begin() + bounds[i], ordered.begin() + bounds[i + width],
+                                       ordered.begin() + bounds[last], by_key);
+                }));
+            }
+            for(auto& f : merged){f.get();}
+        }
+        ordered.erase(std::unique(ordered.begin(), ordered.end(), same_key), ordered.end());
+    }
+
+    /**
+     * @brief Auxiliary function of bulk_load, for a random access range:
+     * if it is already sorted the tree is built straight from it
+     */
+    template <typename It>
+    void _bulk_load(It first, It last, std::random_access_iterator_tag){
+        if(!_is_strictly_sorted(first, last)){
+            _bulk_load(first, last, std::input_iterator_tag{});
+            return;
+        }
+        _build(first, last - first);
+    }
+
+    /**
+     * @brief Auxiliary function of bulk_load, for any other range:
+     * the pairs are copied into a vector, sorted by key and
+     * deduplicated (the first pair with a given key wins) if needed
+     */
+    template <typename It>
+    void _bulk_load(It first, It last, std::input_iterator_tag){
+        std::vector<std::pair<k_t,v_t>> ordered(first, last);
+        _sort_unique(ordered);
+
+        _build(std::make_move_iterator(ordered.begin()), ordered.size());
+    }
+
+    /**
+     * @brief Auxiliary function to copy a subtree without recursion:
+     * the subtree is visited in preorder following the parent pointers,
+     * so that the extra memory does not depend on its height, and the
+     * copy of every node is linked to its parent as soon as it is created
+     *
+     * @param x pointer to the root of the subtree to copy from
+     * @param copy pointer to the copy of x, whose children are created
+     * @param from the pool the nodes are created in
+     */
+    static void _copy_subtree(const node* x, node* copy, pool_t& from){
+        const node* const top = x;
+        for(;;){
+            if(x->left && !copy->left){                     // go down to the left
+                x = x->left.get();
+                copy->left.reset(from.create(*x, copy));    // the children of the node have the node itself as parent
+                copy = copy->left.get();
+            }
+            else if(x->right && !copy->right){              // go down to the right
+                x = x->right.get();
+                copy->right.reset(from.create(*x, copy));
+                copy = copy->right.get();
+            }
+            else if(x == top){return;}
+            else{                                           // both children are done: go up
+                x = x->parent;
+                copy = copy->parent;
+            }
+        }
+    }
+
+    /**
+     * @brief Auxiliary function to copy a subtree.
+     * With more threads, as long as the nodes have two children the
+     * left subtree is copied by another thread in a pool of its own,
+     * as in balancing; the rest is copied by _copy_subtree
+     * 
+     * @param x pointer to the root of the subtree to copy from
+     * @param parent pointer to what it's supposed to be the parent of the copy
+     * @param from the pool the nodes are created in
+     * @param threads number of threads that can work on the subtree
+     * @return pointer to the root of the copy
+     */
+    node* _copy(const node* x, node* parent, pool_t& from, unsigned threads){
+        node* tmp = from.create(*x, parent);
+        if(threads > 1 && x->left && x->right){
+            pool_t side{from.get_allocator()};
+            std::future<node*> left;
+            try{
+                left = std::async(std::launch::async, [&](){
+                    return _copy(x->left.get(), tmp, side, threads / 2);
+                });
+                tmp->right.reset(_copy(x->right.get(), tmp, from, threads - threads / 2));
+                tmp->left.reset(left.get());
+            }
+            catch(...){
+                if(left.valid()){           // wait for the other thread, its nodes are in side
+                    try{tmp->left.reset(left.get());}
+                    catch(...){}            // it already destroyed what it copied
                 }
+                _destroy_subtree(tmp);      // the nodes of both pools, before side goes away
+                throw;
+            }
+            from.splice(std::move(side));
+            return tmp;
+        }
+        try{_copy_subtree(x, tmp, from);}
+        catch(...){
+            _destroy_subtree(tmp);          // the copied part, since a pair could not be copied
+            throw;
+        }
+        return tmp;
+    }
+
+    /**
+     * @brief Auxiliary function to destroy a subtree without recursion:
+     * every node is unlinked from its parent and destroyed once it has
+     * no children left, so that no chain of unique pointer destructors
+     * is ever started. The memory stays in the pool
+     *
+     * @param x pointer to the root of the subtree, already unlinked from its parent
+     */
+    static void _destroy_subtree(node* x) noexcept {
+        node* const stop = x ? x->parent : nullptr;
+        while(x != stop){
+            if(x->left){x = x->left.release();}
+            else if(x->right){x = x->right.release();}
+            else{
+                auto parent = x->parent;
+                _node_destroy{}(x);
+                x = parent;
+            }
+        }
+    }
+
+    /**
+     * @brief Auxiliary function 
+     */
+    bool _is_empty() const noexcept {return head == nullptr;}
+
+    /**
+     * @brief Auxiliary function to compute the number of keys smaller than x
+     * (or not bigger than x, if inclusive is true): whenever we move to the right
+     * the current node and its left subtree are all smaller
+     * 
+     * @param x the key
+     * @param inclusive whether the keys equivalent to x are counted
+     */
+    template <typename K>
+    std::size_t _rank(const K& x, bool inclusive) const noexcept {
+        auto reader = adjust.enter();
+        auto probe = _probe();
+        std::size_t r = 0;
+        auto tmp = head.get();
+        while(tmp){
+            probe.visit();
+            if(inclusive ? !probe.less(cmp, x, tmp->_pair.first) : probe.less(cmp, tmp->_pair.first, x)){
+                r += 1 + _subtree_size(tmp->left.get());
+                tmp = tmp->right.get();
+            }
+            else{tmp = tmp->left.get();}
+        }
+        return r;
+    }
+
+    /**
+     * @brief Auxiliary function to retrieve the node with the k-th smallest key
+     * 
+     * @param k rank of the key, starting from 0
+     * @return pointer to the node, nullptr if k >= size()
+     */
+    node* _select(std::size_t k) const noexcept {
+        auto reader = adjust.enter();
+        auto tmp = head.get();
+        while(tmp){
+            auto left = _subtree_size(tmp->left.get());
+            if(k < left){tmp = tmp->left.get();}
+            else if(k == left){return tmp;}
+            else{
+                k -= left + 1;
+                tmp = tmp->right.get();
             }
         }
-        return std::pair<iterator, bool>{iterator{new_node}, true};
+        return nullptr;
+    }
+
+public: 
+    
+    /**
+     * @brief Default ctor
+     * 
+     */ 
+    bst() noexcept = default;
+
+    /**
+     * @brief Custom ctor, no implicit conversion
+     * 
+     * @param a the allocator the nodes are obtained from
+     */
+    explicit bst(const Alloc& a) noexcept: pool{a} {}
+
+    /**
+     * @brief Custom ctor, it builds a balanced tree out of a range of pairs
+     * (see bulk_load)
+     * 
+     * @param first iterator to the first pair
+     * @param last iterator to one past the last pair
+     * @param a the allocator the nodes are obtained from
+     */
+    template <typename It>
+    bst(It first, It last, const Alloc& a = Alloc{}): pool{a} {bulk_load(first, last);}
+
+    /**
+     * @brief Dtor, it releases the node pool through clear
+     * 
+     */
+    ~bst() noexcept {clear();}
+
+
+
+    /**
+     * @brief Move ctor, the nodes (and their pool) are stolen from x
+     */
+    bst(bst&& x) noexcept: pool{std::move(x.pool)}, head{std::move(x.head)}, tail{x.tail}, items{x.items}, cmp{std::move(x.cmp)} {
+        _adopt_stats(x);
+        x.tail = nullptr;
+        x.items = 0;
+    }
+    
+    /**
+     * @brief Move assignment
+     */
+    bst& operator=(bst&& x) noexcept{
+        clear();                     // our nodes must go before our pool
+        pool = std::move(x.pool);
+        head = std::move(x.head);
+        tail = x.tail;
+        x.tail = nullptr;
+        items = x.items;
+        x.items = 0;
+        cmp = std::move(x.cmp);
+        _adopt_stats(x);
+        return *this;
+    }
+    
+
+    
+    /**
+     * @brief Copy ctor
+     *  
+     */
+    bst(const bst& x): pool{x.pool.get_allocator()}, items{x.items}, cmp{x.cmp} {
+        auto reader = x.adjust.enter();
+        if(x.head){    
+            auto threads = _threads(x.items);
+            if(threads == 1){pool.reserve(x.items);}        // all the nodes in one block
+            head.reset(_copy(x.head.get(), nullptr, pool, threads));     // as far as x is not an empty bst I copy it
+            tail = _right_most();
+        }
+        _adopt_stats(x);
+    }
+
+
+    /**
+     * @brief Copy assignment
+     */
+    bst& operator=(const bst& x){
+        auto tmp{x};                 // construct a copy of x
+        *(this) = std::move(tmp);    // move it into myself
+        return *this;                // return myself
+    }
+
+    /**
+     * @brief Retrieve the left most node.
+     * Auxiliary function left_most is used
+     * 
+     * @return iterator to the left most node
+     */
+    iterator begin() noexcept {return left_most();}
+
+    /**
+     * @brief Retrieve the left most node.
+     * Auxiliary function left_most is used
+     * 
+     * @return const_iterator to the left most node
+     */
+    const_iterator begin() const noexcept {return left_most();}
+
+    /**
+     * @brief Retrieve the left most node.
+     * Auxiliary function left_most is used
+     * 
+     * @return const_iterator to the left most node
+     */
+    const_iterator cbegin() const noexcept {return left_most();}
+    
+    /**
+     * @return reverse iterator to the right most node
+     */
+    reverse_iterator rbegin() noexcept {return reverse_iterator{end()};}
+
+    /**
+     * @return const reverse iterator to the right most node
+     */
+    const_reverse_iterator rbegin() const noexcept {return const_reverse_iterator{end()};}
+
+    /**
+     * @return const reverse iterator to the right most node
+     */
+    const_reverse_iterator crbegin() const noexcept {return const_reverse_iterator{cend()};}
+
+    /**
+     * @return reverse iterator to one before the left most node
+     */
+    reverse_iterator rend() noexcept {return reverse_iterator{begin()};}
+
+    /**
+     * @return const reverse iterator to one before the left most node
+     */
+    const_reverse_iterator rend() const noexcept {return const_reverse_iterator{begin()};}
+
+    /**
+     * @return const reverse iterator to one before the left most node
+     */
+    const_reverse_iterator crend() const noexcept {return const_reverse_iterator{cbegin()};}
+
+    /**
+     * @return iterator to one past the last node
+     */
+    iterator end() noexcept {return iterator{nullptr, &tail};}
+
+    /**
+     * @return const_iterator to one past the last node
+     */
+    const_iterator end() const noexcept {return const_iterator{nullptr, &tail};}
+
+    /**
+     * @return const_iterator to one past the last node
+     */
+    const_iterator cend() const noexcept {return const_iterator{nullptr, &tail};}
+
+
+    /**
+     * @brief Find a given key. If the key is present, returns an iterator to the proper node, end() otherwise.
+     * 
+     * @param x key to look for
+     * @return iterator to the key or iterator to one past the last node
+     */
+    iterator find(const k_t& x) noexcept {return iterator{_find(x), &tail};}
+
+    /**
+     * @brief Find a given key. If the key is present, returns an iterator to the proper node, end() otherwise.
+     * 
+     * @param x key to look for
+     * @return const_iterator to the key or iterator to one past the last node
+     */
+    const_iterator find(const k_t& x) const noexcept {return const_iterator{_find(x), &tail};}
+
+    /**
+     * @brief Find the key equivalent to x, that can be of any type comparable
+     * with the keys, e.g. a const char* in a tree of std::string: no key is
+     * constructed. It takes part in overload resolution only if OP is
+     * transparent (it defines is_transparent, as std::less<> does)
+     * 
+     * @param x value to look for
+     * @return iterator to the key or iterator to one past the last node
+     */
+    template <typename K, typename O = OP, typename = typename O::is_transparent>
+    iterator find(const K& x) noexcept {return iterator{_find(x), &tail};}
+
+    /**
+     * @brief Find the key equivalent to x, of any type comparable with the keys
+     * (only if OP is transparent)
+     * 
+     * @param x value to look for
+     * @return const_iterator to the key or iterator to one past the last node
+     */
+    template <typename K, typename O = OP, typename = typename O::is_transparent>
+    const_iterator find(const K& x) const noexcept {return const_iterator{_find(x), &tail};}
+
+    /**
+     * @return 1 if the key is in the bst, 0 otherwise
+     */
+    std::size_t count(const k_t& x) const noexcept {return _find(x) ? 1 : 0;}
+
+    /**
+     * @return 1 if a key equivalent to x is in the bst, 0 otherwise (only if OP is transparent)
+     */
+    template <typename K, typename O = OP, typename = typename O::is_transparent>
+    std::size_t count(const K& x) const noexcept {return _find(x) ? 1 : 0;}
+
+    /**
+     * @return whether the key is in the bst
+     */
+    bool contains(const k_t& x) const noexcept {return _find(x) != nullptr;}
+
+    /**
+     * @return whether a key equivalent to x is in the bst (only if OP is transparent)
+     */
+    template <typename K, typename O = OP, typename = typename O::is_transparent>
+    bool contains(const K& x) const noexcept {return _find(x) != nullptr;}
+
+    /**
+     * @brief Find many keys at once: out[i] is find(first[i]).
+     * The searches are interleaved and their nodes prefetched, so that
+     * the memory latency of one overlaps with the others; if the keys are
+     * sorted, each search starts where its path leaves the previous one
+     * 
+     * @param first random access iterator to the first key
+     * @param last random access iterator to one past the last key
+     * @param out random access iterator to the first of last - first iterators
+     */
+    template <typename It, typename Out>
+    void find_batch(It first, It last, Out out){
+        _find_batch(first, last, [&](std::size_t i, node* x){out[i] = x ? iterator{x, &tail} : end();});
+    }
+
+    /**
+     * @brief Find many keys at once: out[i] is find(first[i]) (see above)
+     * 
+     * @param first random access iterator to the first key
+     * @param last random access iterator to one past the last key
+     * @param out random access iterator to the first of last - first const_iterators
+     */
+    template <typename It, typename Out>
+    void find_batch(It first, It last, Out out) const {
+        _find_batch(first, last, [&](std::size_t i, node* x){out[i] = x ? const_iterator{x, &tail} : end();});
     }
 
     /**
-     * @brief Auxiliary function to balance the tree.
-     * 
+     * @brief Check many keys at once: out[i] is contains(first[i]) (see find_batch)
      * 
-     * @param v an std::vector of pairs
-     * @param start first index
-     * @param end last index
-     * @param parent pointer to the parent node
-     * @return pointer to the node with the median element 
+     * @param first random access iterator to the first key
+     * @param last random access iterator to one past the last key
+     * @param out random access iterator to the first of last - first bools
      */
-
-    template <typename P>
-    node* balancing(std::vector<P> v, int start, int end, node* parent){
-        // Base Case 
-        if (start > end) 
-        return nullptr; 
-  
-        // Get the median element and make a node out of it (head)
-        int median = (start + end)/2; 
-        node* tmp = new node{v[median]}; 
-        tmp->parent = parent;
-
-
-        // Recursively construct the left subtree 
-        // and make it left child  
-        tmp->left.reset(balancing(v, start, median - 1, tmp)); 
-  
-        // Recursively construct the right subtree 
-        // and make it right child 
-        tmp->right.reset(balancing(v, median + 1, end, tmp)); 
-  
-        return tmp; 
+    template <typename It, typename Out>
+    void contains_batch(It first, It last, Out out) const {
+        _find_batch(first, last, [&](std::size_t i, node* x){out[i] = x != nullptr;});
     }
 
     /**
-     * @brief Auxiliary function 
+     * @brief Find the first key that is not smaller than x
+     * 
+     * @param x key to look for
+     * @return iterator to such key or end()
      */
-    bool _is_empty() const noexcept {return head == nullptr;}
+    iterator lower_bound(const k_t& x) noexcept {return iterator{_bound(x, false), &tail};}
 
-public: 
-    
     /**
-     * @brief Default ctor
+     * @brief Find the first key that is not smaller than x
      * 
-     */ 
-    bst() noexcept = default;
+     * @param x key to look for
+     * @return const_iterator to such key or end()
+     */
+    const_iterator lower_bound(const k_t& x) const noexcept {return const_iterator{_bound(x, false), &tail};}
 
     /**
-     * @brief Default dtor
+     * @brief Find the first key that is not smaller than x, of any type
+     * comparable with the keys (only if OP is transparent)
      * 
+     * @param x value to look for
+     * @return iterator to such key or end()
      */
-    ~bst() noexcept = default;
-
-
+    template <typename K, typename O = OP, typename = typename O::is_transparent>
+    iterator lower_bound(const K& x) noexcept {return iterator{_bound(x, false), &tail};}
 
     /**
-     * @brief Move ctor 
+     * @brief Find the first key that is not smaller than x, of any type
+     * comparable with the keys (only if OP is transparent)
+     * 
+     * @param x value to look for
+     * @return const_iterator to such key or end()
      */
-    bst(bst&& x) noexcept: head{std::move(x.head)}, cmp{std::move(x.cmp)} {}
-    
+    template <typename K, typename O = OP, typename = typename O::is_transparent>
+    const_iterator lower_bound(const K& x) const noexcept {return const_iterator{_bound(x, false), &tail};}
+
     /**
-     * @brief Move assignment
+     * @brief Find the first key that is bigger than x
+     * 
+     * @param x key to look for
+     * @return iterator to such key or end()
      */
-    bst& operator=(bst&& x) noexcept{
-        head = std::move(x.head);
-        cmp = std::move(x.cmp);
-        return *this;
-    }
-    
+    iterator upper_bound(const k_t& x) noexcept {return iterator{_bound(x, true), &tail};}
 
-    
     /**
-     * @brief Copy ctor
-     *  
+     * @brief Find the first key that is bigger than x
+     * 
+     * @param x key to look for
+     * @return const_iterator to such key or end()
      */
-    bst(const bst& x){
-        if(x.head){    
-            cmp = x.cmp;                 
-            head.reset(new node{x.head, x.head->parent});   // as far as x is not an empty bst I copy it by
-        }                                                   // calling recursively the node ctor
-    }
-
+    const_iterator upper_bound(const k_t& x) const noexcept {return const_iterator{_bound(x, true), &tail};}
 
     /**
-     * @brief Copy assignment
+     * @brief Find the first key that is bigger than x, of any type
+     * comparable with the keys (only if OP is transparent)
+     * 
+     * @param x value to look for
+     * @return iterator to such key or end()
      */
-    bst& operator=(const bst& x){
-        auto tmp{x};                 // construct a copy of x
-        *(this) = std::move(tmp);    // move it into myself
-        return *this;                // return myself
-    }
+    template <typename K, typename O = OP, typename = typename O::is_transparent>
+    iterator upper_bound(const K& x) noexcept {return iterator{_bound(x, true), &tail};}
 
     /**
-     * @brief Retrieve the left most node.
-     * Auxiliary function left_most is used
+     * @brief Find the first key that is bigger than x, of any type
+     * comparable with the keys (only if OP is transparent)
      * 
-     * @return iterator to the left most node
+     * @param x value to look for
+     * @return const_iterator to such key or end()
      */
-    iterator begin() noexcept {return left_most();}
+    template <typename K, typename O = OP, typename = typename O::is_transparent>
+    const_iterator upper_bound(const K& x) const noexcept {return const_iterator{_bound(x, true), &tail};}
 
     /**
-     * @brief Retrieve the left most node.
-     * Auxiliary function left_most is used
+     * @brief Range of the keys equivalent to x: since the keys are unique
+     * it is either empty or made of a single key.
+     * Only one traversal of the bst is performed
      * 
-     * @return const_iterator to the left most node
+     * @param x key to look for
+     * @return pair of lower_bound(x) and upper_bound(x)
      */
-    const_iterator begin() const noexcept {return left_most();}
+    std::pair<iterator, iterator> equal_range(const k_t& x) noexcept {
+        auto first = lower_bound(x);
+        auto last = first;
+        if(last != end() && !cmp(x, *last)){++last;}
+        return std::pair<iterator, iterator>{first, last};
+    }
 
     /**
-     * @brief Retrieve the left most node.
-     * Auxiliary function left_most is used
+     * @brief Range of the keys equivalent to x: since the keys are unique
+     * it is either empty or made of a single key.
+     * Only one traversal of the bst is performed
      * 
-     * @return const_iterator to the left most node
+     * @param x key to look for
+     * @return pair of lower_bound(x) and upper_bound(x)
      */
-    const_iterator cbegin() const noexcept {return left_most();}
-    
+    std::pair<const_iterator, const_iterator> equal_range(const k_t& x) const noexcept {
+        auto first = lower_bound(x);
+        auto last = first;
+        if(last != end() && !cmp(x, *last)){++last;}
+        return std::pair<const_iterator, const_iterator>{first, last};
+    }
+
+
     /**
-     * @return iterator to one past the last node
+     * @return the number of keys in the bst, in constant time
      */
-    iterator end() noexcept {return iterator{nullptr};}
+    std::size_t size() const noexcept {return items;}
 
     /**
-     * @return const_iterator to one past the last node
+     * @brief Number of keys smaller than x.
+     * It requires the order_statistic policy
+     * 
+     * @param x the key
+     * @return the position that x has, or would have, in the inorder sequence
      */
-    const_iterator end() const noexcept {return const_iterator{nullptr};}
+    std::size_t rank(const k_t& x) const noexcept {
+        static_assert(counted, "rank requires the order_statistic policy");
+        return _rank(x, false);
+    }
 
     /**
-     * @return const_iterator to one past the last node
+     * @brief Retrieve the k-th smallest key (starting from 0).
+     * It requires the order_statistic policy
+     * 
+     * @param k the rank of the key
+     * @return iterator to the node with such key, end() if k >= size()
      */
-    const_iterator cend() const noexcept {return const_iterator{nullptr};}
+    iterator select(std::size_t k) noexcept {
+        static_assert(counted, "select requires the order_statistic policy");
+        return iterator{_select(k), &tail};
+    }
 
+    /**
+     * @brief Retrieve the k-th smallest key (starting from 0).
+     * It requires the order_statistic policy
+     * 
+     * @param k the rank of the key
+     * @return const_iterator to the node with such key, end() if k >= size()
+     */
+    const_iterator select(std::size_t k) const noexcept {
+        static_assert(counted, "select requires the order_statistic policy");
+        return const_iterator{_select(k), &tail};
+    }
 
     /**
-     * @brief Find a given key. If the key is present, returns an iterator to the proper node, end() otherwise.
+     * @brief Number of keys in the closed interval [a, b], with two traversals.
+     * It requires the order_statistic policy
      * 
-     * @param x key to look for
-     * @return iterator to the key or iterator to one past the last node
+     * @param a the lower end of the interval
+     * @param b the upper end of the interval
      */
-    iterator find(const k_t& x) noexcept {
-        auto tmp{head.get()};
-        // we traverse the bst until tmp is nullptr
-        while (tmp)     
-        {
-            if(!cmp(tmp->_pair.first,x) && !cmp(x,tmp->_pair.first)){  // found it  
-                return iterator{tmp};
-            }
-            else{
-                // otherwise move to the right or left child
-                if( cmp(tmp->_pair.first,x) ){
-                    tmp = tmp->right.get();
-                }
-                else{ tmp = tmp->left.get();}
-            }
-        }
-        // if the while loop did not return means that x is not in the bst
-        return end(); 
+    std::size_t count_range(const k_t& a, const k_t& b) const noexcept {
+        static_assert(counted, "count_range requires the order_statistic policy");
+        if(cmp(b, a)){return 0;}
+        return _rank(b, true) - _rank(a, false);
     }
 
     /**
-     * @brief Find a given key. If the key is present, returns an iterator to the proper node, end() otherwise.
+     * @brief Summary of the pairs with keys in the closed interval [a, b],
+     * in O(height): below the first node in [a, b] the path to a collects
+     * the nodes not smaller than a with their right subtrees, and the path
+     * to b the nodes not bigger than b with their left subtrees.
+     * It requires a tree augmented with a monoid
      * 
-     * @param x key to look for
-     * @return const_iterator to the key or iterator to one past the last node
+     * @param a the lower end of the interval
+     * @param b the upper end of the interval
+     * @return the combination of the pairs in order of key, the identity if there are none
      */
-    const_iterator find(const k_t& x) const noexcept {
-        auto tmp{head.get()};
-        // we traverse the bst until tmp is nullptr
-        while (tmp)     
-        {
-            if(!cmp(tmp->_pair.first,x) && !cmp(x,tmp->_pair.first)){  // found it
-                return const_iterator{tmp};
+    template <typename M = monoid>
+    typename M::type aggregate(const k_t& a, const k_t& b) const {
+        static_assert(summarized, "aggregate requires the augmented policy");
+        auto reader = adjust.enter();
+        auto x = head.get();
+        while(x){                                           // the root of the smallest subtree with [a, b]
+            if(cmp(x->_pair.first, a)){x = x->right.get();}
+            else if(cmp(b, x->_pair.first)){x = x->left.get();}
+            else{break;}
+        }
+        if(!x){return M::identity();}
+
+        auto lower = M::identity();                         // the pairs on the left of x, from a on
+        for(auto y = x->left.get(); y;){
+            if(cmp(y->_pair.first, a)){y = y->right.get();}
+            else{
+                auto s = M::of(y->_pair.first, y->_pair.second);
+                if(y->right){s = M::combine(s, y->right->summary);}
+                lower = M::combine(s, lower);
+                y = y->left.get();
             }
+        }
+        auto upper = M::identity();                         // the pairs on the right of x, up to b
+        for(auto y = x->right.get(); y;){
+            if(cmp(b, y->_pair.first)){y = y->left.get();}
             else{
-                // otherwise move to the right or left child
-                if( cmp(tmp->_pair.first,x) ){
-                    tmp = tmp->right.get();
-                }
-                else{ tmp = tmp->left.get();}
+                auto s = M::of(y->_pair.first, y->_pair.second);
+                if(y->left){s = M::combine(y->left->summary, s);}
+                upper = M::combine(upper, s);
+                y = y->right.get();
             }
         }
-        // if the while loop did not return means that x is not in the bst
+        return M::combine(M::combine(lower, M::of(x->_pair.first, x->_pair.second)), upper);
+    }
 
-        // notice that since the function is marked with const
-        // the version of end() that is called is the one that returns a const_iterator
-        return end(); 
+    /**
+     * @brief Summary of all the pairs, in constant time.
+     * It requires a tree augmented with a monoid
+     */
+    template <typename M = monoid>
+    typename M::type aggregate() const {
+        static_assert(summarized, "aggregate requires the augmented policy");
+        auto reader = adjust.enter();
+        return head ? head->summary : M::identity();
     }
 
 
@@ -334,149 +1581,524 @@ public:
 
 
 
+    /**
+     * @brief It is used to insert a new node, close to hint.
+     * If the key belongs right before hint the insertion takes
+     * constant time (e.g. hint = end() when the keys come in order), 
+     * otherwise it is a normal insertion
+     * 
+     * @param hint iterator to the node that should follow the new one
+     * @param x l-value ref to the pair to be inserted
+     * @return iterator pointing to the node with the key of x
+     */
+    iterator insert(const_iterator hint, const std::pair<k_t, v_t>& x) {return _insert(hint, x);}
+
+    /**
+     * @brief It is used to insert a new node, close to hint.
+     * If the key belongs right before hint the insertion takes
+     * constant time (e.g. hint = end() when the keys come in order), 
+     * otherwise it is a normal insertion
+     * 
+     * @param hint iterator to the node that should follow the new one
+     * @param x r-value ref to the pair to be inserted
+     * @return iterator pointing to the node with the key of x
+     */
+    iterator insert(const_iterator hint, std::pair<k_t, v_t>&& x) {return _insert(hint, std::move(x));}
+
+
+
     /**
      * @brief Inserts a new element into the container constructed in-place
-     *  with the given args if there is no element with the key in the container
+     *  with the given args if there is no element with the key in the container.
+     *  The node is constructed first, and given back to the node pool if the key is present
      *  
      * @param args both the key and the value of the node to be inserted 
      * @return a pair of an iterator (pointing to the node) and a bool
      */
     template <typename... Types >
-    std::pair<iterator,bool> emplace(Types&&... args){                      // emplace just needs to construct
-        return _insert(std::pair<k_t,v_t>{std::forward<Types>(args)...});   // an std::pair and call insert
+    std::pair<iterator,bool> emplace(Types&&... args){
+        auto new_node = pool.create(_in_place_t{}, std::forward<Types>(args)...);
+        auto where = _locate(new_node->_pair.first);
+        if(where.second){
+            pool.destroy(new_node);
+            return std::pair<iterator, bool>{iterator{where.first, &tail}, false};
+        }
+        return std::pair<iterator, bool>{iterator{_attach(where.first, new_node), &tail}, true};
+    }
+
+    /**
+     * @brief If the key is not present, inserts a new element with the given key
+     * and the value constructed in-place from args; otherwise it does nothing
+     * (in particular args are not moved from)
+     * 
+     * @param k l-value ref to the key
+     * @param args the arguments to construct the value from
+     * @return a pair of an iterator (pointing to the node) and a bool
+     */
+    template <typename... Types >
+    std::pair<iterator,bool> try_emplace(const k_t& k, Types&&... args){
+        return _try_emplace(k, std::forward<Types>(args)...);
     }
 
     /**
-     * @brief Clear the content of the tree
+     * @brief If the key is not present, inserts a new element with the given key
+     * and the value constructed in-place from args; otherwise it does nothing
+     * (in particular neither k nor args are moved from)
      * 
+     * @param k r-value ref to the key
+     * @param args the arguments to construct the value from
+     * @return a pair of an iterator (pointing to the node) and a bool
+     */
+    template <typename... Types >
+    std::pair<iterator,bool> try_emplace(k_t&& k, Types&&... args){
+        return _try_emplace(std::move(k), std::forward<Types>(args)...);
+    }
+
+    /**
+     * @brief If no key is equivalent to k, inserts a new element whose key is
+     * constructed from k, and whose value is constructed in-place from args;
+     * otherwise it does nothing. The key is looked for with k itself, so it is
+     * constructed only on a real insertion. It takes part in overload
+     * resolution only if OP is transparent
+     * 
+     * @param k value the key can be compared with and constructed from
+     * @param args the arguments to construct the value from
+     * @return a pair of an iterator (pointing to the node) and a bool
+     */
+    template <typename K, typename... Types, typename O = OP, typename = typename O::is_transparent>
+    std::pair<iterator,bool> try_emplace(K&& k, Types&&... args){
+        return _try_emplace(std::forward<K>(k), std::forward<Types>(args)...);
+    }
+
+    /**
+     * @brief If the key is present, assigns obj to its value;
+     * otherwise inserts a new element with the given key and value.
+     * The bool is true if the insertion took place, false if the assignment did
+     * 
+     * @param k l-value ref to the key
+     * @param obj the value
+     * @return a pair of an iterator (pointing to the node) and a bool
+     */
+    template <typename M>
+    std::pair<iterator,bool> insert_or_assign(const k_t& k, M&& obj){
+        auto res = _try_emplace(k, std::forward<M>(obj));
+        if(!res.second){_assign(res.first.where(), std::forward<M>(obj));}
+        return res;
+    }
+
+    /**
+     * @brief If the key is present, assigns obj to its value;
+     * otherwise inserts a new element with the given key and value.
+     * The bool is true if the insertion took place, false if the assignment did
+     * 
+     * @param k r-value ref to the key
+     * @param obj the value
+     * @return a pair of an iterator (pointing to the node) and a bool
+     */
+    template <typename M>
+    std::pair<iterator,bool> insert_or_assign(k_t&& k, M&& obj){
+        auto res = _try_emplace(std::move(k), std::forward<M>(obj));
+        if(!res.second){_assign(res.first.where(), std::forward<M>(obj));}
+        return res;
+    }
+
+    /**
+     * @brief Clear the content of the tree.
+     * If the pairs have a trivial destructor the nodes are simply forgotten,
+     * otherwise they are destroyed one by one, without recursion;
+     * then all the blocks of the node pool are released at once
+     * 
+     */
+    void clear() noexcept {
+        if(std::is_trivially_destructible<std::pair<k_t,v_t>>::value){head.release();}
+        else{_destroy_subtree(head.release());}
+        tail = nullptr;
+        items = 0;
+        pool.release();
+        _reshaped();
+    }
+
+    /**
+     * @return a copy of the allocator of the node pool
      */
-    void clear() noexcept {head.reset();}
+    Alloc get_allocator() const {return pool.get_allocator();}
 
     
     
     /**
-     * This method balances the tree.
-     * At first it traverse the bst inorder and stores all the pairs in a vector v;
-     * then clear the tree and insert the nodes
-     * starting from the median of v and again recursively on the left and right 
-     * subvector of v
+     * This method replaces the content of the tree with the pairs in [first, last),
+     * building a perfectly balanced tree in linear time.
+     * If the keys of a random access range are already sorted the nodes are
+     * built straight from it, all in a single block of the node pool;
+     * otherwise the pairs are first copied, sorted and deduplicated
+     * (the first pair with a given key wins, as with insert).
+     * Above parallel_cutoff pairs both the sort and the construction
+     * of the subtrees are split among the cores
      * 
+     * @param first iterator to the first pair
+     * @param last iterator to one past the last pair
+     */
+    template <typename It>
+    void bulk_load(It first, It last){
+        clear();
+        _bulk_load(first, last, typename std::iterator_traits<It>::iterator_category{});
+        tail = _right_most();
+        // set the balancing information of the new nodes
+        BAL::rebuild(head.get());
+        _reshaped();
+    }
+
+
+    /**
+     * This method inserts the pairs in [first, last), that need not be sorted.
+     * The batch is sorted in parallel (see bulk_load); if it is small wrt the tree
+     * its pairs are inserted one by one, otherwise it is merged with the pairs
+     * of the tree and the tree is rebuilt, in parallel, in linear time.
+     * As with insert, the pairs whose key is already present are discarded
      * 
+     * @param first iterator to the first pair
+     * @param last iterator to one past the last pair
      */
-    void balance(){
-        std::vector<std::pair<k_t,v_t>> ordered;
+    template <typename It>
+    void parallel_bulk_insert(It first, It last){
+        std::vector<std::pair<k_t,v_t>> batch(first, last);
+        _sort_unique(batch);
+
+        if(batch.size() * 4 < items){
+            for(auto& x : batch){insert(std::move(x));}
+            return;
+        }
 
-        // fill ordered with inorder elements of the bst
-        for(const_iterator i = cbegin(); i != cend() ; ++i){
-            ordered.emplace_back(*i, i.value());
+        std::vector<std::pair<k_t,v_t>> merged;
+        merged.reserve(items + batch.size());
+        auto b = batch.begin();
+        for(auto i = begin(); i != end(); ++i){
+            auto& x = i.where()->_pair;
+            while(b != batch.end() && cmp(b->first, x.first)){merged.push_back(std::move(*b++));}
+            if(b != batch.end() && !cmp(x.first, b->first)){++b;}     // the key is already in the tree
+            merged.push_back(std::move(x));
         }
-        
-        // clear the bst (*this) 
-        clear();
-        // rebuild the bst
-        head.reset(balancing(ordered, 0, ordered.size()-1, nullptr));
+        std::move(b, batch.end(), std::back_inserter(merged));
+        bulk_load(std::make_move_iterator(merged.begin()), std::make_move_iterator(merged.end()));
     }
 
 
-    
+    /**
+     * This method balances the tree in place, with the Day-Stout-Warren algorithm.
+     * At first the tree is turned into a vine (a list of right children)
+     * by right rotations; then groups of left rotations along the vine
+     * fold it into a tree whose levels are all full except the last one.
+     * The nodes are only relinked: nothing is allocated or copied,
+     * the extra memory is constant and the parent pointers stay consistent
+     * 
+     */
+    void balance() noexcept {
+#ifdef BST_STATS
+        _bst_timer timer{counters};
+#endif
+        _vine_to_tree(_to_vine());
+        _reshaped();
+    }
 
+#ifdef BST_STATS
+    /**
+     * This method takes a snapshot of the instrumentation (see bits_bst_stats.hpp):
+     * the counters of the lookups and of balance since the last reset_stats,
+     * and the shape of the tree, measured in a linear walk
+     * 
+     * @return the snapshot
+     */
+    bst_stats stats() const {
+        auto reader = adjust.enter();
+        bst_stats s;
+        s.size = items;
+        std::size_t sum = 0;
+        _for_each_depth([&](std::size_t d){
+            if(d >= s.depth_histogram.size()){s.depth_histogram.resize(d + 1);}
+            ++s.depth_histogram[d];
+            sum += d;
+        });
+        s.height = s.depth_histogram.size();
+        s.average_depth = items ? static_cast<double>(sum) / items : 0;
+        s.bytes_allocated = pool.capacity() * sizeof(node);
+        s.bytes_live = items * sizeof(node);
+        counters.fill(s);
+        return s;
+    }
 
     /**
-     * @brief Removes the element (if one exists) with the key equivalent to key.
+     * @brief Set the counters of the lookups and of balance to zero
+     */
+    void reset_stats() noexcept {counters.reset();}
+
+    /**
+     * This method makes the tree balance itself whenever the average depth
+     * of its nodes exceeds factor * log2(n). The sum of the depths is kept
+     * up to date by insert and erase, so the check is constant time; after
+     * an erase the sum is only an upper bound (unless the policy is an
+     * order_statistic), and it is measured before balancing.
+     * It has no effect with red_black and avl, that bound the height themselves
      * 
-     * @param x the key of the node to be deleted
+     * @param factor at least 1, since a balanced tree has average depth about log2(n); 0 turns it off
      */
-    void erase(const k_t& x) noexcept {
-    
-        if(find(x)!=iterator{nullptr}){       // better to have ... != end()  // check that the key is present in the bst
-            node* starting_node = find(x).where();
-
-            // starting_node is now pointing to
-            // the node we want to delete; let's cover all the 
-            // possible cases
-
-            // CASE ONE: THE NODE IS A LEAF
-            if(!starting_node->left && !starting_node->right){                         // check the node has no children
-                auto key_of_parent = starting_node->parent->_pair.first;
-                auto parent = starting_node->parent;
-                // we release and reset the pointer of the parent node
-                if(cmp(x,key_of_parent)){parent->left.release();parent->left.reset();} // the node to delete is a left child
-                else{parent->right.release();parent->right.reset();}                   // the node to delete is a right child   
-            }
+    void auto_rebalance(double factor){
+        if(factor != 0 && factor < 1){throw std::invalid_argument{"auto_rebalance: the factor must be 0 or at least 1"};}
+        counters.factor = factor;
+        _reshaped();
+        if(_tracking()){_check_depth();}
+    }
+#endif
 
 
-            // CASE TWO: THE NODE HAS JUST ONE CHILD
-            if((!starting_node->left && starting_node->right) || (starting_node->left && !starting_node->right))          // check the node has only one child
-            {
-                if(starting_node->left){                                // if the child is on the left
-                    auto left_child = starting_node->left.release();    // ptr to the unique child
-                    auto parent = starting_node->parent;                // ptr to parent node
+    /**
+     * @brief Move all the nodes of x into this tree, without allocating or
+     * copying any pair. With a balancing policy the root of the smaller tree
+     * splits the other one and the halves are merged recursively with its
+     * subtrees, in O(m log(n/m + 1)) for sizes m <= n; otherwise both trees
+     * are turned into vines, merged in linear time and folded back into a
+     * balanced tree, as in balance. If a key is in both trees, the pair of
+     * this tree is kept and the one of x is destroyed.
+     * The memory of the nodes of x is adopted by the node pool of this tree;
+     * x is left empty
+     *
+     * @param x the tree to merge
+     */
+    void merge(bst&& x){
+        if(&x == this || !x.head){return;}
+        if(!head){
+            *this = std::move(x);
+            return;
+        }
+        pool.splice(std::move(x.pool));
+        if(std::is_base_of<unbalanced, BAL>::value){            // no bound on the height to recurse on
+            _merge_vines(x);
+            _reshaped();
+            return;
+        }
 
-                    auto key_of_parent = parent->_pair.first;
-                    if(cmp(x,key_of_parent)){parent->left.release();parent->left.reset(left_child); left_child->parent = parent;}  // if the starting node is on the left of its parent
-                    else{parent->right.release();parent->right.reset(left_child); left_child->parent = parent;}                    // otherwise on the right
-                }
-                else{                                                   // if the child is on the right
-                    auto right_child = starting_node->right.release();  // ptr to unique child
-                    auto parent = starting_node->parent;                // ptr to parent node
+        std::size_t duplicates = 0;
+        node* a = head.release();
+        node* b = x.head.release();
+        head.reset(items <= x.items ? _union(a, b, true, duplicates) : _union(b, a, false, duplicates));
+        items += x.items - duplicates;
+        tail = _right_most();
+        x.tail = nullptr;
+        x.items = 0;
+        _reshaped();
+    }
 
-                    auto key_of_parent = parent->_pair.first;
-                    if(cmp(x,key_of_parent)){parent->left.release();parent->left.reset(right_child); right_child->parent = parent;} // if the starting node is on the left of its parent
-                    else{parent->right.release();parent->right.reset(right_child); right_child->parent = parent;}                    // otherwise on the right
-                }
+    /**
+     * @brief Move all the nodes of x into this tree, when all the keys of
+     * x follow (or precede) all the keys of this tree: the right most node
+     * of the lower tree is cut out and joined with the two trees, in
+     * O(log n) with a balancing policy. Otherwise it is a merge.
+     * Nothing is allocated or copied, x is left empty
+     *
+     * @param x the tree to join
+     */
+    void join(bst&& x){
+        if(&x == this || !x.head){return;}
+        if(!head){
+            *this = std::move(x);
+            return;
+        }
+        bool after = cmp(tail->_pair.first, *x.left_most());
+        if(!after && !cmp(x.tail->_pair.first, *left_most())){
+            merge(std::move(x));                                // the ranges of keys overlap
+            return;
+        }
+        pool.splice(std::move(x.pool));
+
+        node* low = (after ? head : x.head).release();
+        node* high = (after ? x.head : head).release();
+        node* middle;                                           // the right most node of low
+        auto halves = _split(low, (after ? tail : x.tail)->_pair.first, middle);
+        head.reset(_join(halves.first, middle, high));
+        items += x.items;
+        if(after){tail = x.tail;}
+        x.tail = nullptr;
+        x.items = 0;
+        _reshaped();
+    }
+
+    /**
+     * @brief Move the keys not smaller than x into a new tree, without
+     * allocating or copying any pair: the path from the root to x is cut
+     * and the subtrees hanging from it are joined into the two parts,
+     * in O(log n) with a balancing policy. Unless the policy is an
+     * order_statistic, the sizes of the parts are found by counting the
+     * nodes of the smaller one.
+     * The nodes of the new tree stay where they are: the two node pools
+     * share the blocks, which are given back when both trees release them
+     *
+     * @param x the key where the tree is cut
+     * @return a tree with the keys not smaller than x; this tree keeps the smaller ones
+     */
+    bst split(const k_t& x){
+        bst upper{pool.get_allocator()};
+        upper.cmp = cmp;
+        if(!head){return upper;}
+        if(!cmp(tail->_pair.first, x)){upper.pool.share(pool);}   // some nodes go to upper
+
+        node* equal;
+        auto halves = _split(head.release(), x, equal);
+        if(equal){halves.second = _join(nullptr, equal, halves.second);}
+        BAL::make_root(halves.first);                           // a part may be a subtree cut out of the path
+        BAL::make_root(halves.second);
+        head.reset(halves.first);
+        upper.head.reset(halves.second);
+        if(upper.head){upper.tail = tail;}
+        tail = _right_most();
+
+        auto total = items;
+        if(counted){items = _subtree_size(head.get());}
+        else{                                                   // walk both parts from the cut at the same pace
+            std::size_t n = 0;
+            auto a = tail;
+            auto b = upper.head ? upper.left_most().where() : nullptr;
+            for(; a && b; ++n){
+                a = _predecessor(a);
+                b = _successor(b);
             }
+            items = a ? total - n : n;
+        }
+        upper.items = total - items;
+        _reshaped();
+        upper._adopt_stats(*this);
+        upper._reshaped();
+        return upper;
+    }
 
-            // LAST CASE: THE NODE HAS TWO CHILDREN
-            if(starting_node->left && starting_node->right){
-                // find the right most node between nodes
-                // that are on the right of the node we must delete
-                // and exchange key and value; then delete the old node
 
-                // we move to the right and then iterate over the left children
-                auto swap_node = starting_node->right.get();
-                while(swap_node->left){                           
-                    swap_node = swap_node->left.get();
-                }
-                // exchange keys and values (swap_node is no needed anymore)
-                starting_node->_pair = swap_node->_pair;
-
-                // since swap_node will now be eliminated we will
-                // reset the ptr that points to it but we have to consider
-                // two cases:
-                // swap_node is not the right child of the deleted node,
-                // in this case 
-                if(swap_node->parent != starting_node){
-                    if(swap_node->right){            
-                        // if swap_node has a right child it will be
-                        // attached to the parent of swap_node
-                        // and so it will have a new parent
-                        swap_node->right->parent = swap_node->parent;
-                    }
-
-                    auto tmp = swap_node->right.release(); 
-                    swap_node->parent->left.reset(tmp);    // attach the subtree to the parent
-                }
-                // otherwise we must
-                else{
-                    if(swap_node->right){  
-                        // if swap_node has a right child it will be
-                        // attached to the starting_node
-                        // and so it will have a new parent                
-                        swap_node->right->parent = starting_node;
-                    }
+    
+
+    /**
+     * This method takes an immutable snapshot of the tree, laid out
+     * for fast lookups (see bits_bst_frozen.hpp); the tree is left untouched
+     * 
+     * @return the snapshot
+     */
+    frozen_bst<k_t,v_t,OP> freeze() const {
+        auto reader = adjust.enter();
+        return frozen_bst<k_t,v_t,OP>{cbegin(), cend(), cmp};
+    }
 
-                    auto tmp = swap_node->right.release();
-                    starting_node->right.reset(tmp);
+    /**
+     * This method writes the pairs to a binary snapshot file, in one
+     * sequential pass (see bits_bst_snapshot.hpp); the keys and values
+     * must be trivially copyable. The file can be loaded back with load,
+     * or searched in place with a mapped_snapshot
+     * 
+     * @param path name of the file, replaced only once it is complete
+     */
+    void save(const std::string& path) const {
+        auto reader = adjust.enter();
+        _save_snapshot<k_t,v_t>(path, cbegin(), cend(), items);
+    }
 
-                }
-            }
+    /**
+     * This method replaces the content of the tree with the pairs of a
+     * snapshot file: the file is mapped in memory and, since its keys are
+     * sorted, the balanced tree is built straight from the mapping in linear
+     * time, as in bulk_load, with no copy of the pairs in between.
+     * A file that is not sorted wrt OP is copied, sorted and deduplicated
+     * 
+     * @param path name of a file written by save
+     */
+    void load(const std::string& path){
+        mapped_snapshot<k_t,v_t,OP> file{path, cmp};
+        file.advise(MADV_WILLNEED);
+        if(!file.is_sorted()){
+            std::vector<std::pair<k_t,v_t>> pairs;
+            pairs.reserve(file.size());
+            for(auto i = file.cbegin(); i != file.cend(); ++i){pairs.emplace_back(*i, i.value());}
+            bulk_load(std::make_move_iterator(pairs.begin()), std::make_move_iterator(pairs.end()));
+            return;
         }
+        clear();
+        _build(file.pairs(), file.size());
+        tail = _right_most();
+        BAL::rebuild(head.get());
+        _reshaped();
+    }
+
+
+    /**
+     * @brief Removes the element (if one exists) with the key equivalent to key.
+     * 
+     * @param x the key of the node to be deleted
+     */
+    void erase(const k_t& x) noexcept {_erase(x);}
+
+    /**
+     * @brief Removes the element (if one exists) with the key equivalent to x,
+     * that can be of any type comparable with the keys (only if OP is transparent)
+     * 
+     * @param x value equivalent to the key of the node to be deleted
+     */
+    template <typename K, typename O = OP, typename = typename O::is_transparent>
+    void erase(const K& x) noexcept {_erase(x);}
 
-        else{
+private:
+
+    /**
+     * @brief Auxiliary function implementing erase
+     * 
+     * @param x key, or any value comparable with the keys
+     */
+    template <typename K>
+    void _erase(const K& x) noexcept {
+    
+        auto starting_node = _find(x);
+        if(!starting_node){                                     // check that the key is present in the bst
             std::cerr << "ERROR: no element has key = " << x << std::endl;
+            return;
+        }
+
+        // starting_node is now pointing to
+        // the node we want to delete; we reduce all the 
+        // possible cases to the removal of a node with at most one child
+
+        // THE NODE HAS TWO CHILDREN:
+        // find the left most node between nodes
+        // that are on the right of the node we must delete,
+        // move its key and value into starting_node and delete it instead
+        auto removed = starting_node;
+        if(starting_node->left && starting_node->right){
+            removed = starting_node->right.get();
+            while(removed->left){                           
+                removed = removed->left.get();
+            }
+            starting_node->_pair = std::move(removed->_pair);
         }
+
+        // THE NODE IS A LEAF OR HAS JUST ONE CHILD:
+        // the (possibly empty) child is attached to the parent of the node
+        auto parent = removed->parent;
+        if(removed == tail){                                    // the right most node has no right child
+            tail = removed->left ? _predecessor(removed) : parent;
+        }
+        auto& link = _owner(head, removed);                     // the pointer that owns the node
+        typename node::link old{std::move(link)};
+        link = std::move(old->left ? old->left : old->right);
+        if(link){link->parent = parent;}
+
+        --items;
+        if(counted){                                            // one less node in the subtrees of the ancestors
+            for(auto p = parent; p; p = p->parent){_set_subtree_size(p, _subtree_size(p) - 1);}
+        }
+        _summarize_up(parent);                                  // starting_node is among them, with a new pair
+
+        auto meta = old->meta;
+        pool.destroy(old.release());                            // the node has no children anymore
+
+        // restructure the tree, if the policy requires it
+        BAL::after_erase(head, link.get(), parent, meta);
+        _shrunk(parent, link.get());
     }
 
+public:
+
     /**
      * @brief Overload of operator put to 
      */
@@ -484,6 +2106,7 @@ public:
     std::ostream& operator<<(std::ostream& os, const bst& x){
         if(x._is_empty()){os << "WARNING: empty tree"; return os;}
 
+        auto reader = x.adjust.enter();
         for(auto& key : x){
             os << key << " ";
         }
@@ -501,15 +2124,11 @@ public:
      * @return reference to the value of the key
      */
     v_t& operator[](const k_t& x) {
-        if(find(x) != iterator{nullptr}){   // if the key is already present
-            auto address = find(x);         // we return the associated value
-            return address.value();
-        }
+        // if the key is already present we return the associated value,
         // otherwise we insert a new node with the
         // requested key and the default value of v_t
-        auto def_value = v_t{};
-        auto new_node = emplace(x,def_value);
-        return new_node.first.value();
+        static_assert(!summarized, "the values of an augmented tree change only through insert_or_assign");
+        return try_emplace(x).first.value();
     }
     
 
@@ -522,16 +2141,22 @@ public:
      * @return reference to the value of the key
      */
     v_t& operator[](k_t&& x) {
-        auto tmp{std::move(x)};
-        if(find(tmp) != iterator{nullptr}){   // if the key is already present
-            auto address = find(tmp);         // we return the associated value
-            return address.value();
-        }
-        // otherwise we insert a new node with the
-        // requested key and the default value of v_t
-        auto def_value = v_t{};
-        auto new_node = emplace(tmp,def_value);
-        return new_node.first.value();
+        static_assert(!summarized, "the values of an augmented tree change only through insert_or_assign");
+        return try_emplace(std::move(x)).first.value();
+    }
+
+    /**
+     * Overload of subscripting operator for any value comparable with the keys
+     * and convertible to a key, e.g. a const char* in a tree of std::string:
+     * the key is constructed only if it is inserted. Only if OP is transparent
+     * 
+     * @param x value equivalent to the key
+     * @return reference to the value of the key
+     */
+    template <typename K, typename O = OP, typename = typename O::is_transparent>
+    v_t& operator[](K&& x) {
+        static_assert(!summarized, "the values of an augmented tree change only through insert_or_assign");
+        return try_emplace(std::forward<K>(x)).first.value();
     }
 
 };
@@ -0,0 +1,772 @@
+#ifndef _BITS_BST_BALANCE_
+#define _BITS_BST_BALANCE_
+
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <thread>
+#include <type_traits>
+#include <utility>
+
+#include "bits_bst_node.hpp"
+
+/**
+ * Header with the balancing policies of the bst.
+ * A policy is a struct with static hooks that the bst invokes
+ * after every structural change:
+ * - after_insert: a new node x has just been attached as a leaf
+ * - after_erase: a node with at most one child has just been unlinked;
+ *   x is the child that took its place (possibly nullptr), parent is
+ *   the parent of x and meta is the balancing information of the removed node
+ * - rebuild: the whole tree has been rebuilt from scratch (see bst::balance)
+ * - join_point: two trees l and r are about to be joined with a node k
+ *   whose key lies between theirs (see bst::merge); it returns the node
+ *   of the taller tree under which k must hang, on the right spine of l
+ *   (right = true) or on the left spine of r, nullptr if k is the new root
+ * - after_join: k has been linked as told by join_point, with the
+ *   subtree it replaced and the shorter tree as children
+ * - after_find: a lookup has found the node x (see splay). The bst
+ *   invokes it only for the policies that derive from _self_adjusting,
+ *   once every `every` hits, and only while no other reader is in the
+ *   tree (see _adjust_state)
+ *
+ * The policies restructure the tree only by means of rotations,
+ * so the parent links of the nodes, their sizes and their summaries
+ * (see augmented) are always kept consistent.
+ * The balancing information is stored in the member meta of the node.
+ */
+
+
+/**
+ * @brief Retrieve the unique pointer that owns a node
+ *
+ * @param head the root of the tree
+ * @param x pointer to the node
+ * @return reference to either head or the left/right pointer of the parent of x
+ */
+template <typename node>
+typename node::link& _owner(typename node::link& head, node* x) noexcept {
+    if(!x->parent){return head;}
+    return x->parent->left.get() == x ? x->parent->left : x->parent->right;
+}
+
+/**
+ * @return number of nodes in the subtree rooted in x (0 if x is nullptr)
+ */
+inline std::size_t _subtree_size(const _subtree_count<true>* x) noexcept {return x ? x->size : 0;}
+
+/**
+ * @brief Nodes that do not count their subtrees have nothing to report:
+ * only the trees augmented with order_statistic may ask
+ */
+inline std::size_t _subtree_size(const _subtree_count<false>*) noexcept {return 0;}
+
+/**
+ * @brief Set the number of nodes in the subtree rooted in x
+ */
+inline void _set_subtree_size(_subtree_count<true>* x, std::size_t n) noexcept {x->size = n;}
+
+inline void _set_subtree_size(_subtree_count<false>*, std::size_t) noexcept {}
+
+/**
+ * @brief Compute the size of the subtree of x from the ones of its children
+ */
+template <typename node>
+void _recount(node* x) noexcept {
+    _set_subtree_size(x, 1 + _subtree_size(x->left.get()) + _subtree_size(x->right.get()));
+}
+
+/**
+ * @brief Nodes without a monoid have no summary to compute
+ */
+template <typename k_t, typename v_t, bool Counted>
+void _summarize(_node<k_t,v_t,void,Counted>*) noexcept {}
+
+/**
+ * @brief Compute the summary of x from its pair and the summaries of its children
+ */
+template <typename k_t, typename v_t, typename M, bool Counted>
+void _summarize(_node<k_t,v_t,M,Counted>* x) noexcept {
+    auto s = M::of(x->_pair.first, x->_pair.second);
+    if(x->left){s = M::combine(x->left->summary, s);}
+    if(x->right){s = M::combine(s, x->right->summary);}
+    x->summary = s;
+}
+
+/**
+ * @brief Left rotation around x. The right child of x takes its place.
+ *
+ *       x              y
+ *      / \            / \
+ *     a   y    ->    x   c
+ *        / \        / \
+ *       b   c      a   b
+ *
+ * @param head the root of the tree
+ * @param x pointer to the node to rotate, it must have a right child
+ */
+template <typename node>
+void _rotate_left(typename node::link& head, node* x) noexcept {
+    auto& link = _owner(head, x);               // the pointer that owns x
+    typename node::link y{std::move(x->right)};
+
+    x->right = std::move(y->left);              // b becomes the right child of x
+    if(x->right){x->right->parent = x;}
+
+    y->parent = x->parent;
+    y->left = std::move(link);                  // x becomes the left child of y
+    x->parent = y.get();
+
+    _recount(x);                                // x is now a child of y
+    _recount(y.get());
+    _summarize(x);
+    _summarize(y.get());
+    link = std::move(y);                        // y takes the place of x
+}
+
+/**
+ * @brief Right rotation around x. The left child of x takes its place.
+ *
+ *         x          y
+ *        / \        / \
+ *       y   c  ->  a   x
+ *      / \            / \
+ *     a   b          b   c
+ *
+ * @param head the root of the tree
+ * @param x pointer to the node to rotate, it must have a left child
+ */
+template <typename node>
+void _rotate_right(typename node::link& head, node* x) noexcept {
+    auto& link = _owner(head, x);
+    typename node::link y{std::move(x->left)};
+
+    x->left = std::move(y->right);
+    if(x->left){x->left->parent = x;}
+
+    y->parent = x->parent;
+    y->right = std::move(link);
+    x->parent = y.get();
+
+    _recount(x);
+    _recount(y.get());
+    _summarize(x);
+    _summarize(y.get());
+    link = std::move(y);
+}
+
+
+/**
+ * @brief Default policy: the tree is never restructured,
+ * it can be balanced on demand with bst::balance
+ */
+struct unbalanced{
+
+    template <typename node>
+    static void after_insert(typename node::link&, node*) noexcept {}
+
+    template <typename node>
+    static void after_erase(typename node::link&, node*, node*, int) noexcept {}
+
+    template <typename node>
+    static void rebuild(node*) noexcept {}
+
+    template <typename node>
+    static node* join_point(node*, node*, bool&) noexcept {return nullptr;}
+
+    template <typename node>
+    static void after_join(typename node::link&, node*) noexcept {}
+
+    template <typename node>
+    static void make_root(node*) noexcept {}
+
+    template <typename node>
+    static void after_find(typename node::link&, node*) noexcept {}
+};
+
+
+/**
+ * @brief Red-black tree policy.
+ * meta stores the color of the node; nullptr children are black.
+ * The height of the tree is at most 2*log2(n+1).
+ */
+struct red_black{
+
+    static constexpr int red = 0;
+    static constexpr int black = 1;
+
+    template <typename node>
+    static bool is_red(const node* x) noexcept {return x && x->meta == red;}
+
+    template <typename node>
+    static bool is_black(const node* x) noexcept {return !is_red(x);}
+
+    /**
+     * @brief The new node is colored red, then the red-red violations
+     * are moved up the tree by recoloring or fixed by at most two rotations
+     */
+    template <typename node>
+    static void after_insert(typename node::link& head, node* x) noexcept {
+        x->meta = red;
+
+        while(is_red(x->parent)){
+            auto parent = x->parent;
+            auto grand = parent->parent;                        // exists since the root is black
+
+            if(parent == grand->left.get()){
+                auto uncle = grand->right.get();
+                if(is_red(uncle)){                              // recolor and move up
+                    parent->meta = black;
+                    uncle->meta = black;
+                    grand->meta = red;
+                    x = grand;
+                }
+                else{
+                    if(x == parent->right.get()){               // bring x on the outside
+                        _rotate_left(head, parent);
+                        x = parent;
+                        parent = x->parent;
+                    }
+                    parent->meta = black;
+                    grand->meta = red;
+                    _rotate_right(head, grand);
+                }
+            }
+            else{                                               // mirror case
+                auto uncle = grand->left.get();
+                if(is_red(uncle)){
+                    parent->meta = black;
+                    uncle->meta = black;
+                    grand->meta = red;
+                    x = grand;
+                }
+                else{
+                    if(x == parent->left.get()){
+                        _rotate_right(head, parent);
+                        x = parent;
+                        parent = x->parent;
+                    }
+                    parent->meta = black;
+                    grand->meta = red;
+                    _rotate_left(head, grand);
+                }
+            }
+        }
+        head->meta = black;
+    }
+
+    /**
+     * @brief Removing a black node leaves the path through x one black node short.
+     * The missing black is pushed up the tree (recoloring the sibling) until it
+     * can be absorbed by a red node or fixed by at most three rotations
+     */
+    template <typename node>
+    static void after_erase(typename node::link& head, node* x, node* parent, int meta) noexcept {
+        if(meta == red){return;}                                // no black height changed
+
+        while(x != head.get() && is_black(x)){
+            if(x == parent->left.get()){
+                auto sibling = parent->right.get();             // exists since x is one black short
+                if(is_red(sibling)){
+                    sibling->meta = black;
+                    parent->meta = red;
+                    _rotate_left(head, parent);
+                    sibling = parent->right.get();
+                }
+                if(is_black(sibling->left.get()) && is_black(sibling->right.get())){
+                    sibling->meta = red;
+                    x = parent;
+                    parent = x->parent;
+                }
+                else{
+                    if(is_black(sibling->right.get())){
+                        sibling->left->meta = black;
+                        sibling->meta = red;
+                        _rotate_right(head, sibling);
+                        sibling = parent->right.get();
+                    }
+                    sibling->meta = parent->meta;
+                    parent->meta = black;
+                    sibling->right->meta = black;
+                    _rotate_left(head, parent);
+                    x = head.get();
+                }
+            }
+            else{                                               // mirror case
+                auto sibling = parent->left.get();
+                if(is_red(sibling)){
+                    sibling->meta = black;
+                    parent->meta = red;
+                    _rotate_right(head, parent);
+                    sibling = parent->left.get();
+                }
+                if(is_black(sibling->left.get()) && is_black(sibling->right.get())){
+                    sibling->meta = red;
+                    x = parent;
+                    parent = x->parent;
+                }
+                else{
+                    if(is_black(sibling->left.get())){
+                        sibling->right->meta = black;
+                        sibling->meta = red;
+                        _rotate_left(head, sibling);
+                        sibling = parent->left.get();
+                    }
+                    sibling->meta = parent->meta;
+                    parent->meta = black;
+                    sibling->left->meta = black;
+                    _rotate_right(head, parent);
+                    x = head.get();
+                }
+            }
+        }
+        if(x){x->meta = black;}
+    }
+
+    /**
+     * @brief Color a perfectly balanced tree: the nodes on the last,
+     * incomplete level are red, all the others are black
+     */
+    template <typename node>
+    static void rebuild(node* root) noexcept {
+        if(!root){return;}
+        color(root, 0, shortest(root));
+    }
+
+    /**
+     * @brief The roots are made black, then the spine of the tree with the
+     * greater black height is walked down to the first black node with the
+     * black height of the other tree
+     */
+    template <typename node>
+    static node* join_point(node* l, node* r, bool& right) noexcept {
+        if(l){l->meta = black;}
+        if(r){r->meta = black;}
+        auto hl = black_height(l);
+        auto hr = black_height(r);
+        right = hl >= hr;
+
+        auto x = right ? l : r;
+        auto h = right ? hl : hr;
+        auto target = right ? hr : hl;
+        node* p = nullptr;
+        while(x && (h > target || is_red(x))){
+            if(is_black(x)){--h;}
+            p = x;
+            x = right ? x->right.get() : x->left.get();
+        }
+        return p;
+    }
+
+    /**
+     * @brief k is colored red and fixed up as a new leaf
+     */
+    template <typename node>
+    static void after_join(typename node::link& head, node* k) noexcept {after_insert(head, k);}
+
+    /**
+     * @brief A subtree cut out by split becomes a tree: its root, which may
+     * be red, is made black; the black heights do not change below it
+     */
+    template <typename node>
+    static void make_root(node* x) noexcept {
+        if(x){x->meta = black;}
+    }
+
+    template <typename node>
+    static void after_find(typename node::link&, node*) noexcept {}
+
+private:
+
+    template <typename node>
+    static int black_height(const node* x) noexcept {
+        int h = 0;
+        for(; x; x = x->left.get()){h += is_black(x);}
+        return h;
+    }
+
+    template <typename node>
+    static int shortest(const node* x) noexcept {
+        if(!x){return 0;}
+        auto l = shortest(x->left.get());
+        auto r = shortest(x->right.get());
+        return 1 + (l < r ? l : r);
+    }
+
+    template <typename node>
+    static void color(node* x, int depth, int black_levels) noexcept {
+        if(!x){return;}
+        x->meta = depth < black_levels ? black : red;
+        color(x->left.get(), depth + 1, black_levels);
+        color(x->right.get(), depth + 1, black_levels);
+    }
+};
+
+
+/**
+ * @brief AVL tree policy.
+ * meta stores the height of the subtree rooted in the node (a leaf has height 1).
+ * The heights of the two subtrees of every node differ at most by one,
+ * so the height of the tree is at most 1.44*log2(n+2).
+ */
+struct avl{
+
+    template <typename node>
+    static int height(const node* x) noexcept {return x ? x->meta : 0;}
+
+    template <typename node>
+    static void after_insert(typename node::link& head, node* x) noexcept {
+        x->meta = 1;
+        retrace(head, x->parent);
+    }
+
+    template <typename node>
+    static void after_erase(typename node::link& head, node*, node* parent, int) noexcept {
+        retrace(head, parent);
+    }
+
+    /**
+     * @brief Recompute all the heights bottom-up
+     */
+    template <typename node>
+    static void rebuild(node* root) noexcept {
+        if(!root){return;}
+        rebuild(root->left.get());
+        rebuild(root->right.get());
+        update(root);
+    }
+
+    /**
+     * @brief The spine of the taller tree is walked down to the first
+     * subtree at most one level taller than the other tree
+     */
+    template <typename node>
+    static node* join_point(node* l, node* r, bool& right) noexcept {
+        auto hl = height(l);
+        auto hr = height(r);
+        right = hl >= hr;
+
+        auto x = right ? l : r;
+        auto target = (right ? hr : hl) + 1;
+        node* p = nullptr;
+        while(height(x) > target){
+            p = x;
+            x = right ? x->right.get() : x->left.get();
+        }
+        return p;
+    }
+
+    /**
+     * @brief The subtree of k grew by one level at most, as after an insertion
+     */
+    template <typename node>
+    static void after_join(typename node::link& head, node* k) noexcept {retrace(head, k);}
+
+    template <typename node>
+    static void make_root(node*) noexcept {}
+
+    template <typename node>
+    static void after_find(typename node::link&, node*) noexcept {}
+
+private:
+
+    template <typename node>
+    static void update(node* x) noexcept {
+        auto l = height(x->left.get());
+        auto r = height(x->right.get());
+        x->meta = 1 + (l > r ? l : r);
+    }
+
+    /**
+     * @brief Walk from x up to the root updating the heights
+     * and rotating wherever the subtrees differ by two
+     */
+    template <typename node>
+    static void retrace(typename node::link& head, node* x) noexcept {
+        while(x){
+            auto factor = height(x->left.get()) - height(x->right.get());
+
+            if(factor > 1){                                     // left heavy
+                auto l = x->left.get();
+                if(height(l->left.get()) < height(l->right.get())){
+                    _rotate_left(head, l);                      // left-right case
+                    update(l);
+                }
+                _rotate_right(head, x);
+            }
+            else if(factor < -1){                               // right heavy
+                auto r = x->right.get();
+                if(height(r->right.get()) < height(r->left.get())){
+                    _rotate_right(head, r);                     // right-left case
+                    update(r);
+                }
+                _rotate_left(head, x);
+            }
+
+            update(x);
+            if(x->parent && (factor > 1 || factor < -1)){       // x has been moved down
+                x = x->parent;
+                update(x);
+            }
+            x = x->parent;
+        }
+    }
+};
+
+
+/**
+ * @brief Base of the policies that restructure the tree on lookups too
+ */
+struct _self_adjusting{};
+
+/**
+ * @brief Splay tree policy (Sleator and Tarjan): the nodes that are inserted
+ * or found are moved to the root with zig-zig and zig-zag rotations, so that
+ * the keys looked up most often stay near the root and every sequence of
+ * operations costs O(log n) amortized per operation. There is no bound on
+ * the height, which is why the policy derives from unbalanced.
+ * A splay costs about as much as the lookup it follows: with Every > 1 only
+ * one hit every Every (counted per tree) moves its node, which is then
+ * cheaper and still brings the hot keys up, at a slower pace.
+ * meta is not used.
+ * The lookups change the tree, yet they may run concurrently as on any
+ * bst: they are readers of the gate of the tree (see _adjust_state), and
+ * a hit is moved only if its lookup is the only reader at that moment.
+ *
+ * @tparam Every number of hits per splay
+ */
+template <unsigned Every = 1>
+struct splay: unbalanced, _self_adjusting{
+
+    static_assert(Every > 0, "splay: Every must be positive");
+
+    static constexpr unsigned every = Every;
+
+    template <typename node>
+    static void after_insert(typename node::link& head, node* x) noexcept {to_root(head, x);}
+
+    template <typename node>
+    static void after_find(typename node::link& head, node* x) noexcept {to_root(head, x);}
+
+    /**
+     * @brief Move x to the root: a zig-zig rotates the grandparent first,
+     * a zig-zag the parent, a zig (x is a child of the root) only the parent
+     */
+    template <typename node>
+    static void to_root(typename node::link& head, node* x) noexcept {
+        while(auto p = x->parent){
+            auto g = p->parent;
+            bool left = p->left.get() == x;
+            if(!g){                                             // zig
+                if(left){_rotate_right(head, p);}
+                else{_rotate_left(head, p);}
+            }
+            else if(left == (g->left.get() == p)){              // zig-zig
+                if(left){_rotate_right(head, g); _rotate_right(head, p);}
+                else{_rotate_left(head, g); _rotate_left(head, p);}
+            }
+            else{                                               // zig-zag
+                if(left){_rotate_right(head, p); _rotate_left(head, g);}
+                else{_rotate_left(head, p); _rotate_right(head, g);}
+            }
+        }
+    }
+};
+
+/**
+ * @brief Trait to detect the policies that restructure the tree on lookups,
+ * possibly augmented with order_statistic
+ */
+template <typename BAL>
+struct _is_self_adjusting: std::is_base_of<_self_adjusting, BAL>{};
+
+/**
+ * @brief State kept by a bst for the lookups of its policy: none if the
+ * policy does not change the tree on lookups, so there is nothing to
+ * synchronize and the readers cost nothing
+ */
+template <typename BAL, bool = _is_self_adjusting<BAL>::value>
+class _adjust_state{
+public:
+    struct reader{
+        ~reader() noexcept {}                   // a guard, even if it guards nothing
+    };
+
+    reader enter() const noexcept {return reader{};}
+
+    template <typename node>
+    void found(typename node::link&, node*, reader&) const noexcept {}
+};
+
+/**
+ * @brief State kept by a self-adjusting bst for its lookups: a gate that
+ * counts the readers in the tree, and the number of hits.
+ * Every const member function that walks the tree is a reader, so they
+ * may all run concurrently as on any bst. One hit every BAL::every asks to
+ * restructure the tree: its lookup does so only if it is the only reader,
+ * and keeps the others out until it is done; otherwise the move is skipped,
+ * the tree adapts a bit later, but no lookup ever waits for another one to
+ * finish walking. The iterators are not readers: iterating a tree while
+ * other threads look keys up needs an external lock, as for the writers.
+ * A copy of the state is a new state
+ */
+template <typename BAL>
+class _adjust_state<BAL, true>{
+    mutable std::atomic<int> readers{0};        // -1 while a lookup restructures the tree
+    mutable std::atomic<unsigned> hits{0};
+
+public:
+    _adjust_state() noexcept = default;
+    _adjust_state(const _adjust_state&) noexcept {}
+    _adjust_state& operator=(const _adjust_state&) noexcept {return *this;}
+
+    /**
+     * @brief A reader in the tree: it leaves the gate when it is destroyed
+     */
+    class reader{
+        std::atomic<int>* readers;
+        bool exclusive{false};
+
+    public:
+        explicit reader(std::atomic<int>& r) noexcept: readers{&r} {}
+        reader(reader&& x) noexcept: readers{x.readers}, exclusive{x.exclusive} {x.readers = nullptr;}
+        reader(const reader&) = delete;
+        reader& operator=(const reader&) = delete;
+
+        ~reader() noexcept {
+            if(!readers){return;}
+            if(exclusive){readers->store(0, std::memory_order_release);}
+            else{readers->fetch_sub(1, std::memory_order_release);}
+        }
+
+        /**
+         * @return true if this is the only reader, which then keeps the
+         * others out until it is destroyed
+         */
+        bool alone() noexcept {
+            int one = 1;
+            exclusive = exclusive || readers->compare_exchange_strong(one, -1, std::memory_order_acquire);
+            return exclusive;
+        }
+    };
+
+    /**
+     * @brief Enter the gate, waiting while a lookup restructures the tree
+     */
+    reader enter() const noexcept {
+        auto r = readers.load(std::memory_order_relaxed);
+        while(r < 0 || !readers.compare_exchange_weak(r, r + 1, std::memory_order_acquire, std::memory_order_relaxed)){
+            if(r < 0){
+                std::this_thread::yield();
+                r = readers.load(std::memory_order_relaxed);
+            }
+        }
+        return reader{readers};
+    }
+
+    /**
+     * @brief A lookup of the reader r has found x: one hit every BAL::every
+     * restructures the tree, if r is alone in it
+     */
+    template <typename node>
+    void found(typename node::link& head, node* x, reader& r) const noexcept {
+        if((hits.fetch_add(1, std::memory_order_relaxed) + 1) % BAL::every != 0){return;}
+        if(r.alone()){BAL::after_find(head, x);}
+    }
+};
+
+
+/**
+ * @brief Order statistic augmentation of a balancing policy: the nodes
+ * store the size of their subtree (see _subtree_count), which the bst
+ * keeps up to date at the cost of a walk up to the root on every
+ * insertion and erasure, and provides
+ * rank, select and count_range in O(height)
+ *
+ * @tparam BAL the balancing policy to augment
+ */
+template <typename BAL = unbalanced>
+struct order_statistic: BAL{};
+
+/**
+ * @brief Trait to detect the order statistic augmentation
+ */
+template <typename BAL>
+struct _is_order_statistic: std::false_type{};
+
+template <typename BAL>
+struct _is_order_statistic<order_statistic<BAL>>: std::true_type{};
+
+/**
+ * @brief Monoid augmentation of a balancing policy: every node stores the
+ * summary of the pairs of its subtree, i.e. the combination of M::of of
+ * each pair in order of key, kept up to date by the insertions, the
+ * erasures and the rotations, so that bst::aggregate(a, b) combines the
+ * pairs with keys in [a, b] in O(height). M provides
+ * - type: the summary, default constructible and copyable
+ * - identity(): the summary of no pairs
+ * - of(key, value): the summary of a single pair
+ * - combine(a, b): the summary of the pairs of a followed by those of b;
+ *   it must be associative, but need not be commutative
+ * and none of them may throw. See sum_of, min_of and max_of.
+ * To use it with order_statistic, the latter goes outside:
+ * order_statistic<augmented<M, BAL>>
+ *
+ * @tparam M the monoid
+ * @tparam BAL the balancing policy to augment
+ */
+template <typename M, typename BAL = unbalanced>
+struct augmented: BAL{
+    using monoid = M;
+};
+
+/**
+ * @brief The monoid of a policy, void if it is not augmented
+ */
+template <typename BAL, typename = void>
+struct _monoid_of{
+    using type = void;
+};
+
+template <typename BAL>
+struct _monoid_of<BAL, typename std::conditional<true, void, typename BAL::monoid>::type>{
+    using type = typename BAL::monoid;
+};
+
+/**
+ * @brief Sum of the values
+ */
+template <typename T>
+struct sum_of{
+    using type = T;
+    static T identity() noexcept {return T{};}
+    template <typename K>
+    static T of(const K&, const T& value) noexcept {return value;}
+    static T combine(const T& a, const T& b) noexcept {return a + b;}
+};
+
+/**
+ * @brief Smallest value, std::numeric_limits<T>::max() if there are none
+ */
+template <typename T>
+struct min_of{
+    using type = T;
+    static T identity() noexcept {return std::numeric_limits<T>::max();}
+    template <typename K>
+    static T of(const K&, const T& value) noexcept {return value;}
+    static T combine(const T& a, const T& b) noexcept {return b < a ? b : a;}
+};
+
+/**
+ * @brief Biggest value, std::numeric_limits<T>::lowest() if there are none
+ */
+template <typename T>
+struct max_of{
+    using type = T;
+    static T identity() noexcept {return std::numeric_limits<T>::lowest();}
+    template <typename K>
+    static T of(const K&, const T& value) noexcept {return value;}
+    static T combine(const T& a, const T& b) noexcept {return a < b ? b : a;}
+};
+
+#endif
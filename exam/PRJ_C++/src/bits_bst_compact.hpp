@@ -0,0 +1,1079 @@
+#ifndef _BITS_BST_COMPACT_
+#define _BITS_BST_COMPACT_
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "bits_bst.hpp"
+#include "bits_bst_node.hpp"
+#include "bits_bst_frozen.hpp"
+#include "bits_bst_snapshot.hpp"
+
+/**
+ * Header for the compact engine of the bst.
+ * Passing compact as balancing policy selects a partial specialization
+ * of the bst with the same public interface as the B+ tree engine, whose
+ * nodes live in a single vector and refer to each other by 32-bit index
+ * instead of by pointer:
+ * - a node holds the pair, the indices of its children and the index of
+ *   its parent, whose top bit is the color of the node: 12 bytes of links
+ *   instead of the 32 of the nodes of the bst (two unique pointers, the
+ *   parent, meta and size), e.g. 20 bytes per entry for bst<int,int>
+ * - the slot 0 of the vector is the null node, black and without a pair
+ * - the erased nodes are kept in a free list, threaded through their left
+ *   index, and reused by the next insertions
+ * - the tree is a red-black tree
+ * An iterator holds the index of its node, not its address, so that it
+ * stays valid when the vector grows: as with the bst, only erasing its
+ * own pair invalidates it. At most 2^31 - 2 pairs fit in a tree.
+ */
+struct compact{};
+
+
+/**
+ * @brief Node of the compact engine. The pair is constructed in place
+ * only while the node is in the tree: the vacant nodes (the null node
+ * and the ones in the free list) have none
+ *
+ * @tparam k_t template for the key type
+ * @tparam v_t template for the value type
+ */
+template <typename k_t, typename v_t>
+struct _compact_node{
+    using index = std::uint32_t;
+
+    static constexpr index red_bit = index{1} << 31;
+    static constexpr index vacant = red_bit - 1;            // the parent of a vacant node, black
+
+    index left{0};
+    index right{0};
+    index up{vacant};                                       // parent, and the color in the top bit
+
+    union{
+        std::pair<k_t,v_t> _pair;
+    };
+
+    /**
+     * @brief Default ctor, a vacant node
+     */
+    _compact_node() noexcept {}
+
+    /**
+     * @brief Custom ctor, the pair is constructed in place from args;
+     * the node is red, with no parent yet
+     */
+    template <typename... Types>
+    explicit _compact_node(_in_place_t, Types&&... args): up{red_bit} {
+        ::new(static_cast<void*>(&_pair)) std::pair<k_t,v_t>(std::forward<Types>(args)...);
+    }
+
+    /**
+     * @brief Copy ctor, the links are copied as they are
+     */
+    _compact_node(const _compact_node& x): left{x.left}, right{x.right}, up{x.up} {
+        if(x.live()){::new(static_cast<void*>(&_pair)) std::pair<k_t,v_t>(x._pair);}
+    }
+
+    /**
+     * @brief Move ctor, used by the vector when it grows
+     */
+    _compact_node(_compact_node&& x) noexcept(std::is_nothrow_move_constructible<std::pair<k_t,v_t>>::value):
+        left{x.left}, right{x.right}, up{x.up} {
+        if(x.live()){::new(static_cast<void*>(&_pair)) std::pair<k_t,v_t>(std::move(x._pair));}
+    }
+
+    _compact_node& operator=(const _compact_node&) = delete;
+    _compact_node& operator=(_compact_node&&) = delete;
+
+    ~_compact_node() noexcept {vacate();}
+
+    bool live() const noexcept {return up != vacant;}
+
+    /**
+     * @brief Destroy the pair, if any, and mark the node vacant
+     */
+    void vacate() noexcept {
+        if(live()){_pair.~pair();}
+        up = vacant;
+    }
+
+    index parent() const noexcept {return up & ~red_bit;}
+    void parent(index p) noexcept {up = (up & red_bit) | p;}
+    bool red() const noexcept {return up & red_bit;}
+    void red(bool r) noexcept {up = r ? up | red_bit : up & ~red_bit;}
+};
+
+
+/**
+ * Header for class compact iterator.
+ * It contains a pointer to the vector of the nodes, the index of the
+ * node and a pointer to the index of the right most node (owned by the
+ * bst), so that end() (index 0) can be decremented.
+ *
+ * @tparam O template for the iterator
+ * @tparam v_t template for the value type of the node
+ * @tparam S template for the vector of the nodes
+ */
+template <typename O, typename v_t, typename S>
+class _compact_iterator{
+
+    using index = std::uint32_t;
+
+    S* nodes;
+    index at;
+    const index* last;
+
+    template <typename, typename, typename> friend class _compact_iterator;
+
+public:
+    using value_type = O;
+    using difference_type = std::ptrdiff_t;
+    using iterator_category = std::bidirectional_iterator_tag;
+    using reference = value_type&;
+    using pointer = value_type*;
+
+    /**
+     * @brief Default ctor
+     *
+     */
+    _compact_iterator() noexcept = default;
+
+    /**
+     * @brief Custom ctor
+     *
+     * @param s the vector of the nodes of the bst
+     * @param i index of the node, 0 for end()
+     * @param right_most pointer to the index of the right most node of the bst
+     */
+    _compact_iterator(S* s, index i, const index* right_most) noexcept: nodes{s}, at{i}, last{right_most} {}
+
+    /**
+     * @brief Conversion from iterator to const_iterator
+     *
+     * @param x an iterator on non-const keys
+     */
+    template <typename P, typename = typename std::enable_if<std::is_same<O, const P>::value>::type>
+    _compact_iterator(const _compact_iterator<P,v_t,S>& x) noexcept: nodes{x.nodes}, at{x.at}, last{x.last} {}
+
+    /**
+     * @brief Overloading of the preincrement operator:
+     * left most node of the right subtree, or the first ancestor
+     * we reach from a left child
+     */
+    _compact_iterator& operator++() noexcept {
+        auto& n = *nodes;
+        if(n[at].right){
+            at = n[at].right;
+            while(n[at].left){at = n[at].left;}
+            return *this;
+        }
+        auto p = n[at].parent();
+        while(p && n[p].right == at){
+            at = p;
+            p = n[p].parent();
+        }
+        at = p;
+        return *this;
+    }
+
+    /**
+     * @brief Overloading of post increment operator
+     */
+    _compact_iterator operator++(int) noexcept {
+        auto tmp{*this};
+        ++(*this);
+        return tmp;
+    }
+
+    /**
+     * @brief Overloading of the predecrement operator, symmetric to the
+     * preincrement. Decrementing end() gives the right most node
+     */
+    _compact_iterator& operator--() noexcept {
+        auto& n = *nodes;
+        if(!at){
+            at = *last;
+            return *this;
+        }
+        if(n[at].left){
+            at = n[at].left;
+            while(n[at].right){at = n[at].right;}
+            return *this;
+        }
+        auto p = n[at].parent();
+        while(p && n[p].left == at){
+            at = p;
+            p = n[p].parent();
+        }
+        at = p;
+        return *this;
+    }
+
+    /**
+     * @brief Overloading of post decrement operator
+     */
+    _compact_iterator operator--(int) noexcept {
+        auto tmp{*this};
+        --(*this);
+        return tmp;
+    }
+
+    /**
+     * @return the key the iterator points to
+     */
+    reference operator*() const noexcept {return (*nodes)[at]._pair.first;}
+
+    /**
+     * @return a pointer to the key the iterator points to
+     */
+    pointer operator->() const noexcept {return &**this;}
+
+    /**
+     * @return a reference to the value of the pointed key
+     */
+    v_t& value() {return (*nodes)[at]._pair.second;}
+
+    /**
+     * @return a const reference to the value of the pointed key
+     */
+    const v_t& value() const {return (*nodes)[at]._pair.second;}
+
+    /**
+     * @return the index of the current node
+     */
+    index where() const noexcept {return at;}
+
+    friend
+    bool operator==(const _compact_iterator& a, const _compact_iterator& b) noexcept {return a.at == b.at;}
+
+    friend
+    bool operator!=(const _compact_iterator& a, const _compact_iterator& b) noexcept {return !(a == b);}
+};
+
+
+template <typename k_t, typename v_t, typename OP, typename Alloc>
+class bst<k_t,v_t,OP,compact,Alloc>{
+
+    using node = _compact_node<k_t,v_t>;
+    using index = typename node::index;
+    using storage = std::vector<node, typename std::allocator_traits<Alloc>::template rebind_alloc<node>>;
+
+public:
+    using iterator = _compact_iterator<k_t,v_t,storage>;
+    using const_iterator = _compact_iterator<const k_t,v_t,storage>;
+    using reverse_iterator = _reverse_iterator<iterator>;
+    using const_reverse_iterator = _reverse_iterator<const_iterator>;
+
+private:
+
+    /**
+     * @brief Largest number of nodes, the null one included
+     */
+    static constexpr std::size_t max_nodes = node::vacant;
+
+    /**
+     * @brief Private variables.
+     * The vector always holds the null node once something has been inserted
+     */
+    storage nodes;
+    index root{0};
+    index tail{0};                      // the right most node, for end() and the insertions at the end
+    index free_list{0};                 // the first vacant node that can be reused, 0 if none
+    std::size_t items{0};               // number of pairs, for size()
+    OP cmp;
+
+    node& _at(index i) noexcept {return nodes[i];}
+    const node& _at(index i) const noexcept {return nodes[i];}
+    bool _red(index i) const noexcept {return i && nodes[i].red();}
+
+    iterator _iter(index i) noexcept {return iterator{&nodes, i, &tail};}
+    const_iterator _iter(index i) const noexcept {return const_iterator{const_cast<storage*>(&nodes), i, &tail};}
+
+    /**
+     * This private function looks for a key with a single
+     * top to bottom traversal of the bst.
+     * The bool is true if the key is present, and the index is the one of the node with such key;
+     * otherwise the index is the one of the node the key should be attached to (0 if the tree is empty)
+     */
+    std::pair<index, bool> _locate(const k_t& x) const {
+        index tmp = root;
+        index parent = 0;
+        while(tmp){
+            auto& n = nodes[tmp];
+            parent = tmp;
+            if(cmp(x, n._pair.first)){tmp = n.left;}
+            else if(cmp(n._pair.first, x)){tmp = n.right;}
+            else{return std::pair<index, bool>{tmp, true};}
+        }
+        return std::pair<index, bool>{parent, false};
+    }
+
+    /**
+     * @brief The first node whose key is not smaller than x (if strict is false)
+     * or is bigger than x (if strict is true), 0 if there is none
+     */
+    index _bound(const k_t& x, bool strict) const {
+        index tmp = root;
+        index candidate = 0;
+        while(tmp){
+            auto& n = nodes[tmp];
+            if(strict ? cmp(x, n._pair.first) : !cmp(n._pair.first, x)){
+                candidate = tmp;
+                tmp = n.left;
+            }
+            else{tmp = n.right;}
+        }
+        return candidate;
+    }
+
+    index _left_most() const noexcept {
+        index tmp = root;
+        while(tmp && nodes[tmp].left){tmp = nodes[tmp].left;}
+        return tmp;
+    }
+
+    /**
+     * @brief Construct a pair in a vacant node, reused from the free list
+     * if there is one, otherwise appended to the vector
+     *
+     * @return the index of the node, red and detached
+     */
+    template <typename... Types>
+    index _create(Types&&... args){
+        if(free_list){
+            auto i = free_list;
+            auto& n = nodes[i];
+            ::new(static_cast<void*>(&n._pair)) std::pair<k_t,v_t>(std::forward<Types>(args)...);
+            free_list = n.left;
+            n.left = 0;
+            n.up = node::red_bit;
+            return i;
+        }
+        if(nodes.empty()){nodes.emplace_back();}             // the null node
+        if(nodes.size() >= max_nodes){throw std::length_error{"bst<compact>: too many pairs"};}
+        nodes.emplace_back(_in_place_t{}, std::forward<Types>(args)...);
+        return static_cast<index>(nodes.size() - 1);
+    }
+
+    /**
+     * @brief Give a detached node back to the free list
+     */
+    void _release(index i) noexcept {
+        auto& n = nodes[i];
+        n.vacate();
+        n.right = 0;
+        n.left = free_list;
+        free_list = i;
+    }
+
+    /**
+     * @brief Left rotation around x, whose right child takes its place
+     */
+    void _rotate_left(index x) noexcept {
+        auto& nx = nodes[x];
+        auto y = nx.right;
+        auto& ny = nodes[y];
+        nx.right = ny.left;
+        if(ny.left){nodes[ny.left].parent(x);}
+        _replace(x, y);
+        ny.left = x;
+        nx.parent(y);
+    }
+
+    /**
+     * @brief Right rotation around x, whose left child takes its place
+     */
+    void _rotate_right(index x) noexcept {
+        auto& nx = nodes[x];
+        auto y = nx.left;
+        auto& ny = nodes[y];
+        nx.left = ny.right;
+        if(ny.right){nodes[ny.right].parent(x);}
+        _replace(x, y);
+        ny.right = x;
+        nx.parent(y);
+    }
+
+    /**
+     * @brief The subtree rooted in v (possibly 0) takes the place of the one rooted in u
+     */
+    void _replace(index u, index v) noexcept {
+        auto p = nodes[u].parent();
+        if(!p){root = v;}
+        else if(nodes[p].left == u){nodes[p].left = v;}
+        else{nodes[p].right = v;}
+        if(v){nodes[v].parent(p);}
+    }
+
+    /**
+     * @brief Attach the red node x as a child of parent (0 if the tree is
+     * empty), on the given side, and restore the red-black invariants
+     */
+    iterator _attach(index parent, bool left, index x) noexcept {
+        nodes[x].parent(parent);
+        if(!parent){root = x;}
+        else if(left){nodes[parent].left = x;}
+        else{nodes[parent].right = x;}
+        if(!tail || (parent == tail && !left)){tail = x;}
+        ++items;
+
+        auto z = x;
+        while(_red(nodes[z].parent())){
+            auto p = nodes[z].parent();
+            auto g = nodes[p].parent();
+            bool p_left = nodes[g].left == p;
+            auto uncle = p_left ? nodes[g].right : nodes[g].left;
+            if(_red(uncle)){                                // recolor and move up
+                nodes[p].red(false);
+                nodes[uncle].red(false);
+                nodes[g].red(true);
+                z = g;
+                continue;
+            }
+            if(p_left && nodes[p].right == z){_rotate_left(p); z = p; p = nodes[z].parent();}
+            else if(!p_left && nodes[p].left == z){_rotate_right(p); z = p; p = nodes[z].parent();}
+            nodes[p].red(false);
+            nodes[g].red(true);
+            if(p_left){_rotate_right(g);}
+            else{_rotate_left(g);}
+        }
+        nodes[root].red(false);
+        return _iter(x);
+    }
+
+    /**
+     * @brief Unlink the node z from the tree, restore the red-black
+     * invariants and put z in the free list
+     */
+    void _erase_node(index z) noexcept {
+        if(z == tail){tail = static_cast<index>((--_iter(z)).where());}
+
+        auto& nz = nodes[z];
+        index x, xp;                                        // the node that moved up, possibly 0, and its parent
+        bool removed_red = nz.red();
+        if(!nz.left || !nz.right){
+            x = nz.left ? nz.left : nz.right;
+            xp = nz.parent();
+            _replace(z, x);
+        }
+        else{                                               // the successor y takes the place of z
+            auto y = nz.right;
+            while(nodes[y].left){y = nodes[y].left;}
+            auto& ny = nodes[y];
+            removed_red = ny.red();
+            x = ny.right;
+            if(ny.parent() == z){xp = y;}
+            else{
+                xp = ny.parent();
+                _replace(y, x);
+                ny.right = nz.right;
+                nodes[ny.right].parent(y);
+            }
+            _replace(z, y);
+            ny.left = nz.left;
+            nodes[ny.left].parent(y);
+            ny.red(nz.red());
+        }
+        --items;
+        _release(z);
+        if(!removed_red){_fix_erase(x, xp);}
+    }
+
+    /**
+     * @brief The paths through x (possibly 0, child of xp) lack a black node
+     */
+    void _fix_erase(index x, index xp) noexcept {
+        while(x != root && !_red(x)){
+            if(nodes[xp].left == x){
+                auto w = nodes[xp].right;
+                if(_red(w)){
+                    nodes[w].red(false);
+                    nodes[xp].red(true);
+                    _rotate_left(xp);
+                    w = nodes[xp].right;
+                }
+                if(!_red(nodes[w].left) && !_red(nodes[w].right)){
+                    nodes[w].red(true);
+                    x = xp;
+                    xp = nodes[x].parent();
+                    continue;
+                }
+                if(!_red(nodes[w].right)){
+                    nodes[nodes[w].left].red(false);
+                    nodes[w].red(true);
+                    _rotate_right(w);
+                    w = nodes[xp].right;
+                }
+                nodes[w].red(nodes[xp].red());
+                nodes[xp].red(false);
+                nodes[nodes[w].right].red(false);
+                _rotate_left(xp);
+            }
+            else{
+                auto w = nodes[xp].left;
+                if(_red(w)){
+                    nodes[w].red(false);
+                    nodes[xp].red(true);
+                    _rotate_right(xp);
+                    w = nodes[xp].left;
+                }
+                if(!_red(nodes[w].left) && !_red(nodes[w].right)){
+                    nodes[w].red(true);
+                    x = xp;
+                    xp = nodes[x].parent();
+                    continue;
+                }
+                if(!_red(nodes[w].left)){
+                    nodes[nodes[w].right].red(false);
+                    nodes[w].red(true);
+                    _rotate_left(w);
+                    w = nodes[xp].left;
+                }
+                nodes[w].red(nodes[xp].red());
+                nodes[xp].red(false);
+                nodes[nodes[w].left].red(false);
+                _rotate_right(xp);
+            }
+            x = root;
+        }
+        if(x){nodes[x].red(false);}
+    }
+
+    /**
+     * @brief Link the nodes [lo, hi) into a perfectly balanced subtree:
+     * they hold sorted pairs, so the middle one is the root. The nodes at
+     * depth red_depth, the last level, are red and all the others black
+     *
+     * @return the index of the root of the subtree, 0 if the range is empty
+     */
+    index _link(index lo, index hi, index parent, std::size_t depth, std::size_t red_depth) noexcept {
+        if(lo == hi){return 0;}
+        auto mid = static_cast<index>(lo + (hi - lo) / 2);
+        auto& n = nodes[mid];
+        n.up = depth == red_depth ? node::red_bit : 0;
+        n.parent(parent);
+        n.left = _link(lo, mid, mid, depth + 1, red_depth);
+        n.right = _link(mid + 1, hi, mid, depth + 1, red_depth);
+        return mid;
+    }
+
+    /**
+     * @brief Build the tree out of n sorted pairs without duplicate keys,
+     * in nodes 1..n of a new vector, so that the order of the nodes in
+     * memory is the order of the keys
+     *
+     * @param n number of pairs
+     * @param next callable that returns the next pair
+     */
+    template <typename F>
+    void _build(std::size_t n, F next){
+        if(!n){return;}
+        if(n >= max_nodes){throw std::length_error{"bst<compact>: too many pairs"};}
+        storage built{nodes.get_allocator()};
+        built.reserve(n + 1);
+        built.emplace_back();
+        for(std::size_t i = 0; i < n; ++i){built.emplace_back(_in_place_t{}, next());}
+        nodes.swap(built);
+
+        std::size_t red_depth = 0;                          // the depth of the deepest nodes, floor(log2(n))
+        while((std::size_t{2} << red_depth) <= n){++red_depth;}
+        root = _link(1, static_cast<index>(n + 1), 0, 0, red_depth);
+        nodes[root].red(false);
+        tail = static_cast<index>(n);
+        items = n;
+    }
+
+    /**
+     * @brief Auxiliary function to check whether the keys
+     * of a range are strictly increasing (wrt OP)
+     */
+    template <typename It>
+    bool _is_strictly_sorted(It first, It last) const {
+        if(first == last){return true;}
+        for(auto next = std::next(first); next != last; ++first, ++next){
+            if(!cmp(first->first, next->first)){return false;}
+        }
+        return true;
+    }
+
+    /**
+     * @brief Auxiliary function of bulk_load, for a random access range:
+     * if it is already sorted the tree is built straight from it
+     */
+    template <typename It>
+    void _bulk_load(It first, It last, std::random_access_iterator_tag){
+        if(!_is_strictly_sorted(first, last)){
+            _bulk_load(first, last, std::input_iterator_tag{});
+            return;
+        }
+        _build(last - first, [&first](){return *first++;});
+    }
+
+    /**
+     * @brief Auxiliary function of bulk_load, for any other range:
+     * the pairs are copied into a vector, sorted by key and
+     * deduplicated (the first pair with a given key wins) if needed
+     */
+    template <typename It>
+    void _bulk_load(It first, It last, std::input_iterator_tag){
+        std::vector<std::pair<k_t,v_t>> ordered(first, last);
+
+        if(!_is_strictly_sorted(ordered.begin(), ordered.end())){
+            auto by_key = [this](const std::pair<k_t,v_t>& a, const std::pair<k_t,v_t>& b){
+                return cmp(a.first, b.first);
+            };
+            auto same_key = [this](const std::pair<k_t,v_t>& a, const std::pair<k_t,v_t>& b){
+                return !cmp(a.first, b.first);
+            };
+            std::stable_sort(ordered.begin(), ordered.end(), by_key);
+            ordered.erase(std::unique(ordered.begin(), ordered.end(), same_key), ordered.end());
+        }
+
+        auto i = ordered.begin();
+        _build(ordered.size(), [&i](){return std::move(*i++);});
+    }
+
+    /**
+     * @brief Auxiliary function to implement insert, through forwarding references
+     */
+    template <typename O>
+    std::pair<iterator, bool> _insert(O&& x){
+        auto where = _locate(x.first);
+        if(where.second){return std::pair<iterator, bool>{_iter(where.first), false};}
+        auto left = where.first && cmp(x.first, nodes[where.first]._pair.first);
+        auto i = _create(std::forward<O>(x));
+        return std::pair<iterator, bool>{_attach(where.first, left, i), true};
+    }
+
+    /**
+     * @brief Auxiliary function to implement insert with hint: if the key
+     * belongs right before hint there is no traversal, the node is attached
+     * as the left child of hint or as the right child of its predecessor
+     */
+    template <typename O>
+    iterator _insert(const_iterator hint, O&& x){
+        auto h = hint.where();
+        auto p = (--hint).where();                          // the predecessor of hint, 0 if there is none
+        bool fits = root && (!h || cmp(x.first, nodes[h]._pair.first))
+                         && (!p || cmp(nodes[p]._pair.first, x.first));
+        if(!fits){return _insert(std::forward<O>(x)).first;}
+
+        auto i = _create(std::forward<O>(x));
+        if(h && !nodes[h].left){return _attach(h, true, i);}
+        return _attach(p, false, i);                        // p is the right most node on the left of hint
+    }
+
+    /**
+     * @brief Auxiliary function to implement try_emplace
+     */
+    template <typename K, typename... Types>
+    std::pair<iterator, bool> _try_emplace(K&& k, Types&&... args){
+        auto where = _locate(k);
+        if(where.second){return std::pair<iterator, bool>{_iter(where.first), false};}
+        auto left = where.first && cmp(k, nodes[where.first]._pair.first);
+        auto i = _create(std::piecewise_construct, std::forward_as_tuple(std::forward<K>(k)),
+                         std::forward_as_tuple(std::forward<Types>(args)...));
+        return std::pair<iterator, bool>{_attach(where.first, left, i), true};
+    }
+
+public:
+
+    /**
+     * @brief Default ctor
+     *
+     */
+    bst() noexcept = default;
+
+    /**
+     * @brief Custom ctor, no implicit conversion
+     *
+     * @param a the allocator the vector of the nodes obtains its memory from
+     */
+    explicit bst(const Alloc& a) noexcept: nodes{typename storage::allocator_type{a}} {}
+
+    /**
+     * @brief Custom ctor, it builds the tree out of a range of pairs (see bulk_load)
+     */
+    template <typename It>
+    bst(It first, It last, const Alloc& a = Alloc{}): nodes{typename storage::allocator_type{a}} {bulk_load(first, last);}
+
+    /**
+     * @brief Move ctor, the vector of the nodes is stolen from x
+     */
+    bst(bst&& x) noexcept:
+        nodes{std::move(x.nodes)}, root{x.root}, tail{x.tail}, free_list{x.free_list}, items{x.items}, cmp{std::move(x.cmp)} {
+        x.root = x.tail = x.free_list = 0;
+        x.items = 0;
+    }
+
+    /**
+     * @brief Move assignment
+     */
+    bst& operator=(bst&& x) noexcept {
+        nodes = std::move(x.nodes);
+        root = x.root;
+        tail = x.tail;
+        free_list = x.free_list;
+        items = x.items;
+        cmp = std::move(x.cmp);
+        x.nodes.clear();
+        x.root = x.tail = x.free_list = 0;
+        x.items = 0;
+        return *this;
+    }
+
+    /**
+     * @brief Copy ctor: the nodes are copied as they are, vacant ones
+     * included, since the indices are the links
+     */
+    bst(const bst& x) = default;
+
+    /**
+     * @brief Copy assignment
+     */
+    bst& operator=(const bst& x){
+        auto tmp{x};
+        *(this) = std::move(tmp);
+        return *this;
+    }
+
+    /**
+     * @return iterator to the smallest key
+     */
+    iterator begin() noexcept {return _iter(_left_most());}
+
+    /**
+     * @return const_iterator to the smallest key
+     */
+    const_iterator begin() const noexcept {return _iter(_left_most());}
+
+    /**
+     * @return const_iterator to the smallest key
+     */
+    const_iterator cbegin() const noexcept {return _iter(_left_most());}
+
+    /**
+     * @return reverse iterator to the biggest key
+     */
+    reverse_iterator rbegin() noexcept {return reverse_iterator{end()};}
+
+    /**
+     * @return const reverse iterator to the biggest key
+     */
+    const_reverse_iterator rbegin() const noexcept {return const_reverse_iterator{end()};}
+
+    /**
+     * @return const reverse iterator to the biggest key
+     */
+    const_reverse_iterator crbegin() const noexcept {return const_reverse_iterator{cend()};}
+
+    /**
+     * @return reverse iterator to one before the smallest key
+     */
+    reverse_iterator rend() noexcept {return reverse_iterator{begin()};}
+
+    /**
+     * @return const reverse iterator to one before the smallest key
+     */
+    const_reverse_iterator rend() const noexcept {return const_reverse_iterator{begin()};}
+
+    /**
+     * @return const reverse iterator to one before the smallest key
+     */
+    const_reverse_iterator crend() const noexcept {return const_reverse_iterator{cbegin()};}
+
+    /**
+     * @return iterator to one past the biggest key
+     */
+    iterator end() noexcept {return _iter(0);}
+
+    /**
+     * @return const_iterator to one past the biggest key
+     */
+    const_iterator end() const noexcept {return _iter(0);}
+
+    /**
+     * @return const_iterator to one past the biggest key
+     */
+    const_iterator cend() const noexcept {return _iter(0);}
+
+    /**
+     * @return iterator to the pair with key equivalent to x, end() if there is none
+     */
+    iterator find(const k_t& x) {
+        auto where = _locate(x);
+        return _iter(where.second ? where.first : 0);
+    }
+
+    /**
+     * @return const_iterator to the pair with key equivalent to x, end() if there is none
+     */
+    const_iterator find(const k_t& x) const {
+        auto where = _locate(x);
+        return _iter(where.second ? where.first : 0);
+    }
+
+    /**
+     * @return 1 if a key equivalent to x is present, 0 otherwise
+     */
+    std::size_t count(const k_t& x) const {return _locate(x).second ? 1 : 0;}
+
+    /**
+     * @return true if a key equivalent to x is present
+     */
+    bool contains(const k_t& x) const {return _locate(x).second;}
+
+    /**
+     * @return the number of pairs in the tree
+     */
+    std::size_t size() const noexcept {return items;}
+
+    /**
+     * @return iterator to the first key not smaller than x
+     */
+    iterator lower_bound(const k_t& x) {return _iter(_bound(x, false));}
+
+    /**
+     * @return const_iterator to the first key not smaller than x
+     */
+    const_iterator lower_bound(const k_t& x) const {return _iter(_bound(x, false));}
+
+    /**
+     * @return iterator to the first key bigger than x
+     */
+    iterator upper_bound(const k_t& x) {return _iter(_bound(x, true));}
+
+    /**
+     * @return const_iterator to the first key bigger than x
+     */
+    const_iterator upper_bound(const k_t& x) const {return _iter(_bound(x, true));}
+
+    /**
+     * @brief Range of the pairs with key equivalent to x
+     * @return pair of lower_bound(x) and upper_bound(x)
+     */
+    std::pair<iterator, iterator> equal_range(const k_t& x) {
+        return std::pair<iterator, iterator>{lower_bound(x), upper_bound(x)};
+    }
+
+    /**
+     * @brief Range of the pairs with key equivalent to x
+     * @return pair of lower_bound(x) and upper_bound(x)
+     */
+    std::pair<const_iterator, const_iterator> equal_range(const k_t& x) const {
+        return std::pair<const_iterator, const_iterator>{lower_bound(x), upper_bound(x)};
+    }
+
+    /**
+     * @brief Insert a pair, if its key is not present yet
+     * @return pair of an iterator to the pair with such key and
+     * a bool that is true if the pair has been inserted
+     */
+    std::pair<iterator, bool> insert(const std::pair<k_t, v_t>& x) {return _insert(x);}
+
+    /**
+     * @brief Insert a pair, if its key is not present yet
+     * @return pair of an iterator to the pair with such key and
+     * a bool that is true if the pair has been inserted
+     */
+    std::pair<iterator, bool> insert(std::pair<k_t, v_t>&& x) {return _insert(std::move(x));}
+
+    /**
+     * @brief Insert a pair with a hint: if its key belongs right before
+     * hint it is attached there without a traversal
+     * @return iterator to the pair with such key
+     */
+    iterator insert(const_iterator hint, const std::pair<k_t, v_t>& x) {return _insert(hint, x);}
+
+    /**
+     * @brief Insert a pair with a hint: if its key belongs right before
+     * hint it is attached there without a traversal
+     * @return iterator to the pair with such key
+     */
+    iterator insert(const_iterator hint, std::pair<k_t, v_t>&& x) {return _insert(hint, std::move(x));}
+
+    /**
+     * @brief Inserts a new pair constructed from args, if its key is not present yet
+     */
+    template <typename... Types>
+    std::pair<iterator,bool> emplace(Types&&... args){
+        return _insert(std::pair<k_t,v_t>(std::forward<Types>(args)...));
+    }
+
+    /**
+     * @brief If the key is not present, inserts a new pair with the given key
+     * and the value constructed from args; otherwise it does nothing
+     */
+    template <typename... Types>
+    std::pair<iterator,bool> try_emplace(const k_t& k, Types&&... args){
+        return _try_emplace(k, std::forward<Types>(args)...);
+    }
+
+    /**
+     * @brief If the key is not present, inserts a new pair with the given key
+     * and the value constructed from args; otherwise it does nothing
+     */
+    template <typename... Types>
+    std::pair<iterator,bool> try_emplace(k_t&& k, Types&&... args){
+        return _try_emplace(std::move(k), std::forward<Types>(args)...);
+    }
+
+    /**
+     * @brief If the key is present, assigns obj to its value;
+     * otherwise inserts a new pair with the given key and value
+     */
+    template <typename M>
+    std::pair<iterator,bool> insert_or_assign(const k_t& k, M&& obj){
+        auto res = _try_emplace(k, std::forward<M>(obj));
+        if(!res.second){res.first.value() = std::forward<M>(obj);}
+        return res;
+    }
+
+    /**
+     * @brief If the key is present, assigns obj to its value;
+     * otherwise inserts a new pair with the given key and value
+     */
+    template <typename M>
+    std::pair<iterator,bool> insert_or_assign(k_t&& k, M&& obj){
+        auto res = _try_emplace(std::move(k), std::forward<M>(obj));
+        if(!res.second){res.first.value() = std::forward<M>(obj);}
+        return res;
+    }
+
+    /**
+     * @brief Clear the content of the tree and release the vector of the nodes
+     */
+    void clear() noexcept {
+        storage{nodes.get_allocator()}.swap(nodes);
+        root = tail = free_list = 0;
+        items = 0;
+    }
+
+    /**
+     * @brief Reserve the room for n pairs, so that the vector of the
+     * nodes does not grow while they are inserted
+     */
+    void reserve(std::size_t n){nodes.reserve(n + 1);}
+
+    /**
+     * @return a copy of the allocator of the vector of the nodes
+     */
+    Alloc get_allocator() const {return Alloc{nodes.get_allocator()};}
+
+    /**
+     * @brief Replaces the content of the tree with the pairs in [first, last),
+     * as a perfectly balanced tree built in linear time.
+     * Unsorted ranges are copied, sorted and deduplicated first
+     * (the first pair with a given key wins, as with insert)
+     */
+    template <typename It>
+    void bulk_load(It first, It last){
+        clear();
+        _bulk_load(first, last, typename std::iterator_traits<It>::iterator_category{});
+    }
+
+    /**
+     * @brief Rebuild the tree perfectly balanced, with the nodes laid out
+     * in the order of their keys and without vacant ones: the free list is
+     * dropped and the vector shrinks to the size of the tree.
+     * It invalidates the iterators
+     */
+    void balance(){
+        if(!items){
+            clear();
+            return;
+        }
+        auto i = begin();
+        _build(items, [&i](){
+            std::pair<k_t,v_t> pair{std::move(*i), std::move(i.value())};
+            ++i;
+            return pair;
+        });
+        free_list = 0;
+    }
+
+    /**
+     * @brief Takes an immutable snapshot of the tree (see bits_bst_frozen.hpp)
+     */
+    frozen_bst<k_t,v_t,OP> freeze() const {
+        return frozen_bst<k_t,v_t,OP>{cbegin(), cend(), cmp};
+    }
+
+    /**
+     * @brief Writes the pairs to a binary snapshot file (see bits_bst_snapshot.hpp)
+     */
+    void save(const std::string& path) const {
+        _save_snapshot<k_t,v_t>(path, cbegin(), cend(), items);
+    }
+
+    /**
+     * @brief Replaces the content with the pairs of a snapshot file, built
+     * straight from the mapping as in bulk_load (see bst::load)
+     */
+    void load(const std::string& path){
+        mapped_snapshot<k_t,v_t,OP> file{path, cmp};
+        file.advise(MADV_SEQUENTIAL);
+        if(!file.is_sorted()){
+            std::vector<std::pair<k_t,v_t>> pairs;
+            pairs.reserve(file.size());
+            for(auto i = file.cbegin(); i != file.cend(); ++i){pairs.emplace_back(*i, i.value());}
+            bulk_load(std::make_move_iterator(pairs.begin()), std::make_move_iterator(pairs.end()));
+            return;
+        }
+        clear();
+        auto pairs = file.pairs();
+        std::size_t i = 0;
+        _build(file.size(), [&pairs, &i](){return pairs[i++];});
+    }
+
+    /**
+     * @brief Removes the pair (if one exists) with the key equivalent to x
+     */
+    void erase(const k_t& x){
+        auto where = _locate(x);
+        if(!where.second){
+            std::cerr << "ERROR: no element has key = " << x << std::endl;
+            return;
+        }
+        _erase_node(where.first);
+    }
+
+    /**
+     * @brief Overload of operator put to
+     */
+    friend
+    std::ostream& operator<<(std::ostream& os, const bst& x){
+        if(!x.root){os << "WARNING: empty tree"; return os;}
+
+        for(auto& key : x){
+            os << key << " ";
+        }
+        os << std::endl;
+        return os;
+    }
+
+    /**
+     * Overload of subscripting operator
+     * Returns a reference to the value that is mapped
+     * to a key equivalent to x, performing an insertion if such key does not already exist
+     */
+    v_t& operator[](const k_t& x) {return try_emplace(x).first.value();}
+
+    /**
+     * Overload of subscripting operator
+     * Returns a reference to the value that is mapped
+     * to a key equivalent to x, performing an insertion if such key does not already exist
+     */
+    v_t& operator[](k_t&& x) {return try_emplace(std::move(x)).first.value();}
+};
+
+#endif
@@ -0,0 +1,495 @@
+#ifndef _BITS_BST_CONCURRENT_
+#define _BITS_BST_CONCURRENT_
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+/**
+ * Header for class concurrent bst, a binary search tree that many threads
+ * can read and modify at the same time, without a global lock.
+ * - find and contains are lock-free: they only follow atomic child pointers
+ * - insert and erase traverse the tree the same way, then lock just the
+ *   node they modify and its parent (always in this order, top-down, so
+ *   there are no deadlocks), check that nothing changed in the meantime
+ *   and otherwise start over
+ * - the pair of a node never changes once the node is published:
+ *   erasing a key marks its node as removed; a node with at most one child
+ *   is also unlinked, while one with two children stays as a routing node
+ *   until one of its children goes away. Inserting the key of a routing
+ *   node replaces it with a new node
+ * - the unlinked nodes are reclaimed with epochs: a node is destroyed only
+ *   when all the operations that were running when it was unlinked are over
+ *
+ * The tree is not rebalanced while it is being modified: keys inserted
+ * in random order give a logarithmic expected height, but keys inserted
+ * in sorted order build a chain, and every operation then costs O(n).
+ * The routing nodes are dropped only by balance, which also restores a
+ * logarithmic height, and which runs when no other thread is using the tree;
+ * a tree can also be built balanced from a range.
+ *
+ * The nodes are not the _node of the bst, and there is no _iterator:
+ * the links of a _node are unique pointers that a reader cannot follow
+ * while a writer changes them, and its parent pointers would have to be
+ * kept consistent under fine-grained locks. An iterator could also
+ * outlive the node it points to, once the node is reclaimed, so the pairs
+ * are visited with for_each instead.
+ *
+ * @tparam k_t template for the key type
+ * @tparam v_t template for the value type
+ * @tparam OP template for the total order relation; default is std::less<k_t>
+ * @tparam Alloc template for the allocator of the nodes; it must be thread-safe
+ */
+
+
+/**
+ * @brief Node of the concurrent bst
+ */
+template <typename k_t, typename v_t>
+struct _cnode{
+
+    /**
+     * @brief Pair of key and value, immutable
+     */
+    const std::pair<k_t,v_t> _pair;
+
+    std::atomic<_cnode*> left{nullptr};
+    std::atomic<_cnode*> right{nullptr};
+
+    /**
+     * @brief The key has been erased; the node is only used to route the searches
+     */
+    std::atomic<bool> removed{false};
+
+    /**
+     * @brief The node is not reachable anymore; it is read and written under lock
+     */
+    bool unlinked{false};
+
+    std::mutex lock;
+
+    template <typename P>
+    explicit _cnode(P&& pair): _pair(std::forward<P>(pair)) {}
+};
+
+
+template <typename k_t, typename v_t, typename OP = std::less<k_t>,
+          typename Alloc = std::allocator<std::pair<k_t,v_t>> >
+class concurrent_bst{
+
+    using node = _cnode<k_t,v_t>;
+    using alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<node>;
+    using traits = std::allocator_traits<alloc_t>;
+
+    /**
+     * @brief Epoch announced by a running operation:
+     * (epoch << 1) | 1 while the operation runs, 0 if the slot is free
+     */
+    struct alignas(64) pin_slot{ std::atomic<std::uint64_t> epoch{0}; };
+
+    static constexpr std::size_t max_pins = 128;         // operations running at the same time
+    static constexpr std::size_t retire_batch = 64;      // reclaim every retire_batch unlinked nodes
+
+    /**
+     * @brief Private variables
+     */
+    std::atomic<node*> root{nullptr};
+    std::mutex root_lock;                                // protects root, as the lock of a parent
+    std::atomic<std::size_t> items{0};
+    OP cmp;
+    alloc_t alloc;
+
+    mutable std::atomic<std::uint64_t> global_epoch{2};
+    mutable pin_slot pins[max_pins];
+    std::mutex retire_lock;
+    std::vector<std::pair<std::uint64_t, node*>> retired;   // unlinked nodes, with the epoch of their unlinking
+
+    /**
+     * @brief RAII guard of an operation: it announces the current epoch
+     * in a free slot, so that the nodes it can reach are not destroyed
+     */
+    class pin_guard{
+        pin_slot& slot;
+
+        static pin_slot& acquire(const concurrent_bst& t) noexcept {
+            static thread_local std::size_t hint = 0;
+            for(std::size_t i = hint, tries = 1;; i = (i + 1) % max_pins, ++tries){
+                std::uint64_t free = 0;
+                auto announced = (t.global_epoch.load() << 1) | 1;
+                if(t.pins[i].epoch.compare_exchange_strong(free, announced)){
+                    hint = i;
+                    // the announcement must be visible before any node is read
+                    std::atomic_thread_fence(std::memory_order_seq_cst);
+                    return t.pins[i];
+                }
+                if(tries % max_pins == 0){std::this_thread::yield();}   // all the slots are busy
+            }
+        }
+
+    public:
+        explicit pin_guard(const concurrent_bst& t) noexcept: slot{acquire(t)} {}
+        ~pin_guard() noexcept {slot.epoch.store(0, std::memory_order_release);}
+        pin_guard(const pin_guard&) = delete;
+        pin_guard& operator=(const pin_guard&) = delete;
+    };
+
+    /**
+     * @return the pointer of parent that should point to x
+     * (root if parent is nullptr)
+     */
+    std::atomic<node*>& _slot(node* parent, const k_t& x) noexcept {
+        if(!parent){return root;}
+        return cmp(x, parent->_pair.first) ? parent->left : parent->right;
+    }
+
+    /**
+     * @return the lock that protects the children of parent (root_lock if parent is nullptr)
+     */
+    std::mutex& _lock_of(node* parent) noexcept {return parent ? parent->lock : root_lock;}
+
+    /**
+     * @brief Lock-free search of a key
+     *
+     * @param x the key
+     * @param parent the parent of the node with key x, or of the place where it would be (output)
+     * @param grand the parent of parent (output)
+     * @return the node with key x, nullptr if there is none
+     */
+    node* _search(const k_t& x, node*& parent, node*& grand) const noexcept {
+        grand = parent = nullptr;
+        auto cur = root.load(std::memory_order_acquire);
+        while(cur){
+            if(cmp(x, cur->_pair.first)){
+                grand = parent;
+                parent = cur;
+                cur = cur->left.load(std::memory_order_acquire);
+            }
+            else if(cmp(cur->_pair.first, x)){
+                grand = parent;
+                parent = cur;
+                cur = cur->right.load(std::memory_order_acquire);
+            }
+            else{return cur;}
+        }
+        return nullptr;
+    }
+
+    /**
+     * @brief Deleter of a node that has not been published yet
+     */
+    struct _unpublished{
+        concurrent_bst* t;
+        void operator()(node* n) const noexcept {t->_destroy(n);}
+    };
+
+    template <typename P>
+    node* _create(P&& x){
+        auto n = traits::allocate(alloc, 1);
+        try{traits::construct(alloc, n, std::forward<P>(x));}
+        catch(...){
+            traits::deallocate(alloc, n, 1);
+            throw;
+        }
+        return n;
+    }
+
+    void _destroy(node* n) noexcept {
+        traits::destroy(alloc, n);
+        traits::deallocate(alloc, n, 1);
+    }
+
+    /**
+     * @brief Hand an unlinked node to the epoch based reclamation.
+     * Every retire_batch nodes the epoch is advanced, if all the running
+     * operations have seen the current one, and the nodes unlinked two
+     * epochs ago are destroyed: no running operation can reach them
+     */
+    void _retire(node* n){
+        std::lock_guard<std::mutex> guard{retire_lock};
+        retired.emplace_back(global_epoch.load(), n);
+        if(retired.size() < retire_batch){return;}
+
+        std::atomic_thread_fence(std::memory_order_seq_cst);  // the unlinkings must be visible before the scan
+        auto epoch = global_epoch.load();
+        bool advance = true;
+        for(auto& p : pins){
+            auto announced = p.epoch.load();
+            if(announced && (announced >> 1) != epoch){advance = false;}
+        }
+        if(advance){global_epoch.compare_exchange_strong(epoch, epoch + 1);}
+
+        epoch = global_epoch.load();
+        auto safe = std::partition(retired.begin(), retired.end(),
+                                   [epoch](const std::pair<std::uint64_t, node*>& r){return r.first + 2 > epoch;});
+        for(auto i = safe; i != retired.end(); ++i){_destroy(i->second);}
+        retired.erase(safe, retired.end());
+    }
+
+    /**
+     * @brief Unlink the routing node x, if it has at most one child left
+     *
+     * @param parent the parent of x
+     * @param x a node marked as removed
+     */
+    void _prune(node* parent, node* x){
+        node* child;
+        {
+            std::lock_guard<std::mutex> p_guard{_lock_of(parent)};
+            std::lock_guard<std::mutex> x_guard{x->lock};
+            auto& link = _slot(parent, x->_pair.first);
+            if((parent && parent->unlinked) || x->unlinked || link.load() != x){return;}
+            auto l = x->left.load();
+            auto r = x->right.load();
+            if(l && r){return;}
+            child = l ? l : r;
+            x->unlinked = true;
+            link.store(child, std::memory_order_release);
+        }
+        _retire(x);
+    }
+
+    /**
+     * @brief Auxiliary function to insert a pair through forwarding references
+     */
+    template <typename P>
+    bool _insert(P&& x){
+        pin_guard pin{*this};
+        std::unique_ptr<node, _unpublished> fresh{_create(std::forward<P>(x)), _unpublished{this}};
+        const k_t& k = fresh->_pair.first;
+
+        for(;;){
+            node* parent;
+            node* grand;
+            auto cur = _search(k, parent, grand);
+
+            if(cur && !cur->removed.load(std::memory_order_acquire)){return false;}
+
+            std::unique_lock<std::mutex> p_guard{_lock_of(parent)};
+            auto& link = _slot(parent, k);
+            if((parent && parent->unlinked) || link.load() != cur){continue;}     // something changed: start over
+
+            if(!cur){                                    // attach a new leaf
+                link.store(fresh.release(), std::memory_order_release);
+                ++items;
+                return true;
+            }
+
+            // replace the routing node with the key: the new node takes its children
+            std::unique_lock<std::mutex> c_guard{cur->lock};
+            if(cur->unlinked || !cur->removed.load()){continue;}
+            fresh->left.store(cur->left.load(), std::memory_order_relaxed);
+            fresh->right.store(cur->right.load(), std::memory_order_relaxed);
+            cur->unlinked = true;
+            link.store(fresh.release(), std::memory_order_release);
+            c_guard.unlock();
+            p_guard.unlock();
+            _retire(cur);
+            ++items;
+            return true;
+        }
+    }
+
+    /**
+     * @brief Auxiliary function to build a balanced subtree out of
+     * a sorted range of n pairs (the median becomes the root)
+     */
+    template <typename It>
+    node* _balancing(It first, std::size_t n){
+        if(!n){return nullptr;}
+        auto median = (n - 1) / 2;
+        auto x = _create(first[median]);
+        x->left.store(_balancing(first, median), std::memory_order_relaxed);
+        x->right.store(_balancing(first + median + 1, n - median - 1), std::memory_order_relaxed);
+        return x;
+    }
+
+    /**
+     * @brief Destroy all the nodes, reachable and retired (no other thread may use the tree)
+     */
+    void _destroy_all() noexcept {
+        std::vector<node*> stack;
+        if(auto r = root.load()){stack.push_back(r);}
+        while(!stack.empty()){
+            auto x = stack.back();
+            stack.pop_back();
+            if(auto l = x->left.load()){stack.push_back(l);}
+            if(auto r = x->right.load()){stack.push_back(r);}
+            _destroy(x);
+        }
+        root.store(nullptr);
+        for(auto& r : retired){_destroy(r.second);}
+        retired.clear();
+        items = 0;
+    }
+
+public:
+
+    /**
+     * @brief Default ctor
+     */
+    concurrent_bst() = default;
+
+    /**
+     * @brief Custom ctor, it builds a balanced tree out of a range of pairs;
+     * the first pair with a given key wins
+     */
+    template <typename It>
+    concurrent_bst(It first, It last, const OP& c = OP{}, const Alloc& a = Alloc{}): cmp{c}, alloc{a} {
+        std::vector<std::pair<k_t,v_t>> ordered(first, last);
+        auto by_key = [this](const std::pair<k_t,v_t>& x, const std::pair<k_t,v_t>& y){return cmp(x.first, y.first);};
+        auto same_key = [this](const std::pair<k_t,v_t>& x, const std::pair<k_t,v_t>& y){return !cmp(x.first, y.first);};
+        std::stable_sort(ordered.begin(), ordered.end(), by_key);
+        ordered.erase(std::unique(ordered.begin(), ordered.end(), same_key), ordered.end());
+        root.store(_balancing(std::make_move_iterator(ordered.begin()), ordered.size()));
+        items = ordered.size();
+    }
+
+    /**
+     * @brief Dtor (no other thread may use the tree)
+     */
+    ~concurrent_bst() noexcept {_destroy_all();}
+
+    concurrent_bst(const concurrent_bst&) = delete;
+    concurrent_bst& operator=(const concurrent_bst&) = delete;
+
+    /**
+     * @brief Look for a key, lock-free
+     *
+     * @param x the key
+     * @param value where the value of the key is copied, if it is present
+     * @return true if the key is present
+     */
+    bool find(const k_t& x, v_t& value) const {
+        pin_guard pin{*this};
+        node* parent;
+        node* grand;
+        auto cur = _search(x, parent, grand);
+        if(!cur || cur->removed.load(std::memory_order_acquire)){return false;}
+        value = cur->_pair.second;
+        return true;
+    }
+
+    /**
+     * @brief Look for a key, lock-free
+     *
+     * @return true if the key is present
+     */
+    bool contains(const k_t& x) const {
+        pin_guard pin{*this};
+        node* parent;
+        node* grand;
+        auto cur = _search(x, parent, grand);
+        return cur && !cur->removed.load(std::memory_order_acquire);
+    }
+
+    /**
+     * @brief Insert a new pair, if its key is not present
+     *
+     * @return true if the pair has been inserted
+     */
+    bool insert(const std::pair<k_t,v_t>& x) {return _insert(x);}
+
+    /**
+     * @brief Insert a new pair, if its key is not present
+     *
+     * @return true if the pair has been inserted
+     */
+    bool insert(std::pair<k_t,v_t>&& x) {return _insert(std::move(x));}
+
+    /**
+     * @brief Remove the key x, if it is present
+     *
+     * @return true if the key has been removed
+     */
+    bool erase(const k_t& x){
+        pin_guard pin{*this};
+        for(;;){
+            node* parent;
+            node* grand;
+            auto cur = _search(x, parent, grand);
+            if(!cur || cur->removed.load(std::memory_order_acquire)){return false;}
+
+            std::unique_lock<std::mutex> p_guard{_lock_of(parent)};
+            std::unique_lock<std::mutex> c_guard{cur->lock};
+            auto& link = _slot(parent, x);
+            if((parent && parent->unlinked) || cur->unlinked || link.load() != cur){continue;}
+            if(cur->removed.load()){return false;}
+
+            cur->removed.store(true, std::memory_order_release);     // from now on the key is absent
+            --items;
+            auto l = cur->left.load();
+            auto r = cur->right.load();
+            if(l && r){return true;}                                  // cur stays as a routing node
+
+            cur->unlinked = true;
+            link.store(l ? l : r, std::memory_order_release);
+            c_guard.unlock();
+            p_guard.unlock();
+            _retire(cur);
+
+            if(parent && parent->removed.load()){_prune(grand, parent);}  // the parent may have one child left
+            return true;
+        }
+    }
+
+    /**
+     * @return the number of keys (it may be stale while other threads modify the tree)
+     */
+    std::size_t size() const noexcept {return items.load(std::memory_order_relaxed);}
+
+    /**
+     * @brief Visit the pairs in order of key. It can run together with the
+     * modifications: the keys inserted or erased during the visit may be seen or not
+     *
+     * @param f callable invoked with the key and the value of every pair
+     */
+    template <typename F>
+    void for_each(F&& f) const {
+        pin_guard pin{*this};
+        std::vector<node*> stack;
+        auto cur = root.load(std::memory_order_acquire);
+        while(cur || !stack.empty()){
+            while(cur){
+                stack.push_back(cur);
+                cur = cur->left.load(std::memory_order_acquire);
+            }
+            cur = stack.back();
+            stack.pop_back();
+            if(!cur->removed.load(std::memory_order_acquire)){f(cur->_pair.first, cur->_pair.second);}
+            cur = cur->right.load(std::memory_order_acquire);
+        }
+    }
+
+    /**
+     * @brief Rebuild the tree perfectly balanced, dropping the routing nodes.
+     * No other thread may use the tree in the meantime
+     */
+    void balance(){
+        std::vector<std::pair<k_t,v_t>> ordered;
+        ordered.reserve(size());
+        for_each([&ordered](const k_t& k, const v_t& v){ordered.emplace_back(k, v);});
+        _destroy_all();
+        root.store(_balancing(std::make_move_iterator(ordered.begin()), ordered.size()));
+        items = ordered.size();
+    }
+
+    /**
+     * @brief Overload of operator put to
+     */
+    friend
+    std::ostream& operator<<(std::ostream& os, const concurrent_bst& x){
+        if(!x.size()){os << "WARNING: empty tree"; return os;}
+        x.for_each([&os](const k_t& k, const v_t&){os << k << " ";});
+        os << std::endl;
+        return os;
+    }
+};
+
+#endif
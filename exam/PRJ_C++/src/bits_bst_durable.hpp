@@ -0,0 +1,519 @@
+#ifndef _BITS_BST_DURABLE_
+#define _BITS_BST_DURABLE_
+
+#include "bits_bst.hpp"
+#include "bits_bst_snapshot.hpp"
+
+#include <cerrno>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Header for class durable bst, a bst whose updates are made durable by
+ * an append-only write-ahead log, without rewriting the tree.
+ * - every insert, insert_or_assign, emplace, erase and assignment through
+ *   operator[] that changes the tree appends a compact binary record to
+ *   the log: the kind of update, the key, the value and a checksum
+ * - the records are gathered in a buffer and written in large chunks;
+ *   with durability::every_update an update returns once its record is on
+ *   the disk, and the writers waiting together share one fdatasync (group
+ *   commit): the first one writes and syncs the records of all the others.
+ *   With durability::on_commit the updates return at once and commit
+ *   waits for all of them
+ * - at startup the tree is loaded from the last checkpoint and the log is
+ *   replayed into it, up to the first incomplete or damaged record
+ * - checkpoint writes the whole tree to a snapshot file (see
+ *   bits_bst_snapshot.hpp) and truncates the log
+ *
+ * Replaying a record on a tree that already contains its effect changes
+ * nothing, so a crash between the snapshot and the truncation of the log
+ * is harmless. The keys and values must be trivially copyable.
+ * All the operations lock the tree, so that the records are appended in
+ * the order the updates are applied.
+ *
+ * @tparam k_t template for the key type
+ * @tparam v_t template for the value type
+ * @tparam OP template for the total order relation; default is std::less<k_t>
+ * @tparam BAL template for the balancing policy; default is red_black
+ * @tparam Alloc template for the allocator of the tree
+ */
+
+
+/**
+ * @brief When an update of a durable bst is on the disk
+ */
+enum class durability{
+    every_update,           // before the update returns
+    on_commit               // before the next commit returns
+};
+
+/**
+ * @brief 32 bit FNV-1a hash, the checksum of a log record
+ */
+inline std::uint32_t _fnv1a(const char* p, std::size_t n) noexcept {
+    std::uint32_t h = 2166136261u;
+    for(std::size_t i = 0; i < n; ++i){
+        h ^= static_cast<unsigned char>(p[i]);
+        h *= 16777619u;
+    }
+    return h;
+}
+
+/**
+ * @brief Append-only log of byte records, with group commit.
+ * The position of a record is the number of bytes appended up to its end
+ * (its log sequence number); the log keeps how many bytes have been written
+ * and synced, and the writer that finds no flush in progress flushes the
+ * records of everyone (it is the leader), while the others wait for it
+ */
+class _write_ahead_log{
+
+    static constexpr std::size_t max_buffer = 1 << 20;     // the records are written at least in chunks of this size
+
+    /**
+     * @brief Private variables
+     */
+    int fd{-1};
+    std::mutex lock;
+    std::condition_variable flushed;
+    std::vector<char> buffer;           // the records not written yet
+    std::uint64_t appended{0};          // bytes appended since the log was opened
+    std::uint64_t written{0};           // of which handed to the file
+    std::uint64_t durable{0};           // of which synced
+    std::uint64_t length{0};            // bytes of the file, up to the last complete write
+    bool flushing{false};               // a leader is writing
+    std::string failure;                // why a flush failed; the log is then unusable
+
+    /**
+     * @brief Auxiliary function: throw if a flush has failed
+     */
+    void _check() const {
+        if(!failure.empty()){throw std::runtime_error{failure};}
+    }
+
+    /**
+     * @brief Auxiliary function: write the records up to lsn, and sync them
+     * if required. If another thread is flushing we wait for it, since its
+     * flush may cover our records too; otherwise we take the whole buffer
+     * and write it without holding the lock, so that the others keep appending.
+     * If the write or the sync fails the batch is lost: the log is marked as
+     * failed, the bytes written after the last complete flush are cut away
+     * and every flush, wait and append, current or future, throws, so that
+     * no record after the lost ones is ever reported durable
+     */
+    void _drain(std::unique_lock<std::mutex>& guard, std::uint64_t lsn, bool sync){
+        while(sync ? durable < lsn : written < lsn){
+            _check();
+            if(flushing){
+                flushed.wait(guard);
+                continue;
+            }
+            flushing = true;
+            std::vector<char> batch;
+            batch.swap(buffer);
+            auto end = appended;
+            guard.unlock();
+
+            bool ok = true;
+            for(std::size_t done = 0; ok && done < batch.size();){
+                auto n = ::write(fd, batch.data() + done, batch.size() - done);
+                if(n < 0 && errno == EINTR){continue;}
+                ok = n > 0;
+                done += ok ? static_cast<std::size_t>(n) : 0;
+            }
+            if(ok && sync){ok = fdatasync(fd) == 0;}
+            auto error = errno;
+
+            guard.lock();
+            flushing = false;
+            flushed.notify_all();
+            if(!ok){
+                failure = std::string{"cannot write the log: "} + std::strerror(error);
+                if(ftruncate(fd, static_cast<off_t>(length)) != 0){   // a torn record would hide the ones after it
+                    failure += ", and the partial records cannot be cut away";
+                }
+                _check();
+            }
+            written = end;
+            length += batch.size();
+            if(sync){durable = end;}
+            if(buffer.empty()){                                 // keep the larger buffer
+                batch.clear();
+                buffer.swap(batch);
+            }
+        }
+    }
+
+public:
+
+    /**
+     * @brief Custom ctor: the log is opened for appending, or created
+     *
+     * @param path name of the file
+     * @param valid the bytes of the file holding complete records; the rest is dropped
+     */
+    _write_ahead_log(const std::string& path, std::uint64_t valid){
+        fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+        if(fd < 0 || ftruncate(fd, static_cast<off_t>(valid)) != 0){
+            if(fd >= 0){::close(fd);}
+            throw std::runtime_error{"cannot open the log " + path + ": " + std::strerror(errno)};
+        }
+        length = valid;
+        buffer.reserve(max_buffer);
+    }
+
+    /**
+     * @brief Dtor, the records still in the buffer are written and synced
+     *
+     */
+    ~_write_ahead_log() noexcept {
+        try{commit();}
+        catch(...){}
+        ::close(fd);
+    }
+
+    _write_ahead_log(const _write_ahead_log&) = delete;
+    _write_ahead_log& operator=(const _write_ahead_log&) = delete;
+
+    /**
+     * @brief Append a record to the buffer, writing the buffer when it is full.
+     * It throws if a flush has failed
+     *
+     * @return the log sequence number of the record
+     */
+    std::uint64_t append(const char* record, std::size_t n){
+        std::unique_lock<std::mutex> guard{lock};
+        _check();
+        buffer.insert(buffer.end(), record, record + n);
+        appended += n;
+        auto lsn = appended;
+        if(buffer.size() >= max_buffer){_drain(guard, lsn, false);}
+        return lsn;
+    }
+
+    /**
+     * @brief Wait until the record with the given log sequence number is on
+     * the disk. It throws if a flush failed before the record got there
+     */
+    void wait(std::uint64_t lsn){
+        std::unique_lock<std::mutex> guard{lock};
+        _drain(guard, lsn, true);
+    }
+
+    /**
+     * @brief Wait until all the records appended so far are on the disk
+     */
+    void commit(){
+        std::unique_lock<std::mutex> guard{lock};
+        _drain(guard, appended, true);
+    }
+
+    /**
+     * @brief Drop all the records, e.g. because a checkpoint contains them:
+     * they count as durable for the writers still waiting. A failed log
+     * stays failed: it throws
+     */
+    void reset(){
+        std::unique_lock<std::mutex> guard{lock};
+        while(flushing){flushed.wait(guard);}
+        _check();
+        if(ftruncate(fd, 0) != 0 || fdatasync(fd) != 0){
+            throw std::runtime_error{std::string{"cannot truncate the log: "} + std::strerror(errno)};
+        }
+        buffer.clear();
+        length = 0;
+        written = durable = appended;
+        flushed.notify_all();
+    }
+
+    /**
+     * @return the number of bytes appended since the log was opened
+     */
+    std::uint64_t size() noexcept {
+        std::lock_guard<std::mutex> guard{lock};
+        return appended;
+    }
+};
+
+
+template <typename k_t, typename v_t, typename OP = std::less<k_t>, typename BAL = red_black,
+          typename Alloc = std::allocator<std::pair<k_t,v_t>> >
+class durable_bst{
+
+    using tree = bst<k_t,v_t,OP,BAL,Alloc>;
+
+    /**
+     * @brief Kind of a log record: the key follows, then the value (not
+     * for erase), then the checksum of all the previous bytes
+     */
+    enum record_type: char {insert_record = 1, assign_record = 2, erase_record = 3};
+
+    static constexpr std::size_t key_record = 1 + sizeof(k_t) + sizeof(std::uint32_t);
+    static constexpr std::size_t pair_record = key_record + sizeof(v_t);
+
+    /**
+     * @brief Private variables
+     */
+    tree t;
+    mutable std::mutex lock;
+    std::string snapshot;
+    durability mode;
+    _write_ahead_log log;
+
+    /**
+     * @brief Auxiliary function of the ctor: load the last checkpoint,
+     * if any, and apply the complete records of the log
+     *
+     * @return the number of bytes of the log holding complete records
+     */
+    std::uint64_t _recover(const std::string& log_path){
+        _snapshot_types<k_t,v_t>{};
+        struct stat st;
+        if(stat(snapshot.c_str(), &st) == 0){t.load(snapshot);}
+
+        std::ifstream is{log_path, std::ios::binary};
+        std::vector<char> bytes{std::istreambuf_iterator<char>{is}, std::istreambuf_iterator<char>{}};
+        std::uint64_t valid = 0;
+        while(valid < bytes.size()){
+            auto record = bytes.data() + valid;
+            auto type = record[0];
+            std::size_t n = pair_record;
+            if(type == erase_record){n = key_record;}
+            if((type != insert_record && type != assign_record && type != erase_record)
+               || bytes.size() - valid < n){break;}             // an incomplete record at the end
+            std::uint32_t checksum;
+            std::memcpy(&checksum, record + n - sizeof(checksum), sizeof(checksum));
+            if(checksum != _fnv1a(record, n - sizeof(checksum))){break;}
+
+            std::pair<k_t,v_t> x;
+            std::memcpy(&x.first, record + 1, sizeof(k_t));
+            if(type == erase_record){
+                if(t.find(x.first) != t.end()){t.erase(x.first);}
+            }
+            else{
+                std::memcpy(&x.second, record + 1 + sizeof(k_t), sizeof(v_t));
+                if(type == insert_record){t.insert(x);}
+                else{t.insert_or_assign(x.first, x.second);}
+            }
+            valid += n;
+        }
+        return valid;
+    }
+
+    /**
+     * @brief Auxiliary function: append the record of an update, with the tree locked
+     *
+     * @return the log sequence number of the record
+     */
+    std::uint64_t _append(record_type type, const k_t& key, const v_t* value){
+        char record[pair_record];
+        std::size_t n = pair_record;
+        if(!value){n = key_record;}
+        record[0] = type;
+        std::memcpy(record + 1, &key, sizeof(k_t));
+        if(value){std::memcpy(record + 1 + sizeof(k_t), value, sizeof(v_t));}
+        std::uint32_t checksum = _fnv1a(record, n - sizeof(std::uint32_t));
+        std::memcpy(record + n - sizeof(checksum), &checksum, sizeof(checksum));
+        return log.append(record, n);
+    }
+
+    /**
+     * @brief Auxiliary function: return once the update is as durable as required
+     */
+    void _wait(std::uint64_t lsn){
+        if(mode == durability::every_update){log.wait(lsn);}
+    }
+
+public:
+
+    /**
+     * @brief The result of operator[]: assigning to it is a logged insert_or_assign,
+     * reading it returns a copy of the value
+     */
+    class reference{
+        durable_bst* tree;
+        k_t key;
+
+    public:
+        reference(durable_bst* t, const k_t& k): tree{t}, key{k} {}
+
+        reference& operator=(const v_t& value){
+            tree->insert_or_assign(key, value);
+            return *this;
+        }
+
+        reference& operator=(const reference& x){return *this = static_cast<v_t>(x);}
+
+        operator v_t() const {
+            v_t value{};
+            if(!tree->find(key, value)){tree->insert(std::pair<k_t,v_t>{key, value});}
+            return value;
+        }
+    };
+
+    /**
+     * @brief Custom ctor: the tree is recovered from the last checkpoint
+     * and the log, then the log is opened for appending
+     *
+     * @param snapshot_path name of the checkpoint file
+     * @param log_path name of the log file
+     * @param m when the updates are on the disk
+     * @param a the allocator of the tree
+     */
+    durable_bst(const std::string& snapshot_path, const std::string& log_path,
+                durability m = durability::every_update, const Alloc& a = Alloc{}):
+        t{a}, snapshot{snapshot_path}, mode{m}, log{log_path, _recover(log_path)} {}
+
+    durable_bst(const durable_bst&) = delete;
+    durable_bst& operator=(const durable_bst&) = delete;
+
+    /**
+     * @brief Insert a new pair, unless its key is already present
+     *
+     * @return true if the pair has been inserted
+     */
+    bool insert(const std::pair<k_t,v_t>& x){
+        std::uint64_t lsn;
+        {
+            std::lock_guard<std::mutex> guard{lock};
+            if(!t.insert(x).second){return false;}
+            lsn = _append(insert_record, x.first, &x.second);
+        }
+        _wait(lsn);
+        return true;
+    }
+
+    /**
+     * @brief Construct a pair from the given args and insert it, unless its key is already present
+     *
+     * @return true if the pair has been inserted
+     */
+    template <typename... Types>
+    bool emplace(Types&&... args){return insert(std::pair<k_t,v_t>(std::forward<Types>(args)...));}
+
+    /**
+     * @brief Insert a new pair or overwrite the value of its key
+     *
+     * @return true if the pair has been inserted, false if it has been assigned
+     */
+    bool insert_or_assign(const k_t& k, const v_t& v){
+        std::uint64_t lsn;
+        bool inserted;
+        {
+            std::lock_guard<std::mutex> guard{lock};
+            inserted = t.insert_or_assign(k, v).second;
+            lsn = _append(assign_record, k, &v);
+        }
+        _wait(lsn);
+        return inserted;
+    }
+
+    /**
+     * @brief Removes the pair (if one exists) with the key equivalent to x
+     *
+     * @return true if the key was present
+     */
+    bool erase(const k_t& x){
+        std::uint64_t lsn;
+        {
+            std::lock_guard<std::mutex> guard{lock};
+            if(t.find(x) == t.end()){return false;}
+            t.erase(x);
+            lsn = _append(erase_record, x, nullptr);
+        }
+        _wait(lsn);
+        return true;
+    }
+
+    /**
+     * @brief Subscripting operator: the value of the key, which is
+     * inserted with the default value when it is read and missing
+     */
+    reference operator[](const k_t& x) {return reference{this, x};}
+
+    /**
+     * @brief Look for a key
+     *
+     * @param x the key
+     * @param value set to a copy of the value of x, if present
+     * @return true if the key is present
+     */
+    bool find(const k_t& x, v_t& value) const {
+        std::lock_guard<std::mutex> guard{lock};
+        auto i = t.find(x);
+        if(i == t.end()){return false;}
+        value = i.value();
+        return true;
+    }
+
+    /**
+     * @return true if the key is present
+     */
+    bool contains(const k_t& x) const {
+        std::lock_guard<std::mutex> guard{lock};
+        return t.find(x) != t.end();
+    }
+
+    /**
+     * @return the number of pairs
+     */
+    std::size_t size() const {
+        std::lock_guard<std::mutex> guard{lock};
+        return t.size();
+    }
+
+    /**
+     * @brief Call f(key, value) on all the pairs in order of key, with the tree locked
+     */
+    template <typename F>
+    void for_each(F&& f) const {
+        std::lock_guard<std::mutex> guard{lock};
+        for(auto i = t.cbegin(); i != t.cend(); ++i){f(*i, i.value());}
+    }
+
+    /**
+     * @brief Wait until all the updates so far are on the disk
+     */
+    void commit(){log.commit();}
+
+    /**
+     * @brief Write the whole tree to the checkpoint file and truncate the
+     * log, whose records it contains. save already makes the file durable
+     * before renaming it and then syncs the directory, so the log is
+     * truncated only once the new checkpoint has reached the disk
+     */
+    void checkpoint(){
+        std::lock_guard<std::mutex> guard{lock};
+        t.save(snapshot);
+        log.reset();
+    }
+
+    /**
+     * @return the number of bytes appended to the log since it was opened
+     */
+    std::uint64_t log_size() {return log.size();}
+
+    /**
+     * @brief Overload of operator put to
+     */
+    friend
+    std::ostream& operator<<(std::ostream& os, const durable_bst& x){
+        std::lock_guard<std::mutex> guard{x.lock};
+        return os << x.t;
+    }
+};
+
+#endif
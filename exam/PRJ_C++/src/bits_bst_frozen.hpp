@@ -0,0 +1,286 @@
+#ifndef _BITS_BST_FROZEN_
+#define _BITS_BST_FROZEN_
+
+#include <cstdint>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+/**
+ * Header for class frozen bst, an immutable snapshot of a bst
+ * (see bst::freeze) laid out for fast lookups.
+ * The keys are stored in a contiguous array in Eytzinger (BFS) order:
+ * the root is in position 1 and the children of the node in position i
+ * are in positions 2i and 2i+1, so that the first levels of the tree
+ * share a few cache lines and the next ones can be prefetched.
+ * The values are stored in a separate array, in the same order,
+ * so that a lookup only touches the keys.
+ *
+ * @tparam k_t template for the key type
+ * @tparam v_t template for the value type
+ * @tparam OP template for the total order relation; default is std::less<k_t>
+ */
+
+
+template <typename k_t, typename v_t, typename OP> class frozen_bst;
+
+
+/**
+ * Header for class frozen iterator.
+ * It traverses the frozen bst inorder, moving between
+ * positions of the implicit tree.
+ *
+ * @tparam k_t template for the key type
+ * @tparam v_t template for the value type
+ * @tparam OP template for the total order relation
+ */
+template <typename k_t, typename v_t, typename OP>
+class _frozen_iterator{
+
+    /**
+     * @brief pointer to the snapshot and position (1-based) of the node; 0 is end()
+     *
+     */
+    const frozen_bst<k_t,v_t,OP>* tree;
+    std::size_t current;
+
+public:
+    using value_type = const k_t;
+    using difference_type = std::ptrdiff_t;
+    using iterator_category = std::forward_iterator_tag;
+    using reference = value_type&;
+    using pointer = value_type*;
+
+    /**
+     * @brief Default ctor
+     *
+     */
+    _frozen_iterator() noexcept = default;
+
+    /**
+     * @brief Custom ctor
+     *
+     * @param t pointer to the snapshot
+     * @param i position of the node
+     */
+    _frozen_iterator(const frozen_bst<k_t,v_t,OP>* t, std::size_t i) noexcept: tree{t}, current{i} {}
+
+    /**
+     * @brief Overloading of the preincrement operator
+     *
+     * @return an iterator pointing to the next node, wrt the inorder relation
+     */
+    _frozen_iterator& operator++() noexcept {
+        auto n = tree->size();
+        if(2*current + 1 <= n){                 // the left most node of the right subtree
+            current = 2*current + 1;
+            while(2*current <= n){current *= 2;}
+        }
+        else{                                   // go up until we come from a left child
+            while(current & 1){current >>= 1;}
+            current >>= 1;
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Overloading of post increment operator
+     */
+    _frozen_iterator operator++(int) noexcept {
+        auto tmp{*this};
+        ++(*this);
+        return tmp;
+    }
+
+    /**
+     * @return the key of the node the iterator points to
+     */
+    reference operator*() const noexcept {return tree->keys[current - 1];}
+
+    /**
+     * @return a pointer to the key of the node the iterator points to
+     */
+    pointer operator->() const noexcept {return &**this;}
+
+    /**
+     * @return a const reference to the value of the key of the pointed node
+     */
+    const v_t& value() const noexcept {return tree->values[current - 1];}
+
+    /**
+     * @return the position of the node in the Eytzinger order (0 is end())
+     */
+    std::size_t where() const noexcept {return current;}
+
+    friend
+    bool operator==(const _frozen_iterator& a, const _frozen_iterator& b) noexcept {
+        return a.current == b.current;
+    }
+
+    friend
+    bool operator!=(const _frozen_iterator& a, const _frozen_iterator& b) noexcept {return !(a == b);}
+};
+
+
+template <typename k_t, typename v_t, typename OP = std::less<k_t> >
+class frozen_bst{
+
+    friend class _frozen_iterator<k_t,v_t,OP>;
+
+    /**
+     * @brief Private variables
+     */
+    std::vector<k_t> keys;          // keys[i-1] is the key in position i
+    std::vector<v_t> values;
+    OP cmp;
+
+    /**
+     * @brief Auxiliary function to compute the Eytzinger layout: it visits
+     * the implicit tree inorder, assigning to each position its rank
+     *
+     * @param rank rank of the position (output)
+     * @param i current position
+     * @param next next rank to assign
+     */
+    static void _ranks(std::vector<std::size_t>& rank, std::size_t i, std::size_t& next){
+        if(i > rank.size()){return;}
+        _ranks(rank, 2*i, next);
+        rank[i - 1] = next++;
+        _ranks(rank, 2*i + 1, next);
+    }
+
+    /**
+     * @brief Auxiliary function: branch-free descent of the implicit tree.
+     * At every level we move to the right child if the key is smaller than x,
+     * so that the position of the first key not smaller than x is the last
+     * node where we moved to the left: it is recovered by dropping the
+     * trailing right moves (the trailing ones of i) and the last left move
+     *
+     * @param x key to look for
+     * @return position of the first key not smaller than x, 0 if there is none
+     */
+    std::size_t _lower_bound(const k_t& x) const noexcept {
+        auto n = keys.size();
+        auto base = keys.data();
+        std::size_t i = 1;
+        while(i <= n){
+#if defined(__GNUC__)
+            // the 16 descendants four levels below are contiguous: fetch them in advance
+            __builtin_prefetch(reinterpret_cast<const char*>(base) + 16 * i * sizeof(k_t));
+#endif
+            i = 2*i + static_cast<std::size_t>(cmp(base[i - 1], x));
+        }
+#if defined(__GNUC__)
+        i >>= __builtin_ffsll(static_cast<long long>(~i));
+#else
+        while(i & 1){i >>= 1;}
+        i >>= 1;
+#endif
+        return i;
+    }
+
+public:
+    using const_iterator = _frozen_iterator<k_t,v_t,OP>;
+
+    /**
+     * @brief Default ctor
+     *
+     */
+    frozen_bst() noexcept = default;
+
+    /**
+     * @brief Custom ctor, used by bst::freeze
+     *
+     * @param first iterator of a bst to its smallest key
+     * @param last iterator of a bst to one past its last key
+     * @param c the total order relation
+     */
+    template <typename It>
+    frozen_bst(It first, It last, const OP& c = OP{}): cmp{c} {
+        std::vector<It> sorted;
+        for(; first != last; ++first){sorted.push_back(first);}
+
+        std::vector<std::size_t> rank(sorted.size());
+        std::size_t next = 0;
+        _ranks(rank, 1, next);
+
+        keys.reserve(sorted.size());
+        values.reserve(sorted.size());
+        for(auto r : rank){
+            keys.push_back(*sorted[r]);
+            values.push_back(sorted[r].value());
+        }
+    }
+
+    /**
+     * @return the number of keys
+     */
+    std::size_t size() const noexcept {return keys.size();}
+
+    /**
+     * @return true if there are no keys
+     */
+    bool empty() const noexcept {return keys.empty();}
+
+    /**
+     * @return const_iterator to the smallest key
+     */
+    const_iterator begin() const noexcept {
+        std::size_t i = keys.empty() ? 0 : 1;
+        while(2*i <= keys.size() && i){i *= 2;}
+        return const_iterator{this, i};
+    }
+
+    /**
+     * @return const_iterator to the smallest key
+     */
+    const_iterator cbegin() const noexcept {return begin();}
+
+    /**
+     * @return const_iterator to one past the last key
+     */
+    const_iterator end() const noexcept {return const_iterator{this, 0};}
+
+    /**
+     * @return const_iterator to one past the last key
+     */
+    const_iterator cend() const noexcept {return end();}
+
+    /**
+     * @brief Find the first key that is not smaller than x
+     *
+     * @param x key to look for
+     * @return const_iterator to such key or end()
+     */
+    const_iterator lower_bound(const k_t& x) const noexcept {return const_iterator{this, _lower_bound(x)};}
+
+    /**
+     * @brief Find a given key. If the key is present, returns an iterator to it, end() otherwise.
+     *
+     * @param x key to look for
+     * @return const_iterator to the key or to one past the last key
+     */
+    const_iterator find(const k_t& x) const noexcept {
+        auto i = _lower_bound(x);
+        if(i && !cmp(x, keys[i - 1])){return const_iterator{this, i};}
+        return end();
+    }
+
+    /**
+     * @brief Overload of operator put to
+     */
+    friend
+    std::ostream& operator<<(std::ostream& os, const frozen_bst& x){
+        if(x.empty()){os << "WARNING: empty tree"; return os;}
+
+        for(auto& key : x){
+            os << key << " ";
+        }
+        os << std::endl;
+        return os;
+    }
+};
+
+#endif
@@ -4,36 +4,42 @@
 #include <iterator>
 #include <utility>
 #include <memory>
+#include <type_traits>
 
 #include "bits_bst_node.hpp"
 
 /**
  * Header for class iterator. 
  * It is a subclass of the bst.
- * It contains a raw pointer to a node
+ * It contains a raw pointer to a node and a pointer to the right most
+ * node of the tree (owned by the bst), so that end() can be decremented
  * 
  * @tparam O template for the iterator
  * @tparam k_t template for the key type of node
  * @tparam v_t template for the value type of node
+ * @tparam M template for the monoid of the node (see augmented), void if none
+ * @tparam Counted whether the node keeps the size of its subtree (see order_statistic)
  */
 
 // ITERATOR CLASS
-template <typename O, typename k_t, typename v_t>
+template <typename O, typename k_t, typename v_t, typename M = void, bool Counted = false>
 class _iterator{
     
-    using node = _node<k_t,v_t>;
+    using node = _node<k_t,v_t,M,Counted>;
 
     /**
      * @brief pointer to the node
      * 
      */
     node* current;              // iterator is basically a (raw)ptr to node
+    node* const* last;          // the right most node of the bst, for the decrement of end()
 
+    template <typename, typename, typename, typename, bool> friend class _iterator;
 
 public:
     using value_type = O;
     using difference_type = std::ptrdiff_t;
-    using iterator_category = std::forward_iterator_tag;
+    using iterator_category = std::bidirectional_iterator_tag;
     using reference = value_type&;
     using pointer = value_type*;
 
@@ -45,12 +51,21 @@ public:
     _iterator() noexcept = default;
 
     /**
-     * @brief Custom ctor, no implicit conversion
+     * @brief Custom ctor
      * 
      * @param x pointer to a node
+     * @param right_most pointer to the right most node of the bst
      * @return an iterator pointing to x
      */
-    explicit _iterator(node* x) noexcept: current{x} {}
+    _iterator(node* x, node* const* right_most) noexcept: current{x}, last{right_most} {}
+
+    /**
+     * @brief Conversion from iterator to const_iterator
+     * 
+     * @param x an iterator on non-const keys
+     */
+    template <typename P, typename = typename std::enable_if<std::is_same<O, const P>::value>::type>
+    _iterator(const _iterator<P,k_t,v_t,M,Counted>& x) noexcept: current{x.current}, last{x.last} {}
 
     /**
      * @brief Defaul dtor
@@ -116,6 +131,45 @@ public:
     }
 
 
+    /**
+     * @brief Overloading of the predecrement operator, mirror of the preincrement:
+     * the previous node is the right most one of the left subtree, if any,
+     * otherwise the first ancestor we reach from its right subtree.
+     * Decrementing end() gives the right most node of the bst
+     * 
+     * @return an iterator pointing to the previous node in the bst, wrt the inorder relation
+     */
+    _iterator& operator--() noexcept{
+        if(!current){
+            current = *last;
+        }
+        else if(current->left){
+            current = current->left.get();
+            while(current->right){
+                current = current->right.get();
+            }
+        }
+        else{
+            auto tmp = current->parent;
+            while(tmp && current != tmp->right.get()){
+                current = tmp;
+                tmp = tmp->parent;
+            }
+            current = tmp;
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Overloading of post decrement operator
+     */
+    _iterator operator--(int) noexcept{
+        auto tmp{*this};
+        --(*this);
+        return tmp;
+    }
+
+
     /**
      * @brief Overloading of operator ->
      * 
@@ -132,9 +186,11 @@ public:
     reference operator*() const noexcept {return current->_pair.first;}
 
     /**
-     * @return a reference to the value of the key of the pointed node 
+     * @return a reference to the value of the key of the pointed node;
+     * a const one if the tree is augmented, since the summaries of the
+     * nodes above depend on it (the bst changes it, see insert_or_assign)
      */
-    v_t& value() {return current->_pair.second;}
+    typename std::conditional<std::is_void<M>::value, v_t&, const v_t&>::type value() {return current->_pair.second;}
 
     /**
      * @return a const reference to the value of the key of the pointed node
@@ -167,4 +223,27 @@ public:
     bool operator!=(const _iterator& a, const _iterator& b) noexcept {return !(a == b);}
 };
 
+
+/**
+ * Header for class reverse iterator.
+ * It is a std::reverse_iterator that also gives access to the value
+ * of the pointed key, like the iterators of the bst
+ * 
+ * @tparam It template for the underlying bidirectional iterator
+ */
+template <typename It>
+class _reverse_iterator: public std::reverse_iterator<It>{
+
+public:
+    using std::reverse_iterator<It>::reverse_iterator;
+
+    /**
+     * @return a reference to the value of the key the iterator points to
+     */
+    decltype(auto) value() const {
+        auto tmp = this->base();
+        return (--tmp).value();
+    }
+};
+
 #endif
\ No newline at end of file
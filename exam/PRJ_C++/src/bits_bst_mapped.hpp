@@ -0,0 +1,703 @@
+#ifndef _BITS_BST_MAPPED_
+#define _BITS_BST_MAPPED_
+
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "bits_bst_snapshot.hpp"
+
+/**
+ * Header for class mapped bst, a bst that lives in a memory-mapped file.
+ * The nodes refer to each other by their offset from the start of the
+ * file (0 is nullptr) instead of by pointers, so that the file can be
+ * mapped at any address: reopening the tree after a restart costs an
+ * mmap, and the pages are read from the disk only when they are touched.
+ *
+ * The file starts with a header (the root, the number of pairs and the
+ * state of the allocator), followed by an array of node slots. A new
+ * node takes the first slot of a free list threaded through the erased
+ * ones or, if there is none, the next never used slot; when the slots
+ * run out the file is doubled and mapped again.
+ * The tree is kept balanced with the AVL rules; the keys and values must
+ * be trivially copyable, since they are stored as they are in memory.
+ *
+ * The changes reach the file through the page cache; sync makes them
+ * durable against a crash of the system, and so does closing the tree.
+ * The header has a dirty flag, set on the disk before the first change
+ * after a sync and cleared by the next sync: a file that is still dirty
+ * when it is opened was left by a crash in between, when any part of the
+ * changes may be missing, so it is refused rather than trusted.
+ * The file is locked: only one mapped bst at a time can open it.
+ *
+ * @tparam k_t template for the key type
+ * @tparam v_t template for the value type
+ * @tparam OP template for the total order relation; default is std::less<k_t>
+ */
+
+
+/**
+ * @brief Header of a mapped bst file
+ */
+struct _mapped_header{
+    char magic[8];                  // "bstmap" and the version of the format
+    std::uint32_t order;            // _snapshot_order as written, to detect a different byte order
+    std::uint32_t key_size;
+    std::uint32_t value_size;
+    std::uint32_t node_size;
+    std::uint64_t capacity;         // size of the file
+    std::uint64_t next;             // offset of the first never used slot
+    std::uint64_t free_list;        // offset of the first erased slot, 0 if none
+    std::uint64_t root;
+    std::uint64_t items;
+    std::uint64_t dirty;            // 1 from the first change after a sync to the next sync
+};
+
+static constexpr char _mapped_magic[8] = {'b', 's', 't', 'm', 'a', 'p', '0', '2'};
+
+/**
+ * @brief Node of a mapped bst: the links are offsets from the start of the file.
+ * An erased node keeps the offset of the next free slot in left
+ */
+template <typename k_t, typename v_t>
+struct _mapped_node{
+    k_t key;
+    v_t value;
+    std::uint64_t left;
+    std::uint64_t right;
+    std::uint64_t parent;
+    std::int32_t height;
+};
+
+
+template <typename k_t, typename v_t, typename OP> class mapped_bst;
+
+
+/**
+ * Header for class mapped iterator of a mapped bst.
+ * It keeps the offset of the node, which stays valid when the file is
+ * mapped again at another address.
+ *
+ * @tparam k_t template for the key type
+ * @tparam v_t template for the value type
+ * @tparam OP template for the total order relation
+ */
+template <typename k_t, typename v_t, typename OP>
+class _mapped_bst_iterator{
+
+    /**
+     * @brief pointer to the tree and offset of the node; 0 is end()
+     *
+     */
+    const mapped_bst<k_t,v_t,OP>* tree;
+    std::uint64_t current;
+
+public:
+    using value_type = const k_t;
+    using difference_type = std::ptrdiff_t;
+    using iterator_category = std::forward_iterator_tag;
+    using reference = value_type&;
+    using pointer = value_type*;
+
+    /**
+     * @brief Default ctor
+     *
+     */
+    _mapped_bst_iterator() noexcept = default;
+
+    /**
+     * @brief Custom ctor
+     *
+     * @param t pointer to the tree
+     * @param x offset of the node
+     */
+    _mapped_bst_iterator(const mapped_bst<k_t,v_t,OP>* t, std::uint64_t x) noexcept: tree{t}, current{x} {}
+
+    /**
+     * @brief Overloading of the preincrement operator: the left most node
+     * of the right subtree, if any, otherwise the first ancestor we reach
+     * from its left subtree
+     *
+     * @return an iterator pointing to the next node, wrt the inorder relation
+     */
+    _mapped_bst_iterator& operator++() noexcept {
+        auto x = tree->_at(current);
+        if(x->right){
+            current = x->right;
+            while(tree->_at(current)->left){current = tree->_at(current)->left;}
+            return *this;
+        }
+        while(x->parent && tree->_at(x->parent)->right == current){
+            current = x->parent;
+            x = tree->_at(current);
+        }
+        current = x->parent;
+        return *this;
+    }
+
+    /**
+     * @brief Overloading of post increment operator
+     */
+    _mapped_bst_iterator operator++(int) noexcept {
+        auto tmp{*this};
+        ++(*this);
+        return tmp;
+    }
+
+    /**
+     * @return the key of the node the iterator points to
+     */
+    reference operator*() const noexcept {return tree->_at(current)->key;}
+
+    /**
+     * @return a pointer to the key of the node the iterator points to
+     */
+    pointer operator->() const noexcept {return &**this;}
+
+    /**
+     * @return a const reference to the value of the pointed node
+     */
+    const v_t& value() const noexcept {return tree->_at(current)->value;}
+
+    /**
+     * @return the offset of the node in the file (0 is end())
+     */
+    std::uint64_t where() const noexcept {return current;}
+
+    friend
+    bool operator==(const _mapped_bst_iterator& a, const _mapped_bst_iterator& b) noexcept {
+        return a.current == b.current;
+    }
+
+    friend
+    bool operator!=(const _mapped_bst_iterator& a, const _mapped_bst_iterator& b) noexcept {return !(a == b);}
+};
+
+
+template <typename k_t, typename v_t, typename OP = std::less<k_t> >
+class mapped_bst{
+
+    friend class _mapped_bst_iterator<k_t,v_t,OP>;
+
+    using node = _mapped_node<k_t,v_t>;
+
+    static constexpr std::uint64_t first_slot = 128;        // the header, in the first two cache lines
+    static constexpr std::uint64_t first_capacity = first_slot + 64 * sizeof(node);
+
+    static_assert(sizeof(_mapped_header) <= first_slot, "the header must fit before the first slot");
+
+    /**
+     * @brief Private variables
+     */
+    int fd{-1};
+    char* map{nullptr};             // the mapping of the whole file
+    std::size_t length{0};
+    OP cmp;
+
+    /**
+     * @return the header at the start of the file
+     */
+    _mapped_header* _header() const noexcept {return reinterpret_cast<_mapped_header*>(map);}
+
+    /**
+     * @param x offset of a node
+     * @return pointer to the node, valid until the file is mapped again
+     */
+    node* _at(std::uint64_t x) const noexcept {return reinterpret_cast<node*>(map + x);}
+
+    /**
+     * @return height of the subtree rooted in the node at offset x (0 if x is 0)
+     */
+    std::int32_t _height(std::uint64_t x) const noexcept {return x ? _at(x)->height : 0;}
+
+    /**
+     * @brief Auxiliary function: write the header back and wait for the disk
+     */
+    bool _sync_header() noexcept {return msync(map, first_slot, MS_SYNC) == 0;}
+
+    /**
+     * @brief Auxiliary function, called before every change: the first
+     * change after a sync marks the file dirty, and the mark reaches the
+     * disk before any of the changes can
+     */
+    void _touch(){
+        auto h = _header();
+        if(h->dirty){return;}
+        h->dirty = 1;
+        if(!_sync_header()){
+            h->dirty = 0;
+            throw std::runtime_error{std::string{"cannot mark the tree dirty: "} + std::strerror(errno)};
+        }
+    }
+
+    /**
+     * @brief Auxiliary function: map the whole file, whose size is length
+     */
+    void _map(){
+        auto p = mmap(nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        if(p == MAP_FAILED){throw std::runtime_error{std::string{"cannot map the tree: "} + std::strerror(errno)};}
+        map = static_cast<char*>(p);
+    }
+
+    /**
+     * @brief Auxiliary function: double the file and map it again.
+     * The nodes keep their offsets, so only the pointers into the old
+     * mapping become invalid
+     */
+    void _grow(){
+        auto capacity = _header()->capacity * 2;
+        if(ftruncate(fd, static_cast<off_t>(capacity)) != 0){throw std::bad_alloc{};}
+        munmap(map, length);
+        map = nullptr;
+        length = static_cast<std::size_t>(capacity);
+        _map();
+        _header()->capacity = capacity;
+    }
+
+    /**
+     * @brief Auxiliary function: the slot for a new node, from the free list
+     * or from the never used slots
+     *
+     * @return offset of the slot
+     */
+    std::uint64_t _allocate(){
+        auto h = _header();
+        if(h->free_list){
+            auto x = h->free_list;
+            h->free_list = _at(x)->left;
+            return x;
+        }
+        if(h->next + sizeof(node) > h->capacity){
+            _grow();
+            h = _header();
+        }
+        auto x = h->next;
+        h->next += sizeof(node);
+        return x;
+    }
+
+    /**
+     * @brief Auxiliary function: put a slot back into the free list
+     */
+    void _deallocate(std::uint64_t x) noexcept {
+        _at(x)->left = _header()->free_list;
+        _header()->free_list = x;
+    }
+
+    /**
+     * @brief Auxiliary function: the child old of p is replaced by x (the root, if p is 0)
+     */
+    void _replace_child(std::uint64_t p, std::uint64_t old, std::uint64_t x) noexcept {
+        if(!p){_header()->root = x;}
+        else if(_at(p)->left == old){_at(p)->left = x;}
+        else{_at(p)->right = x;}
+        if(x){_at(x)->parent = p;}
+    }
+
+    /**
+     * @brief Left rotation around x, as in bits_bst_balance.hpp:
+     * the right child of x takes its place
+     */
+    void _rotate_left(std::uint64_t x) noexcept {
+        auto y = _at(x)->right;
+        auto b = _at(y)->left;
+        _replace_child(_at(x)->parent, x, y);
+        _at(x)->right = b;
+        if(b){_at(b)->parent = x;}
+        _at(y)->left = x;
+        _at(x)->parent = y;
+    }
+
+    /**
+     * @brief Right rotation around x, mirror of _rotate_left
+     */
+    void _rotate_right(std::uint64_t x) noexcept {
+        auto y = _at(x)->left;
+        auto b = _at(y)->right;
+        _replace_child(_at(x)->parent, x, y);
+        _at(x)->left = b;
+        if(b){_at(b)->parent = x;}
+        _at(y)->right = x;
+        _at(x)->parent = y;
+    }
+
+    /**
+     * @brief Recompute the height of the node at offset x from its children
+     */
+    void _update(std::uint64_t x) noexcept {
+        auto l = _height(_at(x)->left);
+        auto r = _height(_at(x)->right);
+        _at(x)->height = 1 + (l > r ? l : r);
+    }
+
+    /**
+     * @brief Walk from x up to the root updating the heights and rotating
+     * wherever the subtrees differ by two, as the avl policy does
+     */
+    void _retrace(std::uint64_t x) noexcept {
+        while(x){
+            auto factor = _height(_at(x)->left) - _height(_at(x)->right);
+
+            if(factor > 1){                                     // left heavy
+                auto l = _at(x)->left;
+                if(_height(_at(l)->left) < _height(_at(l)->right)){
+                    _rotate_left(l);                            // left-right case
+                    _update(l);
+                }
+                _rotate_right(x);
+            }
+            else if(factor < -1){                               // right heavy
+                auto r = _at(x)->right;
+                if(_height(_at(r)->right) < _height(_at(r)->left)){
+                    _rotate_right(r);                           // right-left case
+                    _update(r);
+                }
+                _rotate_left(x);
+            }
+
+            _update(x);
+            if(_at(x)->parent && (factor > 1 || factor < -1)){  // x has been moved down
+                x = _at(x)->parent;
+                _update(x);
+            }
+            x = _at(x)->parent;
+        }
+    }
+
+    /**
+     * @brief Auxiliary function: offset of the node with key equivalent to x,
+     * or of the node it would be attached to (0 if the tree is empty)
+     */
+    std::uint64_t _locate(const k_t& x) const noexcept {
+        std::uint64_t parent = 0;
+        for(auto y = _header()->root; y;){
+            parent = y;
+            if(cmp(x, _at(y)->key)){y = _at(y)->left;}
+            else if(cmp(_at(y)->key, x)){y = _at(y)->right;}
+            else{return y;}
+        }
+        return parent;
+    }
+
+    /**
+     * @brief Auxiliary function for insert and insert_or_assign
+     *
+     * @param x the pair
+     * @param assign whether the value of an existing key is overwritten
+     * @return true if a new node was created
+     */
+    bool _insert(const std::pair<k_t,v_t>& x, bool assign){
+        auto parent = _locate(x.first);
+        if(parent && !cmp(x.first, _at(parent)->key) && !cmp(_at(parent)->key, x.first)){
+            if(assign){
+                _touch();
+                _at(parent)->value = x.second;
+            }
+            return false;
+        }
+
+        _touch();
+        auto slot = _allocate();                                // the file may be mapped again
+        auto n = ::new(static_cast<void*>(_at(slot))) node{x.first, x.second, 0, 0, parent, 1};
+        if(!parent){_header()->root = slot;}
+        else if(cmp(n->key, _at(parent)->key)){_at(parent)->left = slot;}
+        else{_at(parent)->right = slot;}
+        ++_header()->items;
+        _retrace(parent);
+        return true;
+    }
+
+    /**
+     * @brief Auxiliary function: sync a dirty tree before it is closed;
+     * on failure it stays dirty
+     */
+    void _close_clean() noexcept {
+        if(map && _header()->dirty && msync(map, length, MS_SYNC) == 0){
+            _header()->dirty = 0;
+            _sync_header();
+        }
+        _close();
+    }
+
+    /**
+     * @brief Auxiliary function: give the mapping and the file back to the system
+     */
+    void _close() noexcept {
+        if(map){munmap(map, length);}
+        if(fd >= 0){::close(fd);}                               // the lock goes with the descriptor
+        map = nullptr;
+        length = 0;
+        fd = -1;
+    }
+
+public:
+    using const_iterator = _mapped_bst_iterator<k_t,v_t,OP>;
+
+    /**
+     * @brief Custom ctor: the file is opened, or created if it does not
+     * exist, locked and mapped. An existing file is checked against the
+     * types and refused if it is dirty; its tree is used as it is,
+     * without any reload
+     *
+     * @param path name of the file
+     * @param c the total order relation, the same the tree was built with
+     */
+    explicit mapped_bst(const std::string& path, const OP& c = OP{}): cmp{c} {
+        _snapshot_types<k_t,v_t>{};
+        fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+        if(fd < 0){throw std::runtime_error{"cannot open the tree " + path + ": " + std::strerror(errno)};}
+        if(flock(fd, LOCK_EX | LOCK_NB) != 0){
+            _close();
+            throw std::runtime_error{"the tree " + path + " is open elsewhere"};
+        }
+
+        struct stat st;
+        if(fstat(fd, &st) != 0){
+            _close();
+            throw std::runtime_error{"cannot open the tree " + path + ": " + std::strerror(errno)};
+        }
+        bool created = st.st_size == 0;
+        if(created && ftruncate(fd, static_cast<off_t>(first_capacity)) != 0){
+            _close();
+            throw std::runtime_error{"cannot create the tree " + path + ": " + std::strerror(errno)};
+        }
+        length = static_cast<std::size_t>(st.st_size);
+        if(created){length = first_capacity;}
+        if(length < first_slot){
+            _close();
+            throw std::runtime_error{"not a tree of these types: " + path};
+        }
+        try{_map();}
+        catch(...){
+            _close();
+            throw;
+        }
+
+        auto h = _header();
+        if(created){
+            std::memcpy(h->magic, _mapped_magic, sizeof(h->magic));
+            h->order = _snapshot_order;
+            h->key_size = sizeof(k_t);
+            h->value_size = sizeof(v_t);
+            h->node_size = sizeof(node);
+            h->capacity = first_capacity;
+            h->next = first_slot;
+            h->free_list = 0;
+            h->root = 0;
+            h->items = 0;
+            h->dirty = 0;
+        }
+        else if(std::memcmp(h->magic, _mapped_magic, sizeof(h->magic)) || h->order != _snapshot_order
+                || h->key_size != sizeof(k_t) || h->value_size != sizeof(v_t) || h->node_size != sizeof(node)
+                || h->capacity > length || h->next > h->capacity || h->root >= length || h->free_list >= length){
+            _close();
+            throw std::runtime_error{"not a tree of these types: " + path};
+        }
+        else if(h->dirty){
+            _close();
+            throw std::runtime_error{"the tree " + path + " was not synced before a crash and may be damaged"};
+        }
+    }
+
+    /**
+     * @brief Dtor, the changes not yet synced are synced and the file
+     * is unmapped and closed
+     *
+     */
+    ~mapped_bst() noexcept {_close_clean();}
+
+    mapped_bst(const mapped_bst&) = delete;
+    mapped_bst& operator=(const mapped_bst&) = delete;
+
+    /**
+     * @brief Move ctor, the file is stolen from x
+     */
+    mapped_bst(mapped_bst&& x) noexcept: fd{x.fd}, map{x.map}, length{x.length}, cmp{std::move(x.cmp)} {
+        x.fd = -1;
+        x.map = nullptr;
+        x.length = 0;
+    }
+
+    /**
+     * @brief Move assignment, the file of this tree is closed first
+     */
+    mapped_bst& operator=(mapped_bst&& x) noexcept {
+        if(this != &x){
+            _close_clean();
+            std::swap(fd, x.fd);
+            std::swap(map, x.map);
+            std::swap(length, x.length);
+            cmp = std::move(x.cmp);
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Insert a new pair, unless its key is already present
+     *
+     * @return true if the pair has been inserted
+     */
+    bool insert(const std::pair<k_t,v_t>& x) {return _insert(x, false);}
+
+    /**
+     * @brief Insert a new pair or overwrite the value of its key
+     *
+     * @return true if the pair has been inserted, false if it has been assigned
+     */
+    bool insert_or_assign(const k_t& k, const v_t& v) {return _insert(std::pair<k_t,v_t>{k, v}, true);}
+
+    /**
+     * @brief Removes the pair (if one exists) with the key equivalent to x.
+     * A node with two children takes the pair of its successor, which is
+     * removed instead; its slot goes to the free list
+     *
+     * @return true if the key was present
+     */
+    bool erase(const k_t& x){
+        auto z = _locate(x);
+        if(!z || cmp(x, _at(z)->key) || cmp(_at(z)->key, x)){return false;}
+
+        _touch();
+        auto removed = z;
+        if(_at(z)->left && _at(z)->right){
+            removed = _at(z)->right;
+            while(_at(removed)->left){removed = _at(removed)->left;}
+            _at(z)->key = _at(removed)->key;
+            _at(z)->value = _at(removed)->value;
+        }
+        auto parent = _at(removed)->parent;
+        auto child = _at(removed)->left ? _at(removed)->left : _at(removed)->right;
+        _replace_child(parent, removed, child);
+        _deallocate(removed);
+        --_header()->items;
+        _retrace(parent);
+        return true;
+    }
+
+    /**
+     * @brief Find a given key. If the key is present, returns an iterator to it, end() otherwise.
+     *
+     * @param x key to look for
+     * @return const_iterator to the key or to one past the last key
+     */
+    const_iterator find(const k_t& x) const noexcept {
+        auto y = _locate(x);
+        if(y && !cmp(x, _at(y)->key) && !cmp(_at(y)->key, x)){return const_iterator{this, y};}
+        return end();
+    }
+
+    /**
+     * @brief Find the first key that is not smaller than x
+     *
+     * @param x key to look for
+     * @return const_iterator to such key or end()
+     */
+    const_iterator lower_bound(const k_t& x) const noexcept {
+        std::uint64_t candidate = 0;
+        for(auto y = _header()->root; y;){
+            if(cmp(_at(y)->key, x)){y = _at(y)->right;}
+            else{
+                candidate = y;
+                y = _at(y)->left;
+            }
+        }
+        return const_iterator{this, candidate};
+    }
+
+    /**
+     * @return true if the key is present
+     */
+    bool contains(const k_t& x) const noexcept {return find(x) != end();}
+
+    /**
+     * @brief Write the changes back to the file and wait for the disk:
+     * after sync they survive a crash of the system. The dirty flag is
+     * cleared on the disk only once all the changes are there
+     */
+    void sync(){
+        if(!_header()->dirty){return;}
+        if(msync(map, length, MS_SYNC) != 0){
+            throw std::runtime_error{std::string{"cannot sync the tree: "} + std::strerror(errno)};
+        }
+        _header()->dirty = 0;
+        if(!_sync_header()){
+            throw std::runtime_error{std::string{"cannot sync the tree: "} + std::strerror(errno)};
+        }
+    }
+
+    /**
+     * @brief Clears the content of the tree, all the slots become never used;
+     * the file keeps its size
+     */
+    void clear(){
+        _touch();
+        auto h = _header();
+        h->next = first_slot;
+        h->free_list = 0;
+        h->root = 0;
+        h->items = 0;
+    }
+
+    /**
+     * @return the number of pairs
+     */
+    std::size_t size() const noexcept {return static_cast<std::size_t>(_header()->items);}
+
+    /**
+     * @return true if there are no pairs
+     */
+    bool empty() const noexcept {return size() == 0;}
+
+    /**
+     * @return const_iterator to the smallest key
+     */
+    const_iterator begin() const noexcept {
+        auto x = _header()->root;
+        while(x && _at(x)->left){x = _at(x)->left;}
+        return const_iterator{this, x};
+    }
+
+    /**
+     * @return const_iterator to the smallest key
+     */
+    const_iterator cbegin() const noexcept {return begin();}
+
+    /**
+     * @return const_iterator to one past the last key
+     */
+    const_iterator end() const noexcept {return const_iterator{this, 0};}
+
+    /**
+     * @return const_iterator to one past the last key
+     */
+    const_iterator cend() const noexcept {return end();}
+
+    /**
+     * @brief Overload of operator put to
+     */
+    friend
+    std::ostream& operator<<(std::ostream& os, const mapped_bst& x){
+        if(x.empty()){os << "WARNING: empty tree"; return os;}
+
+        for(auto& key : x){
+            os << key << " ";
+        }
+        os << std::endl;
+        return os;
+    }
+};
+
+#endif
@@ -1,9 +1,60 @@
 #ifndef _BITS_BST_NODE_
 #define _BITS_BST_NODE_
 
+#include <cstddef>
 #include <utility>
 #include <memory>
 
+/**
+ * @brief Deleter of the unique pointers between nodes.
+ * The nodes live in the node pool of the bst (see bits_bst_pool.hpp),
+ * which owns their memory: a unique pointer only destroys the node
+ * it points to, the memory is given back by the pool
+ */
+struct _node_destroy{
+    template <typename node>
+    void operator()(node* x) const noexcept {x->~node();}
+};
+
+
+/**
+ * @brief Tag to construct the pair of a node in place
+ */
+struct _in_place_t{};
+
+
+/**
+ * @brief Summary of the pairs in the subtree of a node, kept by the trees
+ * augmented with a monoid M (see augmented in bits_bst_balance.hpp)
+ */
+template <typename M>
+struct _summary{
+    typename M::type summary{M::identity()};
+};
+
+/**
+ * @brief Without a monoid the nodes have no summary, and no extra bytes
+ */
+template <>
+struct _summary<void>{};
+
+
+/**
+ * @brief Number of nodes in the subtree of a node, kept by the trees
+ * augmented with order_statistic (see bits_bst_balance.hpp)
+ */
+template <bool Counted>
+struct _subtree_count{
+    std::size_t size{1};
+};
+
+/**
+ * @brief Without order_statistic the nodes do not count their subtrees
+ */
+template <>
+struct _subtree_count<false>{};
+
+
 /**
  * Header for struct node, it contains a pair,
  * a unique pointer to each of its child node and
@@ -11,13 +62,21 @@
  * 
  * @tparam k_t template for the key type
  * @tparam v_t template for the value type
+ * @tparam M template for the monoid that summarizes the subtrees, void if none
+ * @tparam Counted whether the node keeps the size of its subtree
  */
 
 
 
 
-template <typename k_t, typename v_t >
-struct _node{
+template <typename k_t, typename v_t, typename M = void, bool Counted = false>
+struct _node: _summary<M>, _subtree_count<Counted>{
+
+    /**
+     * @brief Unique pointer to a child node
+     * 
+     */
+    using link = std::unique_ptr<_node, _node_destroy>;
 
     /**
      * @brief Pair of key and value
@@ -29,19 +88,26 @@ struct _node{
      * @brief Pointer to right child
      * 
      */
-    std::unique_ptr<_node> right;
+    link right;
 
     /**
      * @brief Pointer to left child
      * 
      */
-    std::unique_ptr<_node> left;
+    link left;
 
     /**
      * @brief Raw pointer to the parent node
      * 
      */
-    _node* parent;
+    _node* parent{nullptr};
+
+    /**
+     * @brief Balancing information, its meaning depends on
+     * the balancing policy of the bst (see bits_bst_balance.hpp)
+     * 
+     */
+    int meta{0};
              
 
     /**
@@ -66,29 +132,24 @@ struct _node{
     explicit _node(std::pair<k_t,v_t>&& pair) noexcept: _pair(std::move(pair)) {}     
 
     /**
-     * Custom ctor that takes as input a unique ptr to a node that must me copied
-     * and a raw ptr to what it's supposed to be its parent. It is a recursive
-     * ctor that will be later used in the copy semantics of the bst
+     * @brief Curstom ctor, the pair is constructed in place
+     * 
+     * @param args the arguments of the ctor of std::pair<k_t,v_t>
+     * @return a node containing the new pair
+     */
+    template <typename... Types>
+    explicit _node(_in_place_t, Types&&... args): _pair(std::forward<Types>(args)...) {}
+
+    /**
+     * Custom ctor that takes as input a node that must be copied
+     * and a raw ptr to what it's supposed to be its parent.
+     * The children are not copied: it is used by the bst,
+     * that takes care of them, in its copy semantics
      * 
-     * @param x Unique pointer to the node to copy from
+     * @param x node to copy from
      * @param parent Raw pointer to the parent node
      */
-    explicit _node(const std::unique_ptr<_node>& x, _node* parent)noexcept: _pair{x->_pair}, parent{parent}{
-            // take care of left and right children:
-
-            // on the right:
-            if(x->right){
-                right.reset(new _node{x->right,&*this});    // the children of the node have the node itself as parent
-            }
-            else{right.reset();}                            // for sake of completeness
-            // on the left:
-            if(x->left){
-                left.reset(new _node{x->left,&*this});
-            }
-            else{left.reset();}                             // for sake of completeness
-
-            // the idea is to call recursively the ctor (of node) on every side untill we meet a nullptr
-        }
+    explicit _node(const _node& x, _node* parent): _summary<M>(x), _subtree_count<Counted>(x), _pair{x._pair}, parent{parent}, meta{x.meta} {}
 
     /**
      * @brief Default dtor
@@ -0,0 +1,454 @@
+#ifndef _BITS_BST_PERSISTENT_
+#define _BITS_BST_PERSISTENT_
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * Header for class persistent bst, a bst whose versions share their nodes.
+ * The nodes are immutable and reference counted: copying a tree copies a
+ * pointer to its root, in constant time, and an update creates new copies
+ * of the nodes along the path to the modified key only, the rest of the
+ * tree is shared with the previous version (path copying).
+ * The tree is kept balanced with the AVL rules, so that every update
+ * creates O(log n) nodes and any number of snapshots can coexist.
+ *
+ * Since the shared nodes are never modified and their reference counts
+ * are atomic, different threads can use different versions, e.g. a
+ * writer can keep updating its tree while readers traverse its snapshots.
+ *
+ * @tparam k_t template for the key type
+ * @tparam v_t template for the value type
+ * @tparam OP template for the total order relation; default is std::less<k_t>
+ * @tparam Alloc template for the allocator of the nodes
+ */
+
+
+/**
+ * @brief Immutable node of the persistent bst
+ */
+template <typename k_t, typename v_t>
+struct _pnode{
+
+    using link = std::shared_ptr<const _pnode>;
+
+    std::pair<k_t,v_t> _pair;
+    link left;
+    link right;
+    int height;
+
+    template <typename P>
+    _pnode(P&& pair, link l, link r):
+        _pair(std::forward<P>(pair)), left{std::move(l)}, right{std::move(r)},
+        height{1 + std::max(left ? left->height : 0, right ? right->height : 0)} {}
+};
+
+
+/**
+ * Header for class persistent iterator.
+ * It traverses a version of the tree inorder, keeping the path from the
+ * root in a stack since the nodes have no parent pointer. It stays valid
+ * as long as a version containing its nodes is alive, even if the tree
+ * it comes from is updated in the meantime.
+ *
+ * @tparam k_t template for the key type
+ * @tparam v_t template for the value type
+ */
+template <typename k_t, typename v_t>
+class _persistent_iterator{
+
+    using node = _pnode<k_t,v_t>;
+
+    /**
+     * @brief The nodes whose left subtree is being visited; the top is the current node
+     */
+    std::vector<const node*> path;
+
+public:
+    using value_type = const k_t;
+    using difference_type = std::ptrdiff_t;
+    using iterator_category = std::forward_iterator_tag;
+    using reference = value_type&;
+    using pointer = value_type*;
+
+    _persistent_iterator() = default;
+
+    /**
+     * @brief Custom ctor
+     *
+     * @param p the path of the current node: its ancestors that are
+     * bigger than it, then the node itself (empty for end())
+     */
+    explicit _persistent_iterator(std::vector<const node*>&& p) noexcept: path{std::move(p)} {}
+
+    /**
+     * @brief Overloading of the preincrement operator
+     */
+    _persistent_iterator& operator++(){
+        auto x = path.back()->right.get();
+        path.pop_back();
+        for(; x; x = x->left.get()){path.push_back(x);}
+        return *this;
+    }
+
+    /**
+     * @brief Overloading of post increment operator
+     */
+    _persistent_iterator operator++(int){
+        auto tmp{*this};
+        ++(*this);
+        return tmp;
+    }
+
+    reference operator*() const noexcept {return path.back()->_pair.first;}
+
+    pointer operator->() const noexcept {return &**this;}
+
+    /**
+     * @return a const reference to the value of the key of the pointed node
+     */
+    const v_t& value() const noexcept {return path.back()->_pair.second;}
+
+    friend
+    bool operator==(const _persistent_iterator& a, const _persistent_iterator& b) noexcept {
+        if(a.path.empty() || b.path.empty()){return a.path.empty() && b.path.empty();}
+        return a.path.back() == b.path.back();
+    }
+
+    friend
+    bool operator!=(const _persistent_iterator& a, const _persistent_iterator& b) noexcept {return !(a == b);}
+};
+
+
+template <typename k_t, typename v_t, typename OP = std::less<k_t>,
+          typename Alloc = std::allocator<std::pair<k_t,v_t>> >
+class persistent_bst{
+
+    using node = _pnode<k_t,v_t>;
+    using link = typename node::link;
+    using alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<node>;
+
+    /**
+     * @brief Private variables
+     */
+    link root;
+    std::size_t items{0};
+    OP cmp;
+    alloc_t alloc;
+
+    static int _height(const link& x) noexcept {return x ? x->height : 0;}
+
+    /**
+     * @brief Create a new node, sharing the given children
+     */
+    template <typename P>
+    link _make(P&& pair, link l, link r) const {
+        return std::allocate_shared<node>(alloc, std::forward<P>(pair), std::move(l), std::move(r));
+    }
+
+    /**
+     * @brief Auxiliary function to create a node with the given pair and
+     * children, whose heights differ at most by two, restoring the AVL
+     * property with a single or a double rotation. Only the new nodes
+     * are created: the subtrees below them are shared
+     */
+    template <typename P>
+    link _balance(P&& pair, link l, link r) const {
+        auto hl = _height(l);
+        auto hr = _height(r);
+        if(hl > hr + 1){
+            if(_height(l->left) >= _height(l->right)){                         // single rotation
+                return _make(l->_pair, l->left, _make(std::forward<P>(pair), l->right, std::move(r)));
+            }
+            auto& lr = l->right;                                                // double rotation
+            return _make(lr->_pair, _make(l->_pair, l->left, lr->left),
+                                    _make(std::forward<P>(pair), lr->right, std::move(r)));
+        }
+        if(hr > hl + 1){
+            if(_height(r->right) >= _height(r->left)){
+                return _make(r->_pair, _make(std::forward<P>(pair), std::move(l), r->left), r->right);
+            }
+            auto& rl = r->left;
+            return _make(rl->_pair, _make(std::forward<P>(pair), std::move(l), rl->left),
+                                    _make(r->_pair, rl->right, r->right));
+        }
+        return _make(std::forward<P>(pair), std::move(l), std::move(r));
+    }
+
+    /**
+     * @brief Auxiliary function to insert a pair in a subtree, copying the path to it
+     *
+     * @param x the subtree
+     * @param pair the pair to insert
+     * @param assign if the key is present, replace its value
+     * @param inserted set to true if a new key is added (output)
+     * @param changed set to true if the tree changes (output)
+     * @return the root of the new version of the subtree (x itself if nothing changed)
+     */
+    template <typename P>
+    link _insert(const link& x, P&& pair, bool assign, bool& inserted, bool& changed) const {
+        if(!x){
+            inserted = changed = true;
+            return _make(std::forward<P>(pair), nullptr, nullptr);
+        }
+        if(cmp(pair.first, x->_pair.first)){
+            auto l = _insert(x->left, std::forward<P>(pair), assign, inserted, changed);
+            return changed ? _balance(x->_pair, std::move(l), x->right) : x;
+        }
+        if(cmp(x->_pair.first, pair.first)){
+            auto r = _insert(x->right, std::forward<P>(pair), assign, inserted, changed);
+            return changed ? _balance(x->_pair, x->left, std::move(r)) : x;
+        }
+        if(!assign){return x;}
+        changed = true;                                     // same shape: no rebalancing
+        return _make(std::forward<P>(pair), x->left, x->right);
+    }
+
+    /**
+     * @brief Auxiliary function to insert a pair through forwarding references
+     *
+     * @return true if a new key has been added
+     */
+    template <typename P>
+    bool _insert(P&& x, bool assign){
+        bool inserted = false;
+        bool changed = false;
+        root = _insert(root, std::forward<P>(x), assign, inserted, changed);
+        items += inserted;
+        return inserted;
+    }
+
+    /**
+     * @brief Auxiliary function to remove the smallest key of a non empty subtree
+     */
+    link _erase_min(const link& x) const {
+        if(!x->left){return x->right;}
+        return _balance(x->_pair, _erase_min(x->left), x->right);
+    }
+
+    /**
+     * @brief Auxiliary function to remove a key from a subtree, copying the path to it
+     *
+     * @param changed set to true if the key was present (output)
+     * @return the root of the new version of the subtree (x itself if nothing changed)
+     */
+    link _erase(const link& x, const k_t& k, bool& changed) const {
+        if(!x){return x;}
+        if(cmp(k, x->_pair.first)){
+            auto l = _erase(x->left, k, changed);
+            return changed ? _balance(x->_pair, std::move(l), x->right) : x;
+        }
+        if(cmp(x->_pair.first, k)){
+            auto r = _erase(x->right, k, changed);
+            return changed ? _balance(x->_pair, x->left, std::move(r)) : x;
+        }
+        changed = true;
+        if(!x->left){return x->right;}
+        if(!x->right){return x->left;}
+        auto successor = x->right.get();                    // it takes the place of x
+        while(successor->left){successor = successor->left.get();}
+        return _balance(successor->_pair, x->left, _erase_min(x->right));
+    }
+
+    /**
+     * @brief Auxiliary function to build a balanced subtree out of
+     * a sorted range of n pairs (the median becomes the root)
+     */
+    template <typename It>
+    link _build(It first, std::size_t n) const {
+        if(!n){return nullptr;}
+        auto median = (n - 1) / 2;
+        auto l = _build(first, median);
+        auto r = _build(first + median + 1, n - median - 1);
+        return _make(first[median], std::move(l), std::move(r));
+    }
+
+public:
+    using const_iterator = _persistent_iterator<k_t,v_t>;
+
+    /**
+     * @brief Default ctor
+     */
+    persistent_bst() = default;
+
+    /**
+     * @brief Custom ctor
+     *
+     * @param a the allocator of the nodes
+     */
+    explicit persistent_bst(const Alloc& a): alloc{a} {}
+
+    /**
+     * @brief Custom ctor, it builds a balanced tree out of a range of pairs;
+     * the first pair with a given key wins
+     */
+    template <typename It>
+    persistent_bst(It first, It last, const Alloc& a = Alloc{}): alloc{a} {
+        std::vector<std::pair<k_t,v_t>> ordered(first, last);
+        auto by_key = [this](const std::pair<k_t,v_t>& x, const std::pair<k_t,v_t>& y){return cmp(x.first, y.first);};
+        auto same_key = [this](const std::pair<k_t,v_t>& x, const std::pair<k_t,v_t>& y){return !cmp(x.first, y.first);};
+        std::stable_sort(ordered.begin(), ordered.end(), by_key);
+        ordered.erase(std::unique(ordered.begin(), ordered.end(), same_key), ordered.end());
+        root = _build(std::make_move_iterator(ordered.begin()), ordered.size());
+        items = ordered.size();
+    }
+
+    /**
+     * @brief Copy ctor and assignment, in constant time: the copy shares all the nodes.
+     * The default ones (and the move ones) do exactly this
+     */
+    persistent_bst(const persistent_bst&) = default;
+    persistent_bst& operator=(const persistent_bst&) = default;
+    persistent_bst(persistent_bst&& x) noexcept: root{std::move(x.root)}, items{x.items}, cmp{std::move(x.cmp)}, alloc{std::move(x.alloc)} {
+        x.items = 0;
+    }
+    persistent_bst& operator=(persistent_bst&& x) noexcept {
+        root = std::move(x.root);
+        items = x.items;
+        x.items = 0;
+        cmp = std::move(x.cmp);
+        alloc = std::move(x.alloc);
+        return *this;
+    }
+
+    /**
+     * @return a snapshot of the tree, in constant time (same as a copy)
+     */
+    persistent_bst snapshot() const {return *this;}
+
+    /**
+     * @return const_iterator to the smallest key
+     */
+    const_iterator begin() const {
+        std::vector<const node*> path;
+        for(auto x = root.get(); x; x = x->left.get()){path.push_back(x);}
+        return const_iterator{std::move(path)};
+    }
+
+    const_iterator cbegin() const {return begin();}
+
+    /**
+     * @return const_iterator to one past the last key
+     */
+    const_iterator end() const noexcept {return const_iterator{};}
+
+    const_iterator cend() const noexcept {return end();}
+
+    /**
+     * @brief Find the first key that is not smaller than x
+     *
+     * @return const_iterator to such key or end()
+     */
+    const_iterator lower_bound(const k_t& x) const {
+        std::vector<const node*> path;
+        for(auto tmp = root.get(); tmp;){
+            if(cmp(tmp->_pair.first, x)){tmp = tmp->right.get();}
+            else{
+                path.push_back(tmp);
+                tmp = tmp->left.get();
+            }
+        }
+        return const_iterator{std::move(path)};
+    }
+
+    /**
+     * @brief Find a given key. If the key is present, returns an iterator to it, end() otherwise.
+     */
+    const_iterator find(const k_t& x) const {
+        auto i = lower_bound(x);
+        if(i != end() && !cmp(x, *i)){return i;}
+        return end();
+    }
+
+    /**
+     * @return true if the key x is present, without building an iterator
+     */
+    bool contains(const k_t& x) const noexcept {
+        for(auto tmp = root.get(); tmp;){
+            if(cmp(x, tmp->_pair.first)){tmp = tmp->left.get();}
+            else if(cmp(tmp->_pair.first, x)){tmp = tmp->right.get();}
+            else{return true;}
+        }
+        return false;
+    }
+
+    /**
+     * @brief Insert a new pair, if its key is not present
+     *
+     * @return true if the pair has been inserted
+     */
+    bool insert(const std::pair<k_t,v_t>& x) {return _insert(x, false);}
+
+    /**
+     * @brief Insert a new pair, if its key is not present
+     *
+     * @return true if the pair has been inserted
+     */
+    bool insert(std::pair<k_t,v_t>&& x) {return _insert(std::move(x), false);}
+
+    /**
+     * @brief Insert a new pair, or replace the value of its key if present
+     *
+     * @return true if the pair has been inserted, false if the value was assigned
+     */
+    template <typename M>
+    bool insert_or_assign(const k_t& k, M&& obj) {return _insert(std::pair<k_t,v_t>(k, std::forward<M>(obj)), true);}
+
+    /**
+     * @brief Remove the key x, if it is present
+     *
+     * @return true if the key has been removed
+     */
+    bool erase(const k_t& x){
+        bool changed = false;
+        root = _erase(root, x, changed);
+        items -= changed;
+        return changed;
+    }
+
+    /**
+     * @return the number of keys
+     */
+    std::size_t size() const noexcept {return items;}
+
+    /**
+     * @return true if there are no keys
+     */
+    bool empty() const noexcept {return !root;}
+
+    /**
+     * @brief Drop the reference to the nodes: those not shared with
+     * another version are destroyed
+     */
+    void clear() noexcept {
+        root.reset();
+        items = 0;
+    }
+
+    /**
+     * @return true if the two trees are the same version (they share the root)
+     */
+    bool shares_root_with(const persistent_bst& x) const noexcept {return root == x.root;}
+
+    /**
+     * @brief Overload of operator put to
+     */
+    friend
+    std::ostream& operator<<(std::ostream& os, const persistent_bst& x){
+        if(x.empty()){os << "WARNING: empty tree"; return os;}
+
+        for(auto& key : x){
+            os << key << " ";
+        }
+        os << std::endl;
+        return os;
+    }
+};
+
+#endif
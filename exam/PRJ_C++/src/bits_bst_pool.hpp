@@ -0,0 +1,232 @@
+#ifndef _BITS_BST_POOL_
+#define _BITS_BST_POOL_
+
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+/**
+ * Header for class node pool, the arena from which the bst
+ * allocates its nodes.
+ * The memory is obtained from the allocator in blocks of contiguous
+ * nodes, whose size grows geometrically; the nodes that are destroyed
+ * are kept in a free list and reused by the following allocations.
+ * All the blocks are given back together by release.
+ * The blocks are reference counted, so that a pool can share them with
+ * another one (see share): after a bst is split, both parts own the
+ * blocks their nodes live in, and a block goes back to the allocator
+ * when no pool refers to it anymore.
+ *
+ * @tparam node template for the node type
+ * @tparam Alloc template for the allocator, rebound to node
+ */
+template <typename node, typename Alloc>
+class _node_pool{
+
+    using alloc_t = typename std::allocator_traits<Alloc>::template rebind_alloc<node>;
+    using traits = std::allocator_traits<alloc_t>;
+
+    /**
+     * @brief A destroyed node, linked into the free list
+     *
+     */
+    struct free_slot{ free_slot* next; };
+
+    /**
+     * @brief Deleter of a block, it gives the memory back to the allocator
+     *
+     */
+    struct block_deleter{
+        alloc_t alloc;
+        std::size_t size;
+        void operator()(node* p) noexcept {traits::deallocate(alloc, p, size);}
+    };
+
+    static constexpr std::size_t first_block = 32;
+    static constexpr std::size_t max_block = 8192;
+
+    /**
+     * @brief Private variables
+     */
+    alloc_t alloc;
+    std::vector<std::shared_ptr<node>> blocks;             // the blocks this pool owns, alone or with other pools
+    std::size_t last_size{0};                               // number of nodes of the last block
+    free_slot* free_list{nullptr};
+    node* next{nullptr};                                    // first never used node of the last block
+    node* last{nullptr};                                    // one past the last node of the last block
+
+    /**
+     * @brief Allocate a new block, twice as big as the previous one
+     * 
+     * @param at_least minimum number of nodes in the block
+     */
+    void grow(std::size_t at_least = 0){
+        auto size = last_size ? last_size * 2 : first_block;
+        if(size > max_block){size = max_block;}
+        if(size < at_least){size = at_least;}
+        blocks.reserve(blocks.size() + 1);                  // so that push_back cannot throw
+        auto block = traits::allocate(alloc, size);
+        blocks.push_back(std::shared_ptr<node>{block, block_deleter{alloc, size}, alloc});   // on failure the block is deallocated
+        next = block;
+        last = next + size;
+        last_size = size;
+    }
+
+public:
+
+    /**
+     * @brief Custom ctor
+     *
+     * @param a the allocator the blocks are obtained from
+     */
+    explicit _node_pool(const Alloc& a = Alloc{}) noexcept: alloc{a} {}
+
+    /**
+     * @brief Dtor, the nodes must have already been destroyed
+     *
+     */
+    ~_node_pool() noexcept {release();}
+
+    _node_pool(const _node_pool&) = delete;
+    _node_pool& operator=(const _node_pool&) = delete;
+
+    /**
+     * @brief Move ctor, the blocks are stolen from x
+     */
+    _node_pool(_node_pool&& x) noexcept:
+        alloc{std::move(x.alloc)}, blocks{std::move(x.blocks)}, last_size{x.last_size},
+        free_list{x.free_list}, next{x.next}, last{x.last} {
+        x.blocks.clear();
+        x.last_size = 0;
+        x.free_list = nullptr;
+        x.next = x.last = nullptr;
+    }
+
+    /**
+     * @brief Move assignment, the blocks of this pool are released first
+     */
+    _node_pool& operator=(_node_pool&& x) noexcept{
+        release();
+        alloc = std::move(x.alloc);
+        blocks = std::move(x.blocks);
+        last_size = x.last_size;
+        x.last_size = 0;
+        free_list = x.free_list;
+        next = x.next;
+        last = x.last;
+        x.blocks.clear();
+        x.free_list = nullptr;
+        x.next = x.last = nullptr;
+        return *this;
+    }
+
+    /**
+     * @brief Construct a new node with the given args
+     *
+     * @return pointer to the new node
+     */
+    template <typename... Types>
+    node* create(Types&&... args){
+        node* x;
+        if(free_list){                                      // reuse a destroyed node
+            x = reinterpret_cast<node*>(free_list);
+            free_list = free_list->next;
+        }
+        else{
+            if(next == last){grow();}
+            x = next++;
+        }
+        traits::construct(alloc, x, std::forward<Types>(args)...);
+        return x;
+    }
+
+    /**
+     * @brief Make sure that the next n nodes that do not reuse a
+     * destroyed one are created one after the other in the same block
+     * 
+     * @param n number of nodes
+     */
+    void reserve(std::size_t n){
+        if(static_cast<std::size_t>(last - next) < n){grow(n);}
+    }
+
+    /**
+     * @return number of nodes the blocks of this pool can hold, used or not
+     */
+    std::size_t capacity() const noexcept {
+        std::size_t n = 0;
+        for(auto& b : blocks){n += std::get_deleter<block_deleter>(b)->size;}
+        return n;
+    }
+
+    /**
+     * @brief Destroy a node and keep its memory for the next create
+     *
+     * @param x pointer to the node
+     */
+    void destroy(node* x) noexcept {
+        traits::destroy(alloc, x);
+        free_list = ::new(static_cast<void*>(x)) free_slot{free_list};
+    }
+
+    /**
+     * @brief Take over all the blocks of x, with the nodes living in them.
+     * It lets a subtree be built on another thread, with its own pool,
+     * and then be adopted by the tree; the unused nodes of x are
+     * added to the free list
+     *
+     * @param x the pool to empty
+     */
+    void splice(_node_pool&& x){
+        share(x);
+        for(; x.next != x.last; ++x.next){
+            free_list = ::new(static_cast<void*>(x.next)) free_slot{free_list};
+        }
+        while(x.free_list){
+            auto slot = x.free_list;
+            x.free_list = slot->next;
+            slot->next = free_list;
+            free_list = slot;
+        }
+        x.blocks.clear();
+        x.last_size = 0;
+        x.next = x.last = nullptr;
+    }
+
+    /**
+     * @brief Become an owner of all the blocks of x too, e.g. because some
+     * of the nodes of x are moved to the tree of this pool; the nodes that
+     * x has not used yet stay to x
+     *
+     * @param x the pool whose blocks are shared
+     */
+    void share(const _node_pool& x){
+        blocks.reserve(blocks.size() + x.blocks.size());
+        blocks.insert(blocks.end(), x.blocks.begin(), x.blocks.end());
+        auto by_address = [](const std::shared_ptr<node>& a, const std::shared_ptr<node>& b){return a.get() < b.get();};
+        auto same = [](const std::shared_ptr<node>& a, const std::shared_ptr<node>& b){return a.get() == b.get();};
+        std::sort(blocks.begin(), blocks.end(), by_address);           // a block shared twice is owned once
+        blocks.erase(std::unique(blocks.begin(), blocks.end(), same), blocks.end());
+    }
+
+    /**
+     * @brief Give all the blocks back to the allocator at once.
+     * The nodes are not destroyed: it's up to the caller to do it before
+     * (unless their destructor is trivial). The blocks shared with other
+     * pools are given back by the last one that releases them
+     */
+    void release() noexcept {
+        blocks.clear();
+        last_size = 0;
+        free_list = nullptr;
+        next = last = nullptr;
+    }
+
+    /**
+     * @return a copy of the allocator
+     */
+    Alloc get_allocator() const {return Alloc{alloc};}
+};
+
+#endif
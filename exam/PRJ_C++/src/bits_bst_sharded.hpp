@@ -0,0 +1,310 @@
+#ifndef _BITS_BST_SHARDED_
+#define _BITS_BST_SHARDED_
+
+#include "bits_bst.hpp"
+#include "bits_btree.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <utility>
+#include <vector>
+
+/**
+ * Header for class sharded bst, a container that partitions the keys
+ * among independent bsts (the shards), each one with its own lock, so that
+ * threads working on different key ranges do not contend for the same root.
+ * - shard i holds the keys in [bounds[i-1], bounds[i]): a key is routed
+ *   to its shard with a binary search on the bounds, in O(log shards)
+ * - a shard that grows beyond shard_capacity keys is split in two halves
+ *   at its median key, and a shard that shrinks below a quarter of it is
+ *   merged with its smaller neighbour, so that the bounds follow the
+ *   distribution of the keys
+ * - since the shards hold disjoint and ordered ranges, the ordered visit
+ *   of all the keys (or of a range of keys) visits the shards one after
+ *   the other
+ *
+ * The point operations hold the layout lock in shared mode and the lock
+ * of their shard; splits and merges hold the layout lock exclusively.
+ *
+ * @tparam k_t template for the key type
+ * @tparam v_t template for the value type
+ * @tparam OP template for the total order relation; default is std::less<k_t>
+ * @tparam BAL template for the balancing policy of the shards; default is red_black
+ * @tparam Alloc template for the allocator of the shards
+ */
+template <typename k_t, typename v_t, typename OP = std::less<k_t>, typename BAL = red_black,
+          typename Alloc = std::allocator<std::pair<k_t,v_t>> >
+class sharded_bst{
+
+    using tree = bst<k_t,v_t,OP,BAL,Alloc>;
+
+    /**
+     * @brief A bst and the lock that protects it
+     */
+    struct shard{
+        tree t;
+        std::mutex lock;
+
+        explicit shard(const Alloc& a): t{a} {}
+    };
+
+    using shared_guard = std::shared_lock<std::shared_timed_mutex>;
+    using unique_guard = std::unique_lock<std::shared_timed_mutex>;
+
+    /**
+     * @brief Private variables
+     */
+    std::vector<k_t> bounds;                        // bounds[i] is the smallest key that can go to shard i+1
+    std::vector<std::unique_ptr<shard>> shards;
+    mutable std::shared_timed_mutex layout;         // protects bounds and shards
+    std::atomic<std::size_t> items{0};
+    std::size_t capacity;
+    OP cmp;
+    Alloc alloc;
+
+    /**
+     * @return the index of the shard that holds the key x
+     */
+    std::size_t _route(const k_t& x) const {
+        return std::upper_bound(bounds.begin(), bounds.end(), x, cmp) - bounds.begin();
+    }
+
+    /**
+     * @brief Move the pairs of a shard at the end of a vector, emptying the shard
+     */
+    static void _drain(shard& s, std::vector<std::pair<k_t,v_t>>& out){
+        for(auto i = s.t.begin(); i != s.t.end(); ++i){out.emplace_back(*i, std::move(i.value()));}
+        s.t.clear();
+    }
+
+    /**
+     * @brief Split the shard of x in two halves, if it is still too large
+     */
+    void _split(const k_t& x){
+        unique_guard guard{layout};
+        auto i = _route(x);
+        if(shards[i]->t.size() <= capacity){return;}          // another thread got here first
+
+        std::vector<std::pair<k_t,v_t>> pairs;
+        pairs.reserve(shards[i]->t.size());
+        _drain(*shards[i], pairs);
+        auto median = pairs.begin() + pairs.size() / 2;
+        k_t bound{median->first};                               // copied before the pairs are moved out
+
+        std::unique_ptr<shard> upper{new shard{alloc}};
+        upper->t.bulk_load(std::make_move_iterator(median), std::make_move_iterator(pairs.end()));
+        shards[i]->t.bulk_load(std::make_move_iterator(pairs.begin()), std::make_move_iterator(median));
+        bounds.insert(bounds.begin() + i, std::move(bound));
+        shards.insert(shards.begin() + i + 1, std::move(upper));
+    }
+
+    /**
+     * @brief Merge the shard of x with its smaller neighbour, if it is still
+     * too small and the result is not too large
+     */
+    void _merge(const k_t& x){
+        unique_guard guard{layout};
+        if(shards.size() == 1){return;}
+        auto i = _route(x);
+        if(shards[i]->t.size() >= capacity / 4){return;}
+
+        auto lower = i;                                         // merge shards lower and lower+1
+        if(i == shards.size() - 1 || (i > 0 && shards[i - 1]->t.size() < shards[i + 1]->t.size())){--lower;}
+        if(shards[lower]->t.size() + shards[lower + 1]->t.size() > capacity * 3 / 4){return;}
+
+        std::vector<std::pair<k_t,v_t>> pairs;
+        pairs.reserve(shards[lower]->t.size() + shards[lower + 1]->t.size());
+        _drain(*shards[lower], pairs);
+        _drain(*shards[lower + 1], pairs);
+        shards[lower]->t.bulk_load(std::make_move_iterator(pairs.begin()), std::make_move_iterator(pairs.end()));
+        bounds.erase(bounds.begin() + lower);
+        shards.erase(shards.begin() + lower + 1);
+    }
+
+    /**
+     * @brief Auxiliary function to insert a pair through forwarding references
+     */
+    template <typename P>
+    bool _insert(P&& x){
+        std::unique_ptr<k_t> split;                             // key of the new pair, if its shard must be split
+        {
+            shared_guard guard{layout};
+            auto& s = *shards[_route(x.first)];
+            std::lock_guard<std::mutex> s_guard{s.lock};
+            auto inserted = s.t.insert(std::forward<P>(x));   // x may be moved from
+            if(!inserted.second){return false;}
+            ++items;
+            if(s.t.size() > capacity){split.reset(new k_t{*inserted.first});}
+        }
+        if(split){_split(*split);}
+        return true;
+    }
+
+public:
+
+    /**
+     * @brief Custom ctor
+     *
+     * @param shard_capacity number of keys beyond which a shard is split
+     */
+    explicit sharded_bst(std::size_t shard_capacity = 1 << 16, const OP& c = OP{}, const Alloc& a = Alloc{}):
+        capacity{std::max<std::size_t>(shard_capacity, 4)}, cmp{c}, alloc{a} {
+        shards.emplace_back(new shard{alloc});
+    }
+
+    /**
+     * @brief Custom ctor, it loads a range of pairs (the first pair with a given key wins)
+     * into shards half full
+     *
+     * @param first iterator to the first pair
+     * @param last iterator to one past the last pair
+     * @param shard_capacity number of keys beyond which a shard is split
+     */
+    template <typename It>
+    sharded_bst(It first, It last, std::size_t shard_capacity = 1 << 16, const OP& c = OP{}, const Alloc& a = Alloc{}):
+        sharded_bst{shard_capacity, c, a} {
+        std::vector<std::pair<k_t,v_t>> pairs;
+        {
+            shard all{alloc};
+            all.t.bulk_load(first, last);                       // sorted and without duplicates
+            pairs.reserve(all.t.size());
+            _drain(all, pairs);
+        }
+        shards.clear();
+        auto chunk = capacity / 2;
+        for(std::size_t from = 0; from < pairs.size() || shards.empty(); from += chunk){
+            auto to = std::min(from + chunk, pairs.size());
+            if(from){bounds.push_back(pairs[from].first);}
+            shards.emplace_back(new shard{alloc});
+            shards.back()->t.bulk_load(std::make_move_iterator(pairs.begin() + from),
+                                       std::make_move_iterator(pairs.begin() + to));
+        }
+        items = pairs.size();
+    }
+
+    sharded_bst(const sharded_bst&) = delete;
+    sharded_bst& operator=(const sharded_bst&) = delete;
+
+    /**
+     * @brief Look for a key
+     *
+     * @param x the key
+     * @param value where the value of the key is copied, if it is present
+     * @return true if the key is present
+     */
+    bool find(const k_t& x, v_t& value) const {
+        shared_guard guard{layout};
+        auto& s = *shards[_route(x)];
+        std::lock_guard<std::mutex> s_guard{s.lock};
+        auto i = s.t.find(x);
+        if(i == s.t.end()){return false;}
+        value = i.value();
+        return true;
+    }
+
+    /**
+     * @return true if the key x is present
+     */
+    bool contains(const k_t& x) const {
+        shared_guard guard{layout};
+        auto& s = *shards[_route(x)];
+        std::lock_guard<std::mutex> s_guard{s.lock};
+        return s.t.find(x) != s.t.end();
+    }
+
+    /**
+     * @brief Insert a new pair, if its key is not present
+     *
+     * @return true if the pair has been inserted
+     */
+    bool insert(const std::pair<k_t,v_t>& x) {return _insert(x);}
+
+    /**
+     * @brief Insert a new pair, if its key is not present
+     *
+     * @return true if the pair has been inserted
+     */
+    bool insert(std::pair<k_t,v_t>&& x) {return _insert(std::move(x));}
+
+    /**
+     * @brief Remove the key x, if it is present
+     *
+     * @return true if the key has been removed
+     */
+    bool erase(const k_t& x){
+        bool merge;
+        {
+            shared_guard guard{layout};
+            auto& s = *shards[_route(x)];
+            std::lock_guard<std::mutex> s_guard{s.lock};
+            if(s.t.find(x) == s.t.end()){return false;}
+            s.t.erase(x);
+            --items;
+            merge = s.t.size() < capacity / 4;
+        }
+        if(merge){_merge(x);}
+        return true;
+    }
+
+    /**
+     * @return the number of keys (it may be stale while other threads modify the container)
+     */
+    std::size_t size() const noexcept {return items.load(std::memory_order_relaxed);}
+
+    /**
+     * @return the current number of shards
+     */
+    std::size_t shard_count() const {
+        shared_guard guard{layout};
+        return shards.size();
+    }
+
+    /**
+     * @brief Visit the pairs in order of key, one shard at a time: the
+     * modifications of a shard that has not been visited yet are seen
+     *
+     * @param f callable invoked with the key and the value of every pair
+     */
+    template <typename F>
+    void for_each(F&& f) const {
+        shared_guard guard{layout};
+        for(auto& s : shards){
+            std::lock_guard<std::mutex> s_guard{s->lock};
+            for(auto i = s->t.cbegin(); i != s->t.cend(); ++i){f(*i, i.value());}
+        }
+    }
+
+    /**
+     * @brief Visit in order the pairs with key in [a, b)
+     *
+     * @param f callable invoked with the key and the value of every pair
+     */
+    template <typename F>
+    void for_each(const k_t& a, const k_t& b, F&& f) const {
+        shared_guard guard{layout};
+        for(auto k = _route(a); k < shards.size() && (k == 0 || cmp(bounds[k - 1], b)); ++k){
+            std::lock_guard<std::mutex> s_guard{shards[k]->lock};
+            const tree& t = shards[k]->t;
+            for(auto i = t.lower_bound(a); i != t.cend() && cmp(*i, b); ++i){f(*i, i.value());}
+        }
+    }
+
+    /**
+     * @brief Overload of operator put to
+     */
+    friend
+    std::ostream& operator<<(std::ostream& os, const sharded_bst& x){
+        if(!x.size()){os << "WARNING: empty tree"; return os;}
+        x.for_each([&os](const k_t& k, const v_t&){os << k << " ";});
+        os << std::endl;
+        return os;
+    }
+};
+
+#endif
@@ -0,0 +1,510 @@
+#ifndef _BITS_BST_SNAPSHOT_
+#define _BITS_BST_SNAPSHOT_
+
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/**
+ * Header with the binary snapshot format of a bst (see bst::save and
+ * bst::load) and with class mapped snapshot, which maps a snapshot file
+ * in memory and searches it in place, without deserializing it.
+ *
+ * The format is meant for trivially copyable keys and values, which are
+ * written as they are in memory, in the byte order of the machine:
+ * - a header with the sizes of the key and value types, the number of
+ *   pairs and the offsets of the two sections
+ * - the keys, sorted, from an offset multiple of 64
+ * - the values, in the same order, from the next multiple of 64
+ *
+ * The keys are contiguous, so that a lookup only touches them; the
+ * sections are aligned to a cache line, hence to the alignment of any
+ * key and value type, and can be used in place once the file is mapped.
+ */
+
+
+/**
+ * @brief Header of a snapshot file
+ */
+struct _snapshot_header{
+    char magic[8];                  // "bstsnap" and the version of the format
+    std::uint32_t order;            // _snapshot_order as written, to detect a different byte order
+    std::uint32_t key_size;
+    std::uint32_t value_size;
+    std::uint32_t reserved;
+    std::uint64_t count;            // number of pairs
+    std::uint64_t keys_offset;
+    std::uint64_t values_offset;
+};
+
+static constexpr char _snapshot_magic[8] = {'b', 's', 't', 's', 'n', 'a', 'p', '1'};
+static constexpr std::uint32_t _snapshot_order = 0x01020304;
+static constexpr std::uint64_t _snapshot_align = 64;
+
+/**
+ * @return the first multiple of the section alignment not smaller than x
+ */
+inline std::uint64_t _snapshot_round(std::uint64_t x) noexcept {
+    return (x + _snapshot_align - 1) / _snapshot_align * _snapshot_align;
+}
+
+/**
+ * @brief Header of a snapshot with n pairs of the given types
+ */
+template <typename k_t, typename v_t>
+_snapshot_header _make_snapshot_header(std::uint64_t n) noexcept {
+    _snapshot_header h;
+    std::memcpy(h.magic, _snapshot_magic, sizeof(h.magic));
+    h.order = _snapshot_order;
+    h.key_size = sizeof(k_t);
+    h.value_size = sizeof(v_t);
+    h.reserved = 0;
+    h.count = n;
+    h.keys_offset = _snapshot_round(sizeof(_snapshot_header));
+    h.values_offset = _snapshot_round(h.keys_offset + n * sizeof(k_t));
+    return h;
+}
+
+/**
+ * @brief Check that the types can be stored in a snapshot
+ */
+template <typename k_t, typename v_t>
+struct _snapshot_types{
+    static_assert(std::is_trivially_copyable<k_t>::value && std::is_trivially_copyable<v_t>::value,
+                  "a snapshot stores trivially copyable keys and values only");
+    static_assert(alignof(k_t) <= _snapshot_align && alignof(v_t) <= _snapshot_align,
+                  "the keys and values of a snapshot must be aligned to at most 64 bytes");
+};
+
+/**
+ * @brief Make the entry of a file in its directory durable, after the
+ * file was created or renamed
+ */
+inline void _fsync_directory(const std::string& path){
+    auto slash = path.find_last_of('/');
+    auto dir = slash == std::string::npos ? std::string{"."} : path.substr(0, slash + 1);
+    auto fd = ::open(dir.c_str(), O_RDONLY);
+    if(fd < 0 || fsync(fd) != 0){
+        if(fd >= 0){::close(fd);}
+        throw std::runtime_error{"cannot sync " + dir + ": " + std::strerror(errno)};
+    }
+    ::close(fd);
+}
+
+/**
+ * @brief Write a snapshot in one pass over the range: the keys and the
+ * values are gathered in two buffers of about 1MB and each buffer is
+ * written at its place in its section when it is full, so that the memory
+ * used does not grow with the size of the tree.
+ * The file is written under a temporary name, synced and renamed at the
+ * end, and then the directory is synced, so that neither a failure nor a
+ * crash ever leaves a truncated snapshot in place of the old one
+ *
+ * @param path name of the file
+ * @param first iterator of a bst to its smallest key
+ * @param last iterator of a bst to one past its last key
+ * @param n number of pairs in the range
+ */
+template <typename k_t, typename v_t, typename It>
+void _save_snapshot(const std::string& path, It first, It last, std::size_t n){
+    _snapshot_types<k_t,v_t>{};
+    auto header = _make_snapshot_header<k_t,v_t>(n);
+    auto tmp = path + ".tmp";
+    auto fd = ::open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0){throw std::runtime_error{"cannot create the snapshot " + tmp + ": " + std::strerror(errno)};}
+
+    bool ok = true;
+    auto write = [fd, &ok](const void* x, std::size_t size, std::uint64_t offset){
+        auto p = static_cast<const char*>(x);
+        while(ok && size > 0){
+            auto done = ::pwrite(fd, p, size, static_cast<off_t>(offset));
+            if(done < 0 && errno == EINTR){continue;}
+            if(done <= 0){ok = false; break;}
+            p += done;
+            size -= static_cast<std::size_t>(done);
+            offset += static_cast<std::uint64_t>(done);
+        }
+    };
+
+    // the padding between the sections is the zeros of the extended file
+    ok = ::ftruncate(fd, static_cast<off_t>(header.values_offset + n * sizeof(v_t))) == 0;
+    write(&header, sizeof(header), 0);
+
+    constexpr std::size_t chunk = (1 << 20) / (sizeof(k_t) > sizeof(v_t) ? sizeof(k_t) : sizeof(v_t)) + 1;
+    std::vector<k_t> keys;
+    keys.reserve(chunk);
+    std::vector<v_t> values;
+    values.reserve(chunk);
+    std::uint64_t written = 0;                          // pairs already in the file
+    auto flush = [&](){
+        write(keys.data(), keys.size() * sizeof(k_t), header.keys_offset + written * sizeof(k_t));
+        write(values.data(), values.size() * sizeof(v_t), header.values_offset + written * sizeof(v_t));
+        written += keys.size();
+        keys.clear();
+        values.clear();
+    };
+    for(auto i = first; ok && i != last; ++i){
+        if(keys.size() == chunk){flush();}
+        keys.push_back(*i);
+        values.push_back(i.value());
+    }
+    flush();
+
+    ok = ok && fsync(fd) == 0;
+    ok = ::close(fd) == 0 && ok;
+    if(!ok || std::rename(tmp.c_str(), path.c_str()) != 0){
+        std::remove(tmp.c_str());
+        throw std::runtime_error{"cannot write the snapshot " + path};
+    }
+    _fsync_directory(path);
+}
+
+
+template <typename k_t, typename v_t, typename OP> class mapped_snapshot;
+
+
+/**
+ * @brief Random access view of the pairs of a mapped snapshot, for the
+ * builders of the trees (see bst::load): the pair at a position is read
+ * by copy from the two sections of the mapping
+ */
+template <typename k_t, typename v_t>
+struct _snapshot_pairs{
+    const k_t* keys;
+    const v_t* values;
+
+    std::pair<k_t,v_t> operator[](std::size_t i) const {return {keys[i], values[i]};}
+    _snapshot_pairs operator+(std::size_t i) const noexcept {return {keys + i, values + i};}
+};
+
+
+/**
+ * Header for class mapped iterator.
+ * It traverses the mapped snapshot in order of key, that is in the
+ * order of the sections of the file.
+ *
+ * @tparam k_t template for the key type
+ * @tparam v_t template for the value type
+ * @tparam OP template for the total order relation
+ */
+template <typename k_t, typename v_t, typename OP>
+class _mapped_iterator{
+
+    /**
+     * @brief pointer to the snapshot and position of the pair
+     *
+     */
+    const mapped_snapshot<k_t,v_t,OP>* tree;
+    std::size_t current;
+
+public:
+    using value_type = const k_t;
+    using difference_type = std::ptrdiff_t;
+    using iterator_category = std::forward_iterator_tag;
+    using reference = value_type&;
+    using pointer = value_type*;
+
+    /**
+     * @brief Default ctor
+     *
+     */
+    _mapped_iterator() noexcept = default;
+
+    /**
+     * @brief Custom ctor
+     *
+     * @param t pointer to the snapshot
+     * @param i position of the pair
+     */
+    _mapped_iterator(const mapped_snapshot<k_t,v_t,OP>* t, std::size_t i) noexcept: tree{t}, current{i} {}
+
+    /**
+     * @brief Overloading of the preincrement operator
+     *
+     * @return an iterator pointing to the next pair
+     */
+    _mapped_iterator& operator++() noexcept {
+        ++current;
+        return *this;
+    }
+
+    /**
+     * @brief Overloading of post increment operator
+     */
+    _mapped_iterator operator++(int) noexcept {
+        auto tmp{*this};
+        ++(*this);
+        return tmp;
+    }
+
+    /**
+     * @return the key of the pair the iterator points to
+     */
+    reference operator*() const noexcept {return tree->keys[current];}
+
+    /**
+     * @return a pointer to the key of the pair the iterator points to
+     */
+    pointer operator->() const noexcept {return &**this;}
+
+    /**
+     * @return a const reference to the value of the pointed pair
+     */
+    const v_t& value() const noexcept {return tree->values[current];}
+
+    /**
+     * @return the position of the pair in the file
+     */
+    std::size_t where() const noexcept {return current;}
+
+    friend
+    bool operator==(const _mapped_iterator& a, const _mapped_iterator& b) noexcept {
+        return a.current == b.current;
+    }
+
+    friend
+    bool operator!=(const _mapped_iterator& a, const _mapped_iterator& b) noexcept {return !(a == b);}
+};
+
+
+template <typename k_t, typename v_t, typename OP = std::less<k_t> >
+class mapped_snapshot{
+
+    friend class _mapped_iterator<k_t,v_t,OP>;
+
+    /**
+     * @brief Private variables
+     */
+    void* map{nullptr};             // the mapping of the whole file
+    std::size_t length{0};
+    const k_t* keys{nullptr};       // the two sections, in the mapping
+    const v_t* values{nullptr};
+    std::size_t items{0};
+    OP cmp;
+
+    /**
+     * @brief Auxiliary function: branch-free binary search over the keys.
+     * The range where the first key not smaller than x lies is halved at
+     * every step with a conditional move; the keys that the two possible
+     * next steps compare are prefetched, so that the page faults and cache
+     * misses of consecutive levels overlap
+     *
+     * @param x key to look for
+     * @return position of the first key not smaller than x, size() if there is none
+     */
+    std::size_t _lower_bound(const k_t& x) const noexcept {
+        if(!items){return 0;}
+        auto base = keys;
+        auto n = items;
+        while(n > 1){
+            auto half = n / 2;
+#if defined(__GNUC__)
+            __builtin_prefetch(base + half / 2);
+            __builtin_prefetch(base + half + half / 2);
+#endif
+            base = cmp(base[half], x) ? base + half : base;
+            n -= half;
+        }
+        return static_cast<std::size_t>(base - keys) + cmp(*base, x);
+    }
+
+    /**
+     * @brief Auxiliary function: give the mapping back to the system
+     */
+    void _unmap() noexcept {
+        if(map){munmap(map, length);}
+        map = nullptr;
+        length = 0;
+        keys = nullptr;
+        values = nullptr;
+        items = 0;
+    }
+
+public:
+    using const_iterator = _mapped_iterator<k_t,v_t,OP>;
+
+    /**
+     * @brief Default ctor, an empty snapshot
+     *
+     */
+    mapped_snapshot() noexcept = default;
+
+    /**
+     * @brief Custom ctor: the file is mapped read only and its header is
+     * checked against the types; the pairs are read from the disk only
+     * when they are touched
+     *
+     * @param path name of a file written by bst::save
+     * @param c the total order relation, the same the snapshot was sorted with
+     */
+    explicit mapped_snapshot(const std::string& path, const OP& c = OP{}): cmp{c} {
+        _snapshot_types<k_t,v_t>{};
+        auto fd = ::open(path.c_str(), O_RDONLY);
+        if(fd < 0){throw std::runtime_error{"cannot open the snapshot " + path + ": " + std::strerror(errno)};}
+        struct stat st;
+        if(fstat(fd, &st) == 0 && static_cast<std::size_t>(st.st_size) >= sizeof(_snapshot_header)){
+            length = static_cast<std::size_t>(st.st_size);
+            map = mmap(nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+            if(map == MAP_FAILED){map = nullptr;}
+        }
+        ::close(fd);                                        // the mapping keeps the file alive
+
+        _snapshot_header h;
+        if(map){std::memcpy(&h, map, sizeof(h));}
+        auto expected = _make_snapshot_header<k_t,v_t>(map ? h.count : 0);
+        if(!map || std::memcmp(h.magic, _snapshot_magic, sizeof(h.magic)) || h.order != _snapshot_order
+           || h.key_size != sizeof(k_t) || h.value_size != sizeof(v_t)
+           || h.keys_offset != expected.keys_offset || h.values_offset != expected.values_offset
+           || h.count > length || h.values_offset + h.count * sizeof(v_t) > length){
+            _unmap();
+            throw std::runtime_error{"not a snapshot of these types: " + path};
+        }
+
+        auto base = static_cast<const char*>(map);
+        keys = reinterpret_cast<const k_t*>(base + h.keys_offset);
+        values = reinterpret_cast<const v_t*>(base + h.values_offset);
+        items = static_cast<std::size_t>(h.count);
+    }
+
+    /**
+     * @brief Dtor, the file is unmapped
+     *
+     */
+    ~mapped_snapshot() noexcept {_unmap();}
+
+    mapped_snapshot(const mapped_snapshot&) = delete;
+    mapped_snapshot& operator=(const mapped_snapshot&) = delete;
+
+    /**
+     * @brief Move ctor, the mapping is stolen from x
+     */
+    mapped_snapshot(mapped_snapshot&& x) noexcept:
+        map{x.map}, length{x.length}, keys{x.keys}, values{x.values}, items{x.items}, cmp{std::move(x.cmp)} {
+        x.map = nullptr;
+        x._unmap();
+    }
+
+    /**
+     * @brief Move assignment, the mapping of this snapshot is released first
+     */
+    mapped_snapshot& operator=(mapped_snapshot&& x) noexcept {
+        if(this != &x){
+            _unmap();
+            std::swap(map, x.map);
+            std::swap(length, x.length);
+            std::swap(keys, x.keys);
+            std::swap(values, x.values);
+            std::swap(items, x.items);
+            cmp = std::move(x.cmp);
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Advise the system about the next accesses, e.g. MADV_WILLNEED
+     * to page the whole file in at once, MADV_RANDOM for sparse lookups
+     *
+     * @param advice one of the madvise constants
+     */
+    void advise(int advice) const noexcept {
+        if(map){madvise(map, length, advice);}
+    }
+
+    /**
+     * @return true if the keys are strictly increasing wrt OP, as in a
+     * file written by save with the same order relation
+     */
+    bool is_sorted() const {
+        for(std::size_t i = 1; i < items; ++i){
+            if(!cmp(keys[i - 1], keys[i])){return false;}
+        }
+        return true;
+    }
+
+    /**
+     * @return a random access view of the pairs, by position
+     */
+    _snapshot_pairs<k_t,v_t> pairs() const noexcept {return {keys, values};}
+
+    /**
+     * @return the number of pairs
+     */
+    std::size_t size() const noexcept {return items;}
+
+    /**
+     * @return true if there are no pairs
+     */
+    bool empty() const noexcept {return items == 0;}
+
+    /**
+     * @return const_iterator to the smallest key
+     */
+    const_iterator begin() const noexcept {return const_iterator{this, 0};}
+
+    /**
+     * @return const_iterator to the smallest key
+     */
+    const_iterator cbegin() const noexcept {return begin();}
+
+    /**
+     * @return const_iterator to one past the last key
+     */
+    const_iterator end() const noexcept {return const_iterator{this, items};}
+
+    /**
+     * @return const_iterator to one past the last key
+     */
+    const_iterator cend() const noexcept {return end();}
+
+    /**
+     * @brief Find the first key that is not smaller than x
+     *
+     * @param x key to look for
+     * @return const_iterator to such key or end()
+     */
+    const_iterator lower_bound(const k_t& x) const noexcept {return const_iterator{this, _lower_bound(x)};}
+
+    /**
+     * @brief Find a given key. If the key is present, returns an iterator to it, end() otherwise.
+     *
+     * @param x key to look for
+     * @return const_iterator to the key or to one past the last key
+     */
+    const_iterator find(const k_t& x) const noexcept {
+        auto i = _lower_bound(x);
+        if(i < items && !cmp(x, keys[i])){return const_iterator{this, i};}
+        return end();
+    }
+
+    /**
+     * @brief Overload of operator put to
+     */
+    friend
+    std::ostream& operator<<(std::ostream& os, const mapped_snapshot& x){
+        if(x.empty()){os << "WARNING: empty tree"; return os;}
+
+        for(auto& key : x){
+            os << key << " ";
+        }
+        os << std::endl;
+        return os;
+    }
+};
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef _BITS_BST_STATS_
+#define _BITS_BST_STATS_
+
+#include <chrono>
+#include <cstddef>
+#include <iostream>
+#include <vector>
+
+#ifdef BST_STATS
+#include <atomic>
+#endif
+
+/**
+ * Header for the instrumentation of the bst, compiled in only when
+ * BST_STATS is defined (e.g. with -DBST_STATS). Then every lookup
+ * (find, lower_bound, insert, erase, ...) counts the comparisons and the
+ * nodes it visits, balance is timed, and bst::stats returns a snapshot
+ * of the counters together with the shape of the tree.
+ * Without BST_STATS the probes below are empty and the bst has neither
+ * the counters nor the stats API: the code is the same as before.
+ * A lookup adds its counts to the shared counters once, when it is over,
+ * with relaxed atomics, so that concurrent readers do not race.
+ */
+
+
+/**
+ * @brief Snapshot of the state of a bst, see bst::stats
+ *
+ */
+struct bst_stats{
+    std::size_t size{0};                        // number of nodes
+    std::size_t height{0};                      // number of levels, 0 if the tree is empty
+    double average_depth{0};                    // the root has depth 0
+    std::vector<std::size_t> depth_histogram;   // number of nodes at each depth
+    std::size_t bytes_allocated{0};             // memory of the blocks of the node pool
+    std::size_t bytes_live{0};                  // memory of the nodes in the tree
+
+    std::size_t operations{0};                  // lookups since the counters were reset
+    std::size_t comparisons{0};                 // invocations of the comparator by the lookups
+    std::size_t nodes_visited{0};
+    std::size_t balances{0};                    // calls of balance, automatic ones included
+    std::size_t auto_balances{0};
+    double balance_ms{0};                       // time spent in balance
+
+    double comparisons_per_operation() const noexcept {return operations ? double(comparisons) / operations : 0;}
+    double nodes_per_operation() const noexcept {return operations ? double(nodes_visited) / operations : 0;}
+
+    /**
+     * @brief Overload of operator put to, one line per group of numbers
+     */
+    friend
+    std::ostream& operator<<(std::ostream& os, const bst_stats& s){
+        os << "size = " << s.size << ", height = " << s.height << ", average depth = " << s.average_depth << std::endl;
+        os << "depth histogram:";
+        for(auto n : s.depth_histogram){os << " " << n;}
+        os << std::endl;
+        os << "bytes allocated = " << s.bytes_allocated << ", live = " << s.bytes_live << std::endl;
+        os << "operations = " << s.operations << ", comparisons/op = " << s.comparisons_per_operation()
+           << ", nodes/op = " << s.nodes_per_operation() << std::endl;
+        os << "balances = " << s.balances << " (" << s.auto_balances << " automatic), " << s.balance_ms << " ms" << std::endl;
+        return os;
+    }
+};
+
+
+#ifdef BST_STATS
+
+/**
+ * @brief The counters of a bst, and the settings of the automatic rebalance.
+ * A copy starts from zero but keeps the settings
+ *
+ */
+struct _bst_counters{
+    std::atomic<std::size_t> operations{0}, comparisons{0}, visited{0};
+    std::atomic<std::size_t> balances{0}, auto_balances{0}, balance_ns{0};
+    double factor{0};                   // rebalance when the average depth exceeds factor * log2(n); 0 never
+    std::size_t depth_sum{0};           // upper bound of the sum of the depths, kept only if factor > 0
+
+    _bst_counters() noexcept = default;
+    _bst_counters(const _bst_counters& x) noexcept: factor{x.factor}, depth_sum{x.depth_sum} {}
+    _bst_counters& operator=(const _bst_counters& x) noexcept {
+        reset();
+        factor = x.factor;
+        depth_sum = x.depth_sum;
+        return *this;
+    }
+
+    void reset() noexcept {
+        for(auto c : {&operations, &comparisons, &visited, &balances, &auto_balances, &balance_ns}){
+            c->store(0, std::memory_order_relaxed);
+        }
+    }
+
+    /**
+     * @brief Copy the counters into a snapshot
+     */
+    void fill(bst_stats& s) const noexcept {
+        s.operations = operations.load(std::memory_order_relaxed);
+        s.comparisons = comparisons.load(std::memory_order_relaxed);
+        s.nodes_visited = visited.load(std::memory_order_relaxed);
+        s.balances = balances.load(std::memory_order_relaxed);
+        s.auto_balances = auto_balances.load(std::memory_order_relaxed);
+        s.balance_ms = balance_ns.load(std::memory_order_relaxed) / 1e6;
+    }
+};
+
+/**
+ * @brief Counts the comparisons and the visits of one lookup, and adds
+ * them to the counters of the tree when it is destroyed
+ *
+ */
+class _bst_probe{
+    _bst_counters* counters;
+    std::size_t lookups{1}, comparisons{0}, visited{0};
+
+public:
+    explicit _bst_probe(_bst_counters& c) noexcept: counters{&c} {}
+    _bst_probe(_bst_probe&& x) noexcept: counters{x.counters}, lookups{x.lookups}, comparisons{x.comparisons}, visited{x.visited} {x.counters = nullptr;}
+    _bst_probe(const _bst_probe&) = delete;
+    _bst_probe& operator=(const _bst_probe&) = delete;
+
+    ~_bst_probe() noexcept {
+        if(!counters){return;}
+        counters->operations.fetch_add(lookups, std::memory_order_relaxed);
+        counters->comparisons.fetch_add(comparisons, std::memory_order_relaxed);
+        counters->visited.fetch_add(visited, std::memory_order_relaxed);
+    }
+
+    void visit() noexcept {++visited;}
+
+    /**
+     * @brief The probe follows n lookups at once (see bst::find_batch)
+     */
+    void batch(std::size_t n) noexcept {lookups = n;}
+
+    template <typename OP, typename A, typename B>
+    bool less(const OP& cmp, const A& a, const B& b){
+        ++comparisons;
+        return cmp(a, b);
+    }
+};
+
+/**
+ * @brief Adds the time from its construction to its destruction to the counters
+ *
+ */
+class _bst_timer{
+    _bst_counters& counters;
+    std::chrono::steady_clock::time_point start;
+
+public:
+    explicit _bst_timer(_bst_counters& c) noexcept: counters{c}, start{std::chrono::steady_clock::now()} {}
+    _bst_timer(const _bst_timer&) = delete;
+    _bst_timer& operator=(const _bst_timer&) = delete;
+
+    ~_bst_timer() noexcept {
+        auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
+        counters.balances.fetch_add(1, std::memory_order_relaxed);
+        counters.balance_ns.fetch_add(static_cast<std::size_t>(ns), std::memory_order_relaxed);
+    }
+};
+
+#else
+
+/**
+ * @brief Probe of a lookup without BST_STATS: it counts nothing
+ *
+ */
+struct _bst_probe{
+    void visit() const noexcept {}
+    void batch(std::size_t) const noexcept {}
+
+    template <typename OP, typename A, typename B>
+    static bool less(const OP& cmp, const A& a, const B& b) {return cmp(a, b);}
+};
+
+#endif
+
+#endif
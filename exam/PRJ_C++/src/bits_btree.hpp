@@ -0,0 +1,1153 @@
+#ifndef _BITS_BTREE_
+#define _BITS_BTREE_
+
+#include <algorithm>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "bits_bst.hpp"
+#include "bits_bst_pool.hpp"
+#include "bits_bst_frozen.hpp"
+#include "bits_bst_snapshot.hpp"
+
+/**
+ * Header for the B+ tree engine of the bst.
+ * Passing btree<N> as balancing policy selects a partial specialization
+ * of the bst with the same public interface, which stores up to N keys
+ * per node instead of one:
+ * - the inner nodes only hold keys (separators) and pointers to the children
+ * - the leaves hold the pairs, with the keys and the values in two separate
+ *   arrays, and are linked to the previous and the next leaf,
+ *   so that an inorder traversal runs over contiguous arrays
+ * All the leaves are at the same depth, hence the height of the tree
+ * is about log(n)/log(N/2).
+ *
+ * The key and value types must be default constructible and move assignable,
+ * since the nodes hold arrays of them. Every insertion and erasure may move
+ * the pairs inside the leaves, so they invalidate the iterators.
+ *
+ * @tparam N maximum number of keys in a node; with 0 (the default) the
+ * keys of a node fill four cache lines
+ */
+template <std::size_t N = 0>
+struct btree{};
+
+
+template <typename k_t, typename v_t, std::size_t N> struct _binner;
+
+/**
+ * @brief Part shared by the inner nodes and the leaves of the B+ tree:
+ * the sorted keys and a raw pointer to the parent
+ */
+template <typename k_t, typename v_t, std::size_t N>
+struct _bnode{
+    _binner<k_t,v_t,N>* parent{nullptr};
+    std::size_t count{0};                       // number of keys in use
+    bool is_leaf;
+    k_t keys[N];
+
+    explicit _bnode(bool leaf) noexcept: is_leaf{leaf} {}
+};
+
+/**
+ * @brief Leaf of the B+ tree: keys[i] is mapped to values[i]
+ */
+template <typename k_t, typename v_t, std::size_t N>
+struct _bleaf: _bnode<k_t,v_t,N>{
+    _bleaf* prev{nullptr};
+    _bleaf* next{nullptr};
+    v_t values[N];
+
+    _bleaf(): _bnode<k_t,v_t,N>{true} {}
+};
+
+/**
+ * @brief Inner node of the B+ tree with count keys and count+1 children:
+ * the keys in children[i] are smaller than keys[i], the ones in
+ * children[i+1] are not
+ */
+template <typename k_t, typename v_t, std::size_t N>
+struct _binner: _bnode<k_t,v_t,N>{
+    _bnode<k_t,v_t,N>* children[N + 1];
+
+    _binner(): _bnode<k_t,v_t,N>{false} {}
+};
+
+
+/**
+ * Header for class B+ tree iterator.
+ * It contains a raw pointer to a leaf, a position in it and a pointer
+ * to the right most leaf (owned by the bst), so that end() can be decremented.
+ *
+ * @tparam O template for the iterator
+ * @tparam k_t template for the key type of the leaf
+ * @tparam v_t template for the value type of the leaf
+ * @tparam N template for the capacity of the leaf
+ */
+template <typename O, typename k_t, typename v_t, std::size_t N>
+class _btree_iterator{
+
+    using leaf = _bleaf<k_t,v_t,N>;
+
+    /**
+     * @brief pointer to the leaf and position of the pair in it
+     *
+     */
+    leaf* current;
+    std::size_t index;
+    leaf* const* last;
+
+    template <typename, typename, typename, std::size_t> friend class _btree_iterator;
+
+public:
+    using value_type = O;
+    using difference_type = std::ptrdiff_t;
+    using iterator_category = std::bidirectional_iterator_tag;
+    using reference = value_type&;
+    using pointer = value_type*;
+
+    /**
+     * @brief Default ctor
+     *
+     */
+    _btree_iterator() noexcept = default;
+
+    /**
+     * @brief Custom ctor
+     *
+     * @param x pointer to a leaf
+     * @param i position in the leaf
+     * @param right_most pointer to the right most leaf of the bst
+     */
+    _btree_iterator(leaf* x, std::size_t i, leaf* const* right_most) noexcept: current{x}, index{i}, last{right_most} {}
+
+    /**
+     * @brief Conversion from iterator to const_iterator
+     *
+     * @param x an iterator on non-const keys
+     */
+    template <typename P, typename = typename std::enable_if<std::is_same<O, const P>::value>::type>
+    _btree_iterator(const _btree_iterator<P,k_t,v_t,N>& x) noexcept: current{x.current}, index{x.index}, last{x.last} {}
+
+    /**
+     * @brief Overloading of the preincrement operator:
+     * next position in the leaf, or first one of the next leaf
+     */
+    _btree_iterator& operator++() noexcept {
+        if(++index == current->count){
+            current = current->next;
+            index = 0;
+        }
+        return *this;
+    }
+
+    /**
+     * @brief Overloading of post increment operator
+     */
+    _btree_iterator operator++(int) noexcept {
+        auto tmp{*this};
+        ++(*this);
+        return tmp;
+    }
+
+    /**
+     * @brief Overloading of the predecrement operator:
+     * previous position in the leaf, or last one of the previous leaf.
+     * Decrementing end() gives the last pair of the right most leaf
+     */
+    _btree_iterator& operator--() noexcept {
+        if(!current){current = *last;}
+        else if(index){
+            --index;
+            return *this;
+        }
+        else{current = current->prev;}
+        index = current->count - 1;
+        return *this;
+    }
+
+    /**
+     * @brief Overloading of post decrement operator
+     */
+    _btree_iterator operator--(int) noexcept {
+        auto tmp{*this};
+        --(*this);
+        return tmp;
+    }
+
+    /**
+     * @return the key the iterator points to
+     */
+    reference operator*() const noexcept {return current->keys[index];}
+
+    /**
+     * @return a pointer to the key the iterator points to
+     */
+    pointer operator->() const noexcept {return &**this;}
+
+    /**
+     * @return a reference to the value of the pointed key
+     */
+    v_t& value() {return current->values[index];}
+
+    /**
+     * @return a const reference to the value of the pointed key
+     */
+    const v_t& value() const {return current->values[index];}
+
+    /**
+     * @return a pointer to the current leaf
+     */
+    leaf* where() const noexcept {return current;}
+
+    /**
+     * @return the position in the current leaf
+     */
+    std::size_t position() const noexcept {return index;}
+
+    friend
+    bool operator==(const _btree_iterator& a, const _btree_iterator& b) noexcept {
+        return a.current == b.current && a.index == b.index;
+    }
+
+    friend
+    bool operator!=(const _btree_iterator& a, const _btree_iterator& b) noexcept {return !(a == b);}
+};
+
+
+template <typename k_t, typename v_t, typename OP, std::size_t N, typename Alloc>
+class bst<k_t,v_t,OP,btree<N>,Alloc>{
+
+    static constexpr std::size_t order = N ? N : (256 / sizeof(k_t) < 4 ? 4 : 256 / sizeof(k_t));
+    static_assert(order >= 3, "a node of the B+ tree must hold at least three keys");
+    static constexpr std::size_t min_keys = order / 2;
+
+    using bnode = _bnode<k_t,v_t,order>;
+    using leaf = _bleaf<k_t,v_t,order>;
+    using inner = _binner<k_t,v_t,order>;
+
+public:
+    using iterator = _btree_iterator<k_t,k_t,v_t,order>;
+    using const_iterator = _btree_iterator<const k_t,k_t,v_t,order>;
+    using reverse_iterator = _reverse_iterator<iterator>;
+    using const_reverse_iterator = _reverse_iterator<const_iterator>;
+
+private:
+
+    /**
+     * @brief Result of a lookup: the leaf and the position where the key is,
+     * or where it should be inserted
+     */
+    struct position{
+        leaf* l;
+        std::size_t i;
+        bool found;
+    };
+
+    /**
+     * @brief Private variables.
+     * The pools are declared before the pointers, so that the nodes
+     * are destroyed before their memory is released
+     */
+    _node_pool<leaf,Alloc> leaves;
+    _node_pool<inner,Alloc> inners;
+    bnode* head{nullptr};
+    leaf* first{nullptr};               // the left most leaf
+    leaf* tail{nullptr};                // the right most leaf
+    std::size_t items{0};               // number of pairs, for size()
+    OP cmp;
+
+
+    /**
+     * @return position of the first key of x not smaller than k
+     */
+    std::size_t _lower(const bnode* x, const k_t& k) const {
+        return std::lower_bound(x->keys, x->keys + x->count, k, cmp) - x->keys;
+    }
+
+    /**
+     * @return position of the first key of x bigger than k
+     */
+    std::size_t _upper(const bnode* x, const k_t& k) const {
+        return std::upper_bound(x->keys, x->keys + x->count, k, cmp) - x->keys;
+    }
+
+    /**
+     * @brief Traverse the tree from the root to the leaf that contains
+     * the first key bigger than k, if any
+     *
+     * @return the leaf and the position of such key
+     */
+    position _upper_bound(const k_t& k) const {
+        auto x = head;
+        if(!x){return position{nullptr, 0, false};}
+        while(!x->is_leaf){
+            auto in = static_cast<const inner*>(x);
+            x = in->children[_upper(in, k)];
+        }
+        auto l = static_cast<leaf*>(x);
+        return position{l, _upper(l, k), false};
+    }
+
+    /**
+     * @brief Position one past the end of a leaf is the first one of the next leaf
+     */
+    static position _normalize(position where) noexcept {
+        if(where.l && where.i == where.l->count){
+            where.l = where.l->next;
+            where.i = 0;
+        }
+        return where;
+    }
+
+    /**
+     * @brief Traverse the tree from the root to the leaf that may contain k
+     *
+     * @param k key to look for
+     * @return the leaf and the position of the first key not smaller than k
+     */
+    position _locate(const k_t& k) const {
+        auto x = head;
+        if(!x){return position{nullptr, 0, false};}
+        while(!x->is_leaf){
+            auto in = static_cast<const inner*>(x);
+            x = in->children[_upper(in, k)];
+        }
+        auto l = static_cast<leaf*>(x);
+        auto i = _lower(l, k);
+        return position{l, i, i < l->count && !cmp(k, l->keys[i])};
+    }
+
+    /**
+     * @return position of x among the children of its parent
+     */
+    static std::size_t _child_index(const bnode* x) noexcept {
+        auto p = x->parent;
+        std::size_t i = 0;
+        while(p->children[i] != x){++i;}
+        return i;
+    }
+
+    /**
+     * @brief Insert a new pair in position i of the leaf l.
+     * A full leaf is split in two halves first, and the first key
+     * of the new right half is inserted in the parent
+     *
+     * @return iterator to the new pair
+     */
+    template <typename K, typename V>
+    iterator _insert_at(leaf* l, std::size_t i, K&& k, V&& v){
+        if(!l){                                             // empty tree
+            l = leaves.create();
+            head = first = tail = l;
+        }
+
+        if(l->count == order){
+            auto r = leaves.create();
+            std::size_t half = (order + 1) / 2;
+            std::move(l->keys + half, l->keys + order, r->keys);
+            std::move(l->values + half, l->values + order, r->values);
+            r->count = order - half;
+            l->count = half;
+
+            r->next = l->next;                              // link r after l
+            if(r->next){r->next->prev = r;}
+            else{tail = r;}
+            r->prev = l;
+            l->next = r;
+
+            _insert_parent(l, r->keys[0], r);
+
+            // the new key never goes in front of r, otherwise it would
+            // be smaller than the separator of r in the parent
+            if(i > half){
+                l = r;
+                i -= half;
+            }
+        }
+
+        std::move_backward(l->keys + i, l->keys + l->count, l->keys + l->count + 1);
+        std::move_backward(l->values + i, l->values + l->count, l->values + l->count + 1);
+        l->keys[i] = std::forward<K>(k);
+        l->values[i] = std::forward<V>(v);
+        ++l->count;
+        ++items;
+        return iterator{l, i, &tail};
+    }
+
+    /**
+     * @brief Insert the separator sep and the new node right,
+     * that follows left, in the parent of left.
+     * A full parent is split in turn, moving its middle key up
+     *
+     * @param left node that has just been split
+     * @param sep the first key of right
+     * @param right the new node
+     */
+    void _insert_parent(bnode* left, const k_t& sep, bnode* right){
+        auto p = left->parent;
+        if(!p){                                             // left was the root: the tree grows
+            p = inners.create();
+            p->keys[0] = sep;
+            p->children[0] = left;
+            p->children[1] = right;
+            p->count = 1;
+            left->parent = right->parent = p;
+            head = p;
+            return;
+        }
+
+        auto ci = _child_index(left);
+        if(p->count < order){
+            std::move_backward(p->keys + ci, p->keys + p->count, p->keys + p->count + 1);
+            std::move_backward(p->children + ci + 1, p->children + p->count + 1, p->children + p->count + 2);
+            p->keys[ci] = sep;
+            p->children[ci + 1] = right;
+            right->parent = p;
+            ++p->count;
+            return;
+        }
+
+        // p is full: gather its keys and children with the new ones and split them
+        k_t keys[order + 1];
+        bnode* children[order + 2];
+        std::move(p->keys, p->keys + ci, keys);
+        keys[ci] = sep;
+        std::move(p->keys + ci, p->keys + order, keys + ci + 1);
+        std::copy(p->children, p->children + ci + 1, children);
+        children[ci + 1] = right;
+        std::copy(p->children + ci + 1, p->children + order + 1, children + ci + 2);
+
+        auto q = inners.create();
+        std::size_t half = order / 2;                       // keys[half] goes up
+        std::move(keys, keys + half, p->keys);
+        std::copy(children, children + half + 1, p->children);
+        p->count = half;
+        std::move(keys + half + 1, keys + order + 1, q->keys);
+        std::copy(children + half + 1, children + order + 2, q->children);
+        q->count = order - half;
+
+        for(std::size_t j = 0; j <= p->count; ++j){p->children[j]->parent = p;}
+        for(std::size_t j = 0; j <= q->count; ++j){q->children[j]->parent = q;}
+
+        _insert_parent(p, keys[half], q);
+    }
+
+    /**
+     * @brief Remove the pair in position i of the leaf l.
+     * If the leaf has less than min_keys keys it borrows one from
+     * a sibling or it is merged with it
+     */
+    void _erase_at(leaf* l, std::size_t i){
+        std::move(l->keys + i + 1, l->keys + l->count, l->keys + i);
+        std::move(l->values + i + 1, l->values + l->count, l->values + i);
+        --l->count;
+        --items;
+        l->keys[l->count] = k_t{};                          // release the resources of the moved-from pair
+        l->values[l->count] = v_t{};
+
+        if(l == head){
+            if(!l->count){                                  // the tree is now empty
+                leaves.destroy(l);
+                head = first = tail = nullptr;
+            }
+            return;
+        }
+        if(l->count >= min_keys){return;}
+
+        auto p = l->parent;
+        auto ci = _child_index(l);
+        auto left = ci > 0 ? static_cast<leaf*>(p->children[ci - 1]) : nullptr;
+        auto right = ci < p->count ? static_cast<leaf*>(p->children[ci + 1]) : nullptr;
+
+        if(left && left->count > min_keys){                 // borrow the last pair of the left sibling
+            std::move_backward(l->keys, l->keys + l->count, l->keys + l->count + 1);
+            std::move_backward(l->values, l->values + l->count, l->values + l->count + 1);
+            --left->count;
+            l->keys[0] = std::move(left->keys[left->count]);
+            l->values[0] = std::move(left->values[left->count]);
+            ++l->count;
+            p->keys[ci - 1] = l->keys[0];
+        }
+        else if(right && right->count > min_keys){          // borrow the first pair of the right sibling
+            l->keys[l->count] = std::move(right->keys[0]);
+            l->values[l->count] = std::move(right->values[0]);
+            ++l->count;
+            std::move(right->keys + 1, right->keys + right->count, right->keys);
+            std::move(right->values + 1, right->values + right->count, right->values);
+            --right->count;
+            p->keys[ci] = right->keys[0];
+        }
+        else if(left){                                      // merge l into the left sibling
+            _merge_leaves(left, l);
+            _remove_child(p, ci);
+        }
+        else{                                               // merge the right sibling into l
+            _merge_leaves(l, right);
+            _remove_child(p, ci + 1);
+        }
+    }
+
+    /**
+     * @brief Move all the pairs of r at the end of l and destroy r
+     */
+    void _merge_leaves(leaf* l, leaf* r){
+        std::move(r->keys, r->keys + r->count, l->keys + l->count);
+        std::move(r->values, r->values + r->count, l->values + l->count);
+        l->count += r->count;
+        l->next = r->next;
+        if(l->next){l->next->prev = l;}
+        else{tail = l;}
+        leaves.destroy(r);
+    }
+
+    /**
+     * @brief Remove the child in position ci (ci > 0) of p, together with
+     * the separator before it. If p has less than min_keys keys it borrows
+     * one from a sibling (through the parent) or it is merged with it
+     */
+    void _remove_child(inner* p, std::size_t ci){
+        std::move(p->keys + ci, p->keys + p->count, p->keys + ci - 1);
+        std::copy(p->children + ci + 1, p->children + p->count + 1, p->children + ci);
+        --p->count;
+
+        if(p == head){
+            if(!p->count){                                  // the tree shrinks
+                head = p->children[0];
+                head->parent = nullptr;
+                inners.destroy(p);
+            }
+            return;
+        }
+        if(p->count >= min_keys){return;}
+
+        auto g = p->parent;
+        auto pi = _child_index(p);
+        auto left = pi > 0 ? static_cast<inner*>(g->children[pi - 1]) : nullptr;
+        auto right = pi < g->count ? static_cast<inner*>(g->children[pi + 1]) : nullptr;
+
+        if(left && left->count > min_keys){                 // rotate a child from the left sibling
+            std::move_backward(p->keys, p->keys + p->count, p->keys + p->count + 1);
+            std::copy_backward(p->children, p->children + p->count + 1, p->children + p->count + 2);
+            p->keys[0] = std::move(g->keys[pi - 1]);
+            p->children[0] = left->children[left->count];
+            p->children[0]->parent = p;
+            ++p->count;
+            g->keys[pi - 1] = std::move(left->keys[left->count - 1]);
+            --left->count;
+        }
+        else if(right && right->count > min_keys){          // rotate a child from the right sibling
+            p->keys[p->count] = std::move(g->keys[pi]);
+            p->children[p->count + 1] = right->children[0];
+            p->children[p->count + 1]->parent = p;
+            ++p->count;
+            g->keys[pi] = std::move(right->keys[0]);
+            std::move(right->keys + 1, right->keys + right->count, right->keys);
+            std::copy(right->children + 1, right->children + right->count + 1, right->children);
+            --right->count;
+        }
+        else if(left){                                      // merge p into the left sibling
+            _merge_inners(left, std::move(g->keys[pi - 1]), p);
+            _remove_child(g, pi);
+        }
+        else{                                               // merge the right sibling into p
+            _merge_inners(p, std::move(g->keys[pi]), right);
+            _remove_child(g, pi + 1);
+        }
+    }
+
+    /**
+     * @brief Move the separator sep and all the keys and children
+     * of r at the end of l, then destroy r
+     */
+    void _merge_inners(inner* l, k_t sep, inner* r){
+        l->keys[l->count] = std::move(sep);
+        std::move(r->keys, r->keys + r->count, l->keys + l->count + 1);
+        std::copy(r->children, r->children + r->count + 1, l->children + l->count + 1);
+        for(std::size_t j = 0; j <= r->count; ++j){r->children[j]->parent = l;}
+        l->count += r->count + 1;
+        inners.destroy(r);
+    }
+
+    /**
+     * @brief Destroy the subtree rooted in x, recursively
+     * (the recursion depth is the height of the tree)
+     */
+    void _destroy(bnode* x) noexcept {
+        if(x->is_leaf){
+            leaves.destroy(static_cast<leaf*>(x));
+            return;
+        }
+        auto in = static_cast<inner*>(x);
+        for(std::size_t j = 0; j <= in->count; ++j){_destroy(in->children[j]);}
+        inners.destroy(in);
+    }
+
+    /**
+     * @brief Build the tree bottom-up out of n sorted pairs without
+     * duplicate keys: the pairs are spread evenly over the leaves,
+     * then each level of inner nodes is built over the previous one
+     *
+     * @param n number of pairs
+     * @param next callable that writes the next pair in the given key and value
+     */
+    template <typename F>
+    void _build(std::size_t n, F next){
+        if(!n){return;}
+        items = n;
+
+        std::vector<bnode*> level;
+        std::vector<const k_t*> smallest;                   // the smallest key under each node of level
+
+        std::size_t count = (n + order - 1) / order;
+        leaf* prev = nullptr;
+        for(std::size_t j = 0; j < count; ++j){
+            auto l = leaves.create();
+            l->count = n / count + (j < n % count);
+            for(std::size_t t = 0; t < l->count; ++t){next(l->keys[t], l->values[t]);}
+            l->prev = prev;
+            if(prev){prev->next = l;}
+            else{first = l;}
+            prev = l;
+            level.push_back(l);
+            smallest.push_back(&l->keys[0]);
+        }
+        tail = prev;
+
+        while(level.size() > 1){
+            std::vector<bnode*> up;
+            std::vector<const k_t*> up_smallest;
+            auto m = level.size();
+            count = (m + order) / (order + 1);
+            for(std::size_t j = 0, k = 0; j < count; ++j){
+                auto in = inners.create();
+                std::size_t children = m / count + (j < m % count);
+                for(std::size_t t = 0; t < children; ++t, ++k){
+                    in->children[t] = level[k];
+                    level[k]->parent = in;
+                    if(t){in->keys[t - 1] = *smallest[k];}
+                }
+                in->count = children - 1;
+                up.push_back(in);
+                up_smallest.push_back(smallest[k - children]);
+            }
+            level.swap(up);
+            smallest.swap(up_smallest);
+        }
+        head = level[0];
+    }
+
+    /**
+     * @brief Auxiliary function to check whether the keys
+     * of a range are strictly increasing (wrt OP)
+     */
+    template <typename It>
+    bool _is_strictly_sorted(It first, It last) const {
+        if(first == last){return true;}
+        for(auto next = std::next(first); next != last; ++first, ++next){
+            if(!cmp(first->first, next->first)){return false;}
+        }
+        return true;
+    }
+
+    /**
+     * @brief Auxiliary function of bulk_load, for a random access range:
+     * if it is already sorted the tree is built straight from it
+     */
+    template <typename It>
+    void _bulk_load(It first, It last, std::random_access_iterator_tag){
+        if(!_is_strictly_sorted(first, last)){
+            _bulk_load(first, last, std::input_iterator_tag{});
+            return;
+        }
+        _build(last - first, [&first](k_t& k, v_t& v){
+            k = first->first;
+            v = first->second;
+            ++first;
+        });
+    }
+
+    /**
+     * @brief Auxiliary function of bulk_load, for any other range:
+     * the pairs are copied into a vector, sorted by key and
+     * deduplicated (the first pair with a given key wins) if needed
+     */
+    template <typename It>
+    void _bulk_load(It first, It last, std::input_iterator_tag){
+        std::vector<std::pair<k_t,v_t>> ordered(first, last);
+
+        if(!_is_strictly_sorted(ordered.begin(), ordered.end())){
+            auto by_key = [this](const std::pair<k_t,v_t>& a, const std::pair<k_t,v_t>& b){
+                return cmp(a.first, b.first);
+            };
+            auto same_key = [this](const std::pair<k_t,v_t>& a, const std::pair<k_t,v_t>& b){
+                return !cmp(a.first, b.first);
+            };
+            std::stable_sort(ordered.begin(), ordered.end(), by_key);
+            ordered.erase(std::unique(ordered.begin(), ordered.end(), same_key), ordered.end());
+        }
+
+        auto i = ordered.begin();
+        _build(ordered.size(), [&i](k_t& k, v_t& v){
+            k = std::move(i->first);
+            v = std::move(i->second);
+            ++i;
+        });
+    }
+
+    /**
+     * @brief Auxiliary function to implement insert, through forwarding references
+     */
+    template <typename O>
+    std::pair<iterator, bool> _insert(O&& x){
+        auto where = _locate(x.first);
+        if(where.found){
+            return std::pair<iterator, bool>{iterator{where.l, where.i, &tail}, false};
+        }
+        return std::pair<iterator, bool>{_insert_at(where.l, where.i, std::forward<O>(x).first, std::forward<O>(x).second), true};
+    }
+
+    /**
+     * @brief Auxiliary function to implement insert with hint: if the key
+     * belongs right before hint, in the same leaf, there is no traversal
+     */
+    template <typename O>
+    iterator _insert(const_iterator hint, O&& x){
+        auto l = hint.where();
+        auto i = hint.position();
+        if(!l){                                             // hint is end()
+            l = tail;
+            i = l ? l->count : 0;
+        }
+        // in front of a leaf (but the first one) the key could be
+        // smaller than the separator of the leaf: do a normal insertion
+        bool fits = l && (i > 0 || l == first)
+                       && (i == l->count || cmp(x.first, l->keys[i]))
+                       && (i == 0 || cmp(l->keys[i - 1], x.first));
+        if(fits){
+            return _insert_at(l, i, std::forward<O>(x).first, std::forward<O>(x).second);
+        }
+        return _insert(std::forward<O>(x)).first;
+    }
+
+    /**
+     * @brief Auxiliary function to implement try_emplace
+     */
+    template <typename K, typename... Types>
+    std::pair<iterator, bool> _try_emplace(K&& k, Types&&... args){
+        auto where = _locate(k);
+        if(where.found){
+            return std::pair<iterator, bool>{iterator{where.l, where.i, &tail}, false};
+        }
+        return std::pair<iterator, bool>{_insert_at(where.l, where.i, std::forward<K>(k), v_t(std::forward<Types>(args)...)), true};
+    }
+
+public:
+
+    /**
+     * @brief Default ctor
+     *
+     */
+    bst() noexcept = default;
+
+    /**
+     * @brief Custom ctor, no implicit conversion
+     *
+     * @param a the allocator the nodes are obtained from
+     */
+    explicit bst(const Alloc& a) noexcept: leaves{a}, inners{a} {}
+
+    /**
+     * @brief Custom ctor, it builds the tree out of a range of pairs (see bulk_load)
+     */
+    template <typename It>
+    bst(It first, It last, const Alloc& a = Alloc{}): leaves{a}, inners{a} {bulk_load(first, last);}
+
+    /**
+     * @brief Dtor, it releases the node pools through clear
+     *
+     */
+    ~bst() noexcept {clear();}
+
+    /**
+     * @brief Move ctor, the nodes (and their pools) are stolen from x
+     */
+    bst(bst&& x) noexcept:
+        leaves{std::move(x.leaves)}, inners{std::move(x.inners)},
+        head{x.head}, first{x.first}, tail{x.tail}, items{x.items}, cmp{std::move(x.cmp)} {
+        x.head = x.first = x.tail = nullptr;
+        x.items = 0;
+    }
+
+    /**
+     * @brief Move assignment
+     */
+    bst& operator=(bst&& x) noexcept {
+        clear();
+        leaves = std::move(x.leaves);
+        inners = std::move(x.inners);
+        head = x.head;
+        first = x.first;
+        tail = x.tail;
+        items = x.items;
+        cmp = std::move(x.cmp);
+        x.head = x.first = x.tail = nullptr;
+        x.items = 0;
+        return *this;
+    }
+
+    /**
+     * @brief Copy ctor, the leaves are rebuilt bottom-up from those of x
+     */
+    bst(const bst& x): leaves{x.leaves.get_allocator()}, inners{x.inners.get_allocator()}, cmp{x.cmp} {
+        auto i = x.cbegin();
+        _build(x.items, [&i](k_t& k, v_t& v){
+            k = *i;
+            v = i.value();
+            ++i;
+        });
+    }
+
+    /**
+     * @brief Copy assignment
+     */
+    bst& operator=(const bst& x){
+        auto tmp{x};
+        *(this) = std::move(tmp);
+        return *this;
+    }
+
+    /**
+     * @return iterator to the smallest key
+     */
+    iterator begin() noexcept {return iterator{first, 0, &tail};}
+
+    /**
+     * @return const_iterator to the smallest key
+     */
+    const_iterator begin() const noexcept {return const_iterator{first, 0, &tail};}
+
+    /**
+     * @return const_iterator to the smallest key
+     */
+    const_iterator cbegin() const noexcept {return const_iterator{first, 0, &tail};}
+
+    /**
+     * @return reverse iterator to the biggest key
+     */
+    reverse_iterator rbegin() noexcept {return reverse_iterator{end()};}
+
+    /**
+     * @return const reverse iterator to the biggest key
+     */
+    const_reverse_iterator rbegin() const noexcept {return const_reverse_iterator{end()};}
+
+    /**
+     * @return const reverse iterator to the biggest key
+     */
+    const_reverse_iterator crbegin() const noexcept {return const_reverse_iterator{cend()};}
+
+    /**
+     * @return reverse iterator to one before the smallest key
+     */
+    reverse_iterator rend() noexcept {return reverse_iterator{begin()};}
+
+    /**
+     * @return const reverse iterator to one before the smallest key
+     */
+    const_reverse_iterator rend() const noexcept {return const_reverse_iterator{begin()};}
+
+    /**
+     * @return const reverse iterator to one before the smallest key
+     */
+    const_reverse_iterator crend() const noexcept {return const_reverse_iterator{cbegin()};}
+
+    /**
+     * @return iterator to one past the last key
+     */
+    iterator end() noexcept {return iterator{nullptr, 0, &tail};}
+
+    /**
+     * @return const_iterator to one past the last key
+     */
+    const_iterator end() const noexcept {return const_iterator{nullptr, 0, &tail};}
+
+    /**
+     * @return const_iterator to one past the last key
+     */
+    const_iterator cend() const noexcept {return const_iterator{nullptr, 0, &tail};}
+
+    /**
+     * @brief Find a given key. If the key is present, returns an iterator to it, end() otherwise.
+     */
+    iterator find(const k_t& x) {
+        auto where = _locate(x);
+        return where.found ? iterator{where.l, where.i, &tail} : end();
+    }
+
+    /**
+     * @brief Find a given key. If the key is present, returns an iterator to it, end() otherwise.
+     */
+    const_iterator find(const k_t& x) const {
+        auto where = _locate(x);
+        return where.found ? const_iterator{where.l, where.i, &tail} : end();
+    }
+
+    /**
+     * @return the number of pairs in the tree, in constant time
+     */
+    std::size_t size() const noexcept {return items;}
+
+    /**
+     * @brief Find the first key that is not smaller than x
+     */
+    iterator lower_bound(const k_t& x) {
+        auto where = _normalize(_locate(x));
+        return iterator{where.l, where.i, &tail};
+    }
+
+    /**
+     * @brief Find the first key that is not smaller than x
+     */
+    const_iterator lower_bound(const k_t& x) const {
+        auto where = _normalize(_locate(x));
+        return const_iterator{where.l, where.i, &tail};
+    }
+
+    /**
+     * @brief Find the first key that is bigger than x
+     */
+    iterator upper_bound(const k_t& x) {
+        auto where = _normalize(_upper_bound(x));
+        return iterator{where.l, where.i, &tail};
+    }
+
+    /**
+     * @brief Find the first key that is bigger than x
+     */
+    const_iterator upper_bound(const k_t& x) const {
+        auto where = _normalize(_upper_bound(x));
+        return const_iterator{where.l, where.i, &tail};
+    }
+
+    /**
+     * @brief Range of the keys equivalent to x (empty or a single key),
+     * with a single traversal
+     */
+    std::pair<iterator, iterator> equal_range(const k_t& x) {
+        auto where = _locate(x);
+        auto next = _normalize(position{where.l, where.i + where.found, false});
+        where = _normalize(where);
+        return std::pair<iterator, iterator>{iterator{where.l, where.i, &tail}, iterator{next.l, next.i, &tail}};
+    }
+
+    /**
+     * @brief Range of the keys equivalent to x (empty or a single key),
+     * with a single traversal
+     */
+    std::pair<const_iterator, const_iterator> equal_range(const k_t& x) const {
+        auto where = _locate(x);
+        auto next = _normalize(position{where.l, where.i + where.found, false});
+        where = _normalize(where);
+        return std::pair<const_iterator, const_iterator>{const_iterator{where.l, where.i, &tail}, const_iterator{next.l, next.i, &tail}};
+    }
+
+    /**
+     * @brief It is used to insert a new pair.
+     * The bool is true if the pair has been inserted,
+     * false otherwise (i.e., the key was already present in the tree)
+     */
+    std::pair<iterator, bool> insert(const std::pair<k_t, v_t>& x) {return _insert(x);}
+
+    /**
+     * @brief It is used to insert a new pair.
+     * The bool is true if the pair has been inserted,
+     * false otherwise (i.e., the key was already present in the tree)
+     */
+    std::pair<iterator, bool> insert(std::pair<k_t, v_t>&& x) {return _insert(std::move(x));}
+
+    /**
+     * @brief It is used to insert a new pair, close to hint.
+     * If the key belongs right before hint the insertion is
+     * amortized constant time (e.g. hint = end() when the keys come in order)
+     */
+    iterator insert(const_iterator hint, const std::pair<k_t, v_t>& x) {return _insert(hint, x);}
+
+    /**
+     * @brief It is used to insert a new pair, close to hint.
+     * If the key belongs right before hint the insertion is
+     * amortized constant time (e.g. hint = end() when the keys come in order)
+     */
+    iterator insert(const_iterator hint, std::pair<k_t, v_t>&& x) {return _insert(hint, std::move(x));}
+
+    /**
+     * @brief Inserts a new pair constructed with the given args,
+     * if there is no pair with the key in the container
+     */
+    template <typename... Types>
+    std::pair<iterator,bool> emplace(Types&&... args){
+        return _insert(std::pair<k_t,v_t>(std::forward<Types>(args)...));
+    }
+
+    /**
+     * @brief If the key is not present, inserts a new pair with the given key
+     * and the value constructed from args; otherwise it does nothing
+     */
+    template <typename... Types>
+    std::pair<iterator,bool> try_emplace(const k_t& k, Types&&... args){
+        return _try_emplace(k, std::forward<Types>(args)...);
+    }
+
+    /**
+     * @brief If the key is not present, inserts a new pair with the given key
+     * and the value constructed from args; otherwise it does nothing
+     */
+    template <typename... Types>
+    std::pair<iterator,bool> try_emplace(k_t&& k, Types&&... args){
+        return _try_emplace(std::move(k), std::forward<Types>(args)...);
+    }
+
+    /**
+     * @brief If the key is present, assigns obj to its value;
+     * otherwise inserts a new pair with the given key and value
+     */
+    template <typename M>
+    std::pair<iterator,bool> insert_or_assign(const k_t& k, M&& obj){
+        auto res = _try_emplace(k, std::forward<M>(obj));
+        if(!res.second){res.first.value() = std::forward<M>(obj);}
+        return res;
+    }
+
+    /**
+     * @brief If the key is present, assigns obj to its value;
+     * otherwise inserts a new pair with the given key and value
+     */
+    template <typename M>
+    std::pair<iterator,bool> insert_or_assign(k_t&& k, M&& obj){
+        auto res = _try_emplace(std::move(k), std::forward<M>(obj));
+        if(!res.second){res.first.value() = std::forward<M>(obj);}
+        return res;
+    }
+
+    /**
+     * @brief Clear the content of the tree.
+     * If the pairs have a trivial destructor the nodes are simply forgotten,
+     * otherwise they are destroyed; then all the blocks of the node pools are released
+     */
+    void clear() noexcept {
+        if(head && !(std::is_trivially_destructible<k_t>::value && std::is_trivially_destructible<v_t>::value)){
+            _destroy(head);
+        }
+        head = first = tail = nullptr;
+        items = 0;
+        leaves.release();
+        inners.release();
+    }
+
+    /**
+     * @return a copy of the allocator of the node pools
+     */
+    Alloc get_allocator() const {return leaves.get_allocator();}
+
+    /**
+     * @brief Replaces the content of the tree with the pairs in [first, last),
+     * building the leaves and then the inner nodes bottom-up, in linear time.
+     * Unsorted ranges are copied, sorted and deduplicated first
+     * (the first pair with a given key wins, as with insert)
+     */
+    template <typename It>
+    void bulk_load(It first, It last){
+        clear();
+        _bulk_load(first, last, typename std::iterator_traits<It>::iterator_category{});
+    }
+
+    /**
+     * @brief A B+ tree is always balanced: nothing to do
+     */
+    void balance() noexcept {}
+
+    /**
+     * @brief Takes an immutable snapshot of the tree (see bits_bst_frozen.hpp)
+     */
+    frozen_bst<k_t,v_t,OP> freeze() const {
+        return frozen_bst<k_t,v_t,OP>{cbegin(), cend(), cmp};
+    }
+
+    /**
+     * @brief Writes the pairs to a binary snapshot file (see bits_bst_snapshot.hpp)
+     */
+    void save(const std::string& path) const {
+        _save_snapshot<k_t,v_t>(path, cbegin(), cend(), items);
+    }
+
+    /**
+     * @brief Replaces the content with the pairs of a snapshot file, built
+     * straight from the mapping as in bulk_load (see bst::load)
+     */
+    void load(const std::string& path){
+        mapped_snapshot<k_t,v_t,OP> file{path, cmp};
+        file.advise(MADV_SEQUENTIAL);
+        if(!file.is_sorted()){
+            std::vector<std::pair<k_t,v_t>> pairs;
+            pairs.reserve(file.size());
+            for(auto i = file.cbegin(); i != file.cend(); ++i){pairs.emplace_back(*i, i.value());}
+            bulk_load(std::make_move_iterator(pairs.begin()), std::make_move_iterator(pairs.end()));
+            return;
+        }
+        clear();
+        auto pairs = file.pairs();
+        std::size_t i = 0;
+        _build(file.size(), [&pairs, &i](k_t& k, v_t& v){
+            k = pairs.keys[i];
+            v = pairs.values[i];
+            ++i;
+        });
+    }
+
+    /**
+     * @brief Removes the pair (if one exists) with the key equivalent to x
+     */
+    void erase(const k_t& x){
+        auto where = _locate(x);
+        if(!where.found){
+            std::cerr << "ERROR: no element has key = " << x << std::endl;
+            return;
+        }
+        _erase_at(where.l, where.i);
+    }
+
+    /**
+     * @brief Overload of operator put to
+     */
+    friend
+    std::ostream& operator<<(std::ostream& os, const bst& x){
+        if(!x.head){os << "WARNING: empty tree"; return os;}
+
+        for(auto& key : x){
+            os << key << " ";
+        }
+        os << std::endl;
+        return os;
+    }
+
+    /**
+     * Overload of subscripting operator
+     * Returns a reference to the value that is mapped
+     * to a key equivalent to x, performing an insertion if such key does not already exist
+     */
+    v_t& operator[](const k_t& x) {return try_emplace(x).first.value();}
+
+    /**
+     * Overload of subscripting operator
+     * Returns a reference to the value that is mapped
+     * to a key equivalent to x, performing an insertion if such key does not already exist
+     */
+    v_t& operator[](k_t&& x) {return try_emplace(std::move(x)).first.value();}
+};
+
+#endif
@@ -3,6 +3,17 @@
 #include "bits_bst.hpp"
 #include "bits_bst_iterator.hpp"
 #include "bits_bst_node.hpp"
+#include "bits_bst_balance.hpp"
+#include "bits_bst_pool.hpp"
+#include "bits_bst_frozen.hpp"
+#include "bits_bst_snapshot.hpp"
+#include "bits_btree.hpp"
+#include "bits_bst_compact.hpp"
+#include "bits_bst_concurrent.hpp"
+#include "bits_bst_sharded.hpp"
+#include "bits_bst_persistent.hpp"
+#include "bits_bst_mapped.hpp"
+#include "bits_bst_durable.hpp"
 
 
 #endif
\ No newline at end of file